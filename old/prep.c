@@ -0,0 +1,5 @@
+#include "src/prep.h"
+
+int main(int argc, char **argv){
+  return qloop_prep_main(argc, argv);
+}
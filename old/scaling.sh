@@ -0,0 +1,142 @@
+#!/bin/sh
+
+##################################################
+# end-to-end scaling benchmark on synthetic data
+#  strong scaling : each size of SIZES at every thread count of THREADS
+#  weak scaling   : WEAK_BASE x t bp at t threads
+# for every run, twin (train) and pred are timed, and the planted k-mer
+# pairs of the generator (<data>.truth) are matched against the axes
+# selected by twin. The table is written to ${OUT_DIR}/scaling.tsv.
+#
+# usage: [K=4] [THREADS="1 2 4"] [SIZES="..."] ... ./scaling.sh
+##################################################
+
+set -eu
+
+PROG_DIR=${PROG_DIR:-$(cd $(dirname $0) && pwd)}
+OUT_DIR=${OUT_DIR:-./scaling}
+
+K=${K:-4}
+RES=${RES:-1000}
+THREADS=${THREADS:-"1 2 4"}
+SIZES=${SIZES:-"500000 1000000 2000000"}
+WEAK_BASE=${WEAK_BASE:-500000}
+DMAX=${DMAX:-20}
+PLANTED=${PLANTED:-5}
+SNR=${SNR:-4}
+SEED=${SEED:-20160721}
+iter1=${iter1:-50}
+iter2=${iter2:-1}
+acc=${acc:-0.1}
+f_norm="L1"
+
+now () {
+    date +%s.%N
+}
+
+elapsed () {
+    awk -v a=$1 -v b=$2 'BEGIN { printf "%.3f", b - a }'
+}
+
+# synthetic data of $1 bp into ${OUT_DIR}/s$1
+gen () {
+    if [ ! -e ${OUT_DIR}/s$1.truth ]; then
+	${PROG_DIR}/synth \
+	    -k ${K} \
+	    --res ${RES} \
+	    --len $1 \
+	    --gaps $(($1 / 200000)) \
+	    --gap_len 5000 \
+	    --dmax ${DMAX} \
+	    --planted ${PLANTED} \
+	    --snr ${SNR} \
+	    --seed ${SEED} \
+	    --f_norm ${f_norm} \
+	    --out ${OUT_DIR}/s$1 2> ${OUT_DIR}/s$1.log
+    fi
+}
+
+# run twin and pred on ${OUT_DIR}/s$2 with $3 threads,
+# print a row of the table ($1 : strong|weak, $4 : reference train time)
+run () {
+    DATA=${OUT_DIR}/s$2
+    RUN=${DATA}.t$3
+
+    t0=$(now)
+    ${PROG_DIR}/twin \
+	-k ${K} \
+	--res ${RES} \
+	--iter1 ${iter1} \
+	--iter2 ${iter2} \
+	--acc ${acc} \
+	--fasta ${DATA}.fa \
+	--hic ${DATA}.hic \
+	--kmer ${DATA}.ckp \
+	--f_norm ${f_norm} \
+	--thread_num $3 \
+	--out ${RUN}.res 2> ${RUN}.log
+    t1=$(now)
+    ${PROG_DIR}/pred \
+	-k ${K} \
+	--res ${RES} \
+	--fasta ${DATA}.fa \
+	--hic ${DATA}.hic \
+	--kmer ${DATA}.ckp \
+	--pri ${RUN}.res \
+	--f_norm ${f_norm} \
+	--thread_num $3 \
+	--out ${RUN}.self 2>> ${RUN}.log
+    t2=$(now)
+
+    train=$(elapsed ${t0} ${t1})
+    ref=${4:-${train}}
+    recovered=$(awk 'FNR == 1 { next }
+		     NR == FNR { truth[$1] = 1; n++; next }
+		     ($1 > 0) && ($2 in truth) && !($2 in hit) { hit[$2] = 1; r++ }
+		     END { printf "%d/%d", r, n }' ${DATA}.truth ${RUN}.res)
+
+    # strong : speedup = T(first) / T(t), efficiency = speedup / t
+    # weak   : speedup = t x T(first) / T(t), efficiency = T(first) / T(t)
+    awk -v mode=$1 -v size=$2 -v t=$3 -v train=${train} -v ref=${ref} \
+	-v pred=$(elapsed ${t1} ${t2}) -v rec=${recovered} \
+	-v rows=$(wc -l < ${DATA}.hic) \
+	'BEGIN {
+	   s = (mode == "strong") ? ref / train : t * ref / train;
+	   printf "%s\t%d\t%d\t%d\t%.3f\t%.3f\t%.3f\t%.3f\t%s\n",
+		  mode, size, rows, t, train, pred, s, s / t, rec
+	 }' | tee -a ${OUT_DIR}/scaling.tsv
+
+    LAST_TRAIN=${train}
+}
+
+##################################################
+# preparation step
+##################################################
+mkdir -p ${OUT_DIR}
+(cd ${PROG_DIR} && make twin pred synth > /dev/null)
+
+printf "mode\tbp\trows\tthreads\ttrain_s\tpred_s\tspeedup\tefficiency\trecovered\n" \
+    | tee ${OUT_DIR}/scaling.tsv
+
+##################################################
+# strong scaling
+##################################################
+for size in ${SIZES}; do
+    gen ${size}
+    REF=""
+    for t in ${THREADS}; do
+	run strong ${size} ${t} ${REF}
+	REF=${REF:-${LAST_TRAIN}}
+    done
+done
+
+##################################################
+# weak scaling
+##################################################
+REF=""
+for t in ${THREADS}; do
+    size=$((WEAK_BASE * t))
+    gen ${size}
+    run weak ${size} ${t} ${REF}
+    REF=${REF:-${LAST_TRAIN}}
+done
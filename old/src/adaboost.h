@@ -3,6 +3,7 @@
 
 #include <sys/time.h>
 #include <math.h>
+#include <stdint.h>
 #include <pthread.h>
 #include "calloc_errchk.h"
 #include "diffSec.h"
@@ -10,6 +11,12 @@
 #include "hic.h"
 
 
+/* memory budget of the cached prediction bitmaps (bytes), the other
+ * k-mer pairs are predicted row by row at every iteration */
+#ifndef ADABOOST_BITMAP_BUDGET
+#define ADABOOST_BITMAP_BUDGET (1UL << 30)
+#endif
+
 /* adaboost results*/
 #if 0
 typedef struct _adaboost{
@@ -51,6 +58,19 @@ typedef struct _adaboost_comp_err_args{
   /* array with N elements */
   double *p;
   unsigned int *y;
+  /**
+   * bitmaps of the k-mer pairs [0, cached) : bit x of pair lm is set if
+   * the prediction of lm for row x differs from y[x] (words per pair)
+   */
+  unsigned long words;
+  unsigned long cached;
+  uint64_t *bitmap;
+  /* best stumps of the range of the thread (found == 0 : none) */
+  int found;
+  double min;
+  double max;
+  unsigned long argmin;
+  unsigned long argmax;
 } adaboost_comp_err_args;
 
 
@@ -66,6 +86,13 @@ int adaboost_show_all(FILE *fp,
 		      const char **kmer_strings,
 		      const canonical_kp *kp);
 
+unsigned int adaboost_pred(const adaboost_comp_err_args *params,
+			   const unsigned long x,
+			   const unsigned long kmerpair);
+void *adaboost_set_bitmap(void *args);
+double adaboost_masked_sum(const uint64_t *bitmap,
+			   const double *p,
+			   const unsigned long N);
 void *adaboost_comp_err(void *args);
 
 int adaboost_set_y(hic *hic,
@@ -120,27 +147,105 @@ int adaboost_show_all(FILE *fp,
   return 0;
 }
 		      
+/* stump of kmerpair for row x (1 : pred > 0) */
+unsigned int adaboost_pred(const adaboost_comp_err_args *params,
+			   const unsigned long x,
+			   const unsigned long kmerpair){
+  const unsigned int pred = 
+    (params->kmer_freq)[(params->h_i)[x]][(params->l1)[kmerpair]] * 
+    (params->kmer_freq)[(params->h_j)[x]][(params->m1)[kmerpair]] +
+    (params->kmer_freq)[(params->h_i)[x]][(params->l2)[kmerpair]] * 
+    (params->kmer_freq)[(params->h_j)[x]][(params->m2)[kmerpair]];
+  return (pred > 0 ? 1 : 0);
+}
+
+/* bitmaps of the cached k-mer pairs of the range (once, before the
+ * iterations : the predictions do not depend on the weights) */
+void *adaboost_set_bitmap(void *args){
+  adaboost_comp_err_args *params = (adaboost_comp_err_args *)args;
+  unsigned long kmerpair, x;
+ 
+  for(kmerpair = params->begin;
+      kmerpair <= params->end && kmerpair < params->cached;
+      kmerpair++){
+    uint64_t *bitmap = params->bitmap + kmerpair * params->words;
+    if(params->marked[kmerpair] != 0){
+      continue;
+    }
+    for(x = 0; x < params->N; x++){
+      if((params->y)[x] != adaboost_pred(params, x, kmerpair)){
+	bitmap[x >> 6] |= (uint64_t)1 << (x & 63);
+      }
+    }
+  }
+  return NULL;
+}
+
+/**
+ * \sum_x p[x] over the rows set in bitmap, in row order (the same sum as
+ * the row loop of adaboost_comp_err()), skipping 64 rows at a time where
+ * no bit is set
+ */
+double adaboost_masked_sum(const uint64_t *bitmap,
+			   const double *p,
+			   const unsigned long N){
+  unsigned long w, b, len;
+  double sum = 0;
+  for(w = 0; (w << 6) < N; w++){
+    const uint64_t word = bitmap[w];
+    const double *pw = p + (w << 6);
+    if(word == 0){
+      continue;
+    }
+    len = (N - (w << 6) < 64) ? N - (w << 6) : 64;
+    for(b = 0; b < len; b++){
+      sum += ((word >> b) & 1) ? pw[b] : 0;
+    }
+  }
+  return sum;
+}
+
 void *adaboost_comp_err(void *args){
   adaboost_comp_err_args *params = (adaboost_comp_err_args *)args;
-  unsigned int kmerpair = 0, x = 0, pred;
+  unsigned int kmerpair = 0, x = 0;
+  double *err = *(params->err);
  
   for(kmerpair = params->begin; kmerpair <= params->end; kmerpair++){
-    (*(params->err))[kmerpair] = 0;
+    err[kmerpair] = 0;
   }
   for(kmerpair = params->begin; kmerpair <= params->end; kmerpair++){
     if(params->marked[kmerpair] == 0){
-      for(x = 0; x < params->N; x++){
-	pred = 
-	  (params->kmer_freq)[(params->h_i)[x]][(params->l1)[kmerpair]] * 
-	  (params->kmer_freq)[(params->h_j)[x]][(params->m1)[kmerpair]] +
-	  (params->kmer_freq)[(params->h_i)[x]][(params->l2)[kmerpair]] * 
-	  (params->kmer_freq)[(params->h_j)[x]][(params->m2)[kmerpair]];
-	if((params->y)[x] != (pred > 0 ? 1 : 0)){
-	  (*(params->err))[kmerpair] += (params->p)[x];
+      if(kmerpair < params->cached){
+	err[kmerpair] =
+	  adaboost_masked_sum(params->bitmap + kmerpair * params->words,
+			      params->p, params->N);
+      }else{
+	for(x = 0; x < params->N; x++){
+	  if((params->y)[x] != adaboost_pred(params, x, kmerpair)){
+	    err[kmerpair] += (params->p)[x];
+	  }
 	}
       }
     }
-  }  
+  }
+
+  /* min and max of the range (first k-mer pair on ties) */
+  params->found = 0;
+  for(kmerpair = params->begin; kmerpair <= params->end; kmerpair++){
+    if(params->marked[kmerpair] != 0){
+      continue;
+    }else if(params->found == 0){
+      params->found = 1;
+      params->max = params->min = err[kmerpair];
+      params->argmax = params->argmin = kmerpair;
+    }else if(err[kmerpair] < params->min){
+      params->min = err[kmerpair];
+      params->argmin = kmerpair;
+    }else if(err[kmerpair] > params->max){
+      params->max = err[kmerpair];
+      params->argmax = kmerpair;
+    }
+  }
   return NULL;
 }
 
@@ -165,7 +270,9 @@ int adaboost_learn(const command_line_arguements *cmd_args,
   const unsigned long canonical_kmer_pair_num = 
     (1 << (4 * (cmd_args->k) - 1)) + (1 << (2 * (cmd_args->k) - 1));  
   unsigned long n, lm, argmin_lm, argmax_lm;
+  unsigned long words, cached;
   unsigned int *marked, *y, pred;
+  uint64_t *bitmap;
   double *err, *w, *p, wsum, epsilon, min, max;
   char **kmer_strings;
   struct timeval t0, time;
@@ -186,40 +293,25 @@ int adaboost_learn(const command_line_arguements *cmd_args,
     }
     adaboost_set_y(hic, threshold, &y);
     set_kmer_strings(cmd_args->k, &kmer_strings);
+
+    /* prediction bitmaps, within the budget */
+    words = (hic->nrow + 63) / 64;
+    cached = ADABOOST_BITMAP_BUDGET / (words * sizeof(uint64_t));
+    if(cached > canonical_kmer_pair_num){
+      cached = canonical_kmer_pair_num;
+    }
+    bitmap = calloc_errchk(cached * words, sizeof(uint64_t), "calloc: bitmap");
   }
 
-  /* mark k-mer pairs containing forbidden k-mers */
+  /* mark k-mer pairs containing forbidden k-mers (GATC, see kmer.h) */
   {
-    unsigned int mask, m;
-    unsigned int forbidden_kmer[1] = {141}; /* GATC */
-    unsigned int forbidden_kmer_len[1] = {4};
-    unsigned int forbidden_kmer_num = 1;
+    unsigned char *forbidden =
+      kmer_motif_table(cmd_args->k, "GATC", cmd_args->prog_name);
     for(lm = 0; lm < canonical_kmer_pair_num; lm++){
-      for(m = 0; m < forbidden_kmer_num; m++){
-	if(marked[lm] != 0){
-	  break;
-	}else{
-	  mask = (1 << (2 * forbidden_kmer_len[m])) - 1;
-	  for(n = 0; 
-	      n < cmd_args->k - forbidden_kmer_len[m] + 1;
-	      n++){
-	    if(      (((kp->l1[lm]) >> (2 * n)) & mask) == forbidden_kmer[m]){
-	      marked[lm] = 1;
-	      break;
-	    }else if((((kp->m1[lm]) >> (2 * n)) & mask) == forbidden_kmer[m]){
-	      marked[lm] = 1;
-	      break;
-	    }else if((((kp->l2[lm]) >> (2 * n)) & mask) == forbidden_kmer[m]){
-	      marked[lm] = 1;
-	      break;
-	    }else if((((kp->m2[lm]) >> (2 * n)) & mask) == forbidden_kmer[m]){	
-	      marked[lm] = 1;
-	      break;
-	    }
-	  }
-	}
-      }
+      marked[lm] = (forbidden[kp->l1[lm]] | forbidden[kp->m1[lm]] |
+		    forbidden[kp->l2[lm]] | forbidden[kp->m2[lm]]);
     }
+    free(forbidden);
   }
 
   {
@@ -254,7 +346,7 @@ int adaboost_learn(const command_line_arguements *cmd_args,
 	params[i].begin = ((i == 0) ? 0 : params[i - 1].end + 1);
 	params[i].end =
 	  ((i == (cmd_args->exec_thread_num - 1)) ?
-	   canonical_kmer_pair_num :
+	   canonical_kmer_pair_num - 1 :
 	   ((canonical_kmer_pair_num / cmd_args->exec_thread_num) * (i + 1) - 1));
 	params[i].N = hic->nrow;
 	params[i].kmer_freq = kmer_freq;
@@ -268,7 +360,20 @@ int adaboost_learn(const command_line_arguements *cmd_args,
 	params[i].err = &err;
 	params[i].p = p;
 	params[i].y = y;
+	params[i].words = words;
+	params[i].cached = cached;
+	params[i].bitmap = bitmap;
       }
+
+      /* prediction bitmaps of the cached k-mer pairs */
+      for(i = 0; i < cmd_args->exec_thread_num; i++){
+	pthread_create(&threads[i], NULL, adaboost_set_bitmap, (void*)&params[i]);	
+      }      
+      for(i = 0; i < cmd_args->exec_thread_num; i++){
+	pthread_join(threads[i], NULL);
+      }
+      fprintf(stderr, "%s: info: AdaBoost: prediction bitmaps of %ld out of %ld k-mer pairs are cached\n",
+	      cmd_args->prog_name, cached, canonical_kmer_pair_num);
     }
 
     gettimeofday(&t0, NULL);
@@ -302,22 +407,28 @@ int adaboost_learn(const command_line_arguements *cmd_args,
 
 	/* find best stamp */
 	{
-	  lm = 0;
-	  /* skip arleady selected kmer pairs */
-	  while(marked[lm] != 0){
-	    lm++;
-	  }
-	  /* find max and min*/
-	  max = min = err[lm];
-	  argmax_lm = argmin_lm = lm;
-	  for(lm++; lm < canonical_kmer_pair_num; lm++){
-	    if(marked[lm] == 0){
-	      if(err[lm] < min){
-		min = err[lm];
-		argmin_lm = lm;
-	      }else if(err[lm] > max){
-		max = err[lm];
-		argmax_lm = lm;
+	  int found = 0;
+	  max = min = 0;
+	  argmax_lm = argmin_lm = 0;
+	  /* reduce max and min of the threads (already selected kmer
+	   * pairs are skipped by the threads) */
+	  for(i = 0; i < cmd_args->exec_thread_num; i++){
+	    if(params[i].found == 0){
+	      continue;
+	    }else if(found == 0){
+	      found = 1;
+	      min = params[i].min;
+	      max = params[i].max;
+	      argmin_lm = params[i].argmin;
+	      argmax_lm = params[i].argmax;
+	    }else{
+	      if(params[i].min < min){
+		min = params[i].min;
+		argmin_lm = params[i].argmin;
+	      }
+	      if(params[i].max > max){
+		max = params[i].max;
+		argmax_lm = params[i].argmax;
 	      }
 	    }
 	  }
@@ -345,15 +456,25 @@ int adaboost_learn(const command_line_arguements *cmd_args,
       /* step 3 : compute new weights */
       {
 	((*model)->beta)[t] = epsilon / (1 - epsilon);
-	for(n = 0; n < hic->nrow; n++){
-	  pred = 
-	    ((kmer_freq[hic->i[n]][kp->l1[((*model)->axis)[t]]] * 
-	      kmer_freq[hic->j[n]][kp->m1[((*model)->axis)[t]]] +
-	      kmer_freq[hic->i[n]][kp->l2[((*model)->axis)[t]]] * 
-	      kmer_freq[hic->j[n]][kp->m2[((*model)->axis)[t]]]) > 0) ? 1 : 0;
-	  if(((((*model)->sign)[t] == 0) && pred == y[n]) ||
-	     ((((*model)->sign)[t] == 1) && pred != y[n])){
-	    w[n] *= ((*model)->beta)[t];
+	if(((*model)->axis)[t] < cached){
+	  /* the bit of row n is set where pred != y[n] */
+	  const uint64_t *bits = bitmap + ((*model)->axis)[t] * words;
+	  for(n = 0; n < hic->nrow; n++){
+	    if(((bits[n >> 6] >> (n & 63)) & 1) == ((*model)->sign)[t]){
+	      w[n] *= ((*model)->beta)[t];
+	    }
+	  }
+	}else{
+	  for(n = 0; n < hic->nrow; n++){
+	    pred = 
+	      ((kmer_freq[hic->i[n]][kp->l1[((*model)->axis)[t]]] * 
+		kmer_freq[hic->j[n]][kp->m1[((*model)->axis)[t]]] +
+		kmer_freq[hic->i[n]][kp->l2[((*model)->axis)[t]]] * 
+		kmer_freq[hic->j[n]][kp->m2[((*model)->axis)[t]]]) > 0) ? 1 : 0;
+	    if(((((*model)->sign)[t] == 0) && pred == y[n]) ||
+	       ((((*model)->sign)[t] == 1) && pred != y[n])){
+	      w[n] *= ((*model)->beta)[t];
+	    }
 	  }
 	}
       }
@@ -9,6 +9,47 @@
 #include "calloc_errchk.h"
 
 typedef enum { NONE , L1 , L2 } f_norm;
+typedef enum { DOUBLE , SINGLE } precision;
+typedef enum { NUMA_OFF , NUMA_PIN , NUMA_REPLICATE , NUMA_INTERLEAVE } numa_mode;
+
+/* k-mer lengths trained with sparse features (see sparse.h) */
+#define SPARSE_K_MIN 7
+#define SPARSE_K_MAX 10
+
+/* largest number of worker processes of --procs (see l2shm.h) */
+#define L2_SHM_PROCS_MAX 64
+
+/* long options without a short form */
+enum {
+  OPT_CAND = 256,
+  OPT_CAND_REFRESH,
+  OPT_SCREEN,
+  OPT_PRECISION,
+  OPT_SHADOW,
+  OPT_NUMA,
+  OPT_TILE_ROWS,
+  OPT_TILE_COLS,
+  OPT_NO_TILE,
+  OPT_SPARSE,
+  OPT_METRICS,
+  OPT_PERF,
+  OPT_TRACE,
+  OPT_BATCH_ACC,
+  OPT_BATCH_HIC,
+  OPT_CV,
+  OPT_CV_BLOCK,
+  OPT_VAL,
+  OPT_PATIENCE,
+  OPT_TOL,
+  OPT_PROCS,
+  OPT_STREAM,
+  OPT_EXCLUDE,
+  OPT_HIC_CHR,
+  OPT_HIC_NORM,
+  OPT_HIC_OE,
+  OPT_HIC_BAND,
+  OPT_MEM_LIMIT,
+};
 	      
 typedef struct _cmd_args {
   /* parameters */
@@ -23,6 +64,18 @@ typedef struct _cmd_args {
   char *hic_file;
   char *kmer_pair;
   char *kmer;
+  /* motifs excluded from the enumerated canonical k-mer pairs, comma
+   * separated (NULL : none, see kmer_motif_table() in kmer.h) */
+  char *exclude;
+  /* Juicer .hic input (see juicer.h) : chromosome (NULL : text or binary
+   * Hi-C file), normalization, log_2 O/E and distance band d1,d2 (bp,
+   * hic_band : 0 off, -1 malformed) */
+  char *hic_chr;
+  char *hic_norm;
+  int hic_oe;
+  int hic_band;
+  unsigned long hic_dmin;
+  unsigned long hic_dmax;
   /* output */
   char *out_file;
   /* saved results */
@@ -33,6 +86,47 @@ typedef struct _cmd_args {
   int thread_num;
   char *prog_name;
   f_norm f_norm;
+  /* lazy axis search */
+  int cand_num;
+  int cand_refresh;
+  /* safe screening of axes */
+  int screen;
+  /* floating point precision of the features and residuals */
+  precision precision;
+  int shadow;
+  /* NUMA placement of the workers and of the data */
+  numa_mode numa;
+  /* cache blocking of the inner products (0 : automatic) */
+  int tile;
+  int tile_rows;
+  int tile_cols;
+  /* sparse k-mer features, pairs enumerated implicitly (large k) */
+  int sparse;
+  /* JSON lines of per-phase metrics (NULL : off, see metrics.h) */
+  char *metrics_file;
+  /* hardware counters in the metrics (see perfctr.h) */
+  int perf;
+  /* Chrome trace of the run (NULL : off, see trace.h) */
+  char *trace_file;
+  /* batched training : comma separated learning rates and Hi-C files
+   * trained together with --acc and --hic (NULL : off, see l2batch.h) */
+  char *batch_acc;
+  char *batch_hic;
+  /* K-fold cross-validation (0 : off), folds of blocks of cv_block bins
+   * (0 : of rows, see l2batch.h) */
+  int cv;
+  int cv_block;
+  /* validation rows (fraction, 0 : off) and early stopping after
+   * patience iterations without a relative improvement of tol */
+  double val_frac;
+  int patience;
+  double tol;
+  /* worker processes over shared memory (0 : threads, see l2shm.h) */
+  int procs;
+  /* out-of-core training, rows per chunk (0 : in memory, see l2stream.h) */
+  int stream;
+  /* memory budget (bytes, 0 : no plan, -1 : malformed, see memplan.h) */
+  long mem_limit;
 } cmd_args;
 
 
@@ -47,7 +141,7 @@ int show_usage(FILE *fp,
   fprintf(fp, "%s [INFO] ", prog_name);
   fprintf(fp, "usage:\n");
   fprintf(fp, 
-	  "%s -k k --res r [--margin M] --iter1 n --iter2 m --acc a --fasta f --hic H --kmer c --out o [--pri p] [--sec s] [--verbose V] --thread_num t \n",
+	  "%s -k k --res r [--margin M] --iter1 n --iter2 m --acc a --fasta f --hic H [--kmer c] [--exclude M1,M2,...] [--hic_chr c] [--hic_norm N] [--hic_oe] [--hic_band d1,d2] --out o [--pri p] [--sec s] [--verbose V] --thread_num t [--cand K] [--cand_refresh R] [--screen] [--precision single|double] [--shadow N] [--numa off|pin|replicate|interleave] [--tile_rows R] [--tile_cols C] [--no_tile] [--sparse] [--metrics FILE] [--perf] [--trace FILE] [--batch_acc a1,a2,...] [--batch_hic H1,H2,...] [--cv K] [--cv_block B] [--val f] [--patience P] [--tol t] [--procs N] [--stream C] [--mem_limit B] \n",
 	  prog_name);
   return 0;
 }
@@ -57,7 +151,7 @@ int show_usage_pred(FILE *fp,
   fprintf(fp, "%s [INFO] ", prog_name);
   fprintf(fp, "usage:\n");
   fprintf(fp, 
-	  "%s -k k --res r [--margin M] --fasta f --hic H --kmer c --out o --pri p [--verbose V] --thread_num t \n",
+	  "%s -k k --res r [--margin M] --fasta f --hic H [--kmer c] [--exclude M1,M2,...] [--hic_chr c] [--hic_norm N] [--hic_oe] [--hic_band d1,d2] --out o --pri p [--verbose V] --thread_num t [--metrics FILE] [--perf] [--trace FILE] [--mem_limit B] \n",
 	  prog_name);
   return 0;
 }
@@ -141,13 +235,64 @@ int cmd_args_chk(const cmd_args *args){
     fprintf(stderr, "%s : %s\n", "hic_file", args->hic_file);
   }
 
-  if(args->kmer_pair == NULL){
+  if(args->hic_chr != NULL){
+    if(args->sparse != 0 || args->stream > 0 || args->batch_hic != NULL){
+      fprintf(stderr, "%s [ERROR] ", args->prog_name);
+      fprintf(stderr, "%s\n", "hic_chr does not support --sparse, --stream and --batch_hic");
+      errflag++;
+    }else if(args->hic_band < 0 ||
+	     (args->hic_band > 0 && args->hic_dmin > args->hic_dmax)){
+      fprintf(stderr, "%s [ERROR] ", args->prog_name);
+      fprintf(stderr, "%s\n", "hic_band must be d1,d2 (bp) with d1 <= d2");
+      errflag++;
+    }else if(errflag == 0){
+      fprintf(stderr, "%s [INFO] ", args->prog_name);
+      fprintf(stderr, "%s : %s, %s : %s, %s : %s\n",
+	      "hic_chr", args->hic_chr, "hic_norm", args->hic_norm,
+	      "hic_oe", (args->hic_oe != 0) ? "on" : "off");
+      if(args->hic_band > 0){
+	fprintf(stderr, "%s [INFO] ", args->prog_name);
+	fprintf(stderr, "%s : %ld - %ld\n", "hic_band",
+		args->hic_dmin, args->hic_dmax);
+      }
+    }
+  }else if(args->hic_band != 0 || args->hic_oe != 0 ||
+	   strcmp(args->hic_norm, "NONE") != 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "hic_norm, hic_oe and hic_band require --hic_chr (Juicer .hic file)");
+    errflag++;
+  }
+
+  if(args->sparse != 0){
+    if(args->k > SPARSE_K_MAX){
+      fprintf(stderr, "%s [ERROR] ", args->prog_name);
+      fprintf(stderr, "sparse mode supports k <= %d\n", SPARSE_K_MAX);
+      errflag++;
+    }else if(errflag == 0){
+      fprintf(stderr, "%s [INFO] ", args->prog_name);
+      fprintf(stderr, "%s : %s\n", "sparse", "on (canonical k-mer pairs are enumerated)");
+    }
+    if(args->exclude != NULL){
+      fprintf(stderr, "%s [ERROR] ", args->prog_name);
+      fprintf(stderr, "%s\n", "exclude does not support --sparse");
+      errflag++;
+    }
+  }else if(args->kmer_pair != NULL && args->exclude != NULL){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "exclude applies to the enumerated k-mer pairs, not to --kmer");
+    errflag++;
+  }else if(args->kmer_pair == NULL && args->k > SPARSE_K_MIN){
     fprintf(stderr, "%s [ERROR] ", args->prog_name);
-    fprintf(stderr, "%s\n", "k-mer pair file is not specified");
+    fprintf(stderr, "k-mer pairs are enumerated for k <= %d (use --sparse)\n", SPARSE_K_MIN);
     errflag++;
   }else if(errflag == 0){
     fprintf(stderr, "%s [INFO] ", args->prog_name);
-    fprintf(stderr, "%s : %s\n", "kmer_pair", args->kmer_pair);
+    fprintf(stderr, "%s : %s\n", "kmer_pair",
+	    (args->kmer_pair != NULL) ? args->kmer_pair : "enumerated");
+    if(args->exclude != NULL){
+      fprintf(stderr, "%s [INFO] ", args->prog_name);
+      fprintf(stderr, "%s : %s\n", "exclude", args->exclude);
+    }
   }
 
   /* output */
@@ -189,6 +334,218 @@ int cmd_args_chk(const cmd_args *args){
     fprintf(stderr, "%s : %d\n", "f_norm", args->f_norm);
   }
 
+  /* lazy axis search */
+
+  if(args->cand_num < 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "cand must be non-negative");
+    errflag++;
+  }else if(args->cand_num > 0 && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %d\n", "cand", args->cand_num);
+  }
+
+  if(args->cand_refresh <= 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "cand_refresh must be positive");
+    errflag++;
+  }else if(args->cand_num > 0 && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %d\n", "cand_refresh", args->cand_refresh);
+  }
+
+  if(args->screen != 0 && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %s\n", "screen", "on");
+  }
+
+  /* precision */
+
+  if(errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %s\n", "precision",
+	    (args->precision == SINGLE) ? "single" : "double");
+  }
+
+  if(args->shadow < 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "shadow must be non-negative");
+    errflag++;
+  }else if(args->shadow > 0 && args->precision != SINGLE){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "shadow requires --precision single");
+    errflag++;
+  }else if(args->shadow > 0 && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %d\n", "shadow", args->shadow);
+  }
+
+  /* NUMA */
+
+  if(args->numa != NUMA_OFF && errflag == 0){
+    const char *numa_str[] = {"off", "pin", "replicate", "interleave"};
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %s\n", "numa", numa_str[args->numa]);
+  }
+
+  /* cache blocking */
+
+  if(args->tile_rows < 0 || args->tile_cols < 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "tile_rows and tile_cols must be non-negative");
+    errflag++;
+  }else if(args->tile == 0 && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %s\n", "tile", "off");
+  }
+
+
+  if(args->metrics_file != NULL && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %s\n", "metrics", args->metrics_file);
+  }
+
+  if(args->perf != 0 && args->metrics_file == NULL){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "perf requires --metrics");
+    errflag++;
+  }else if(args->perf != 0 && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %s\n", "perf", "on");
+  }
+
+  if(args->trace_file != NULL && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %s\n", "trace", args->trace_file);
+  }
+
+  /* batched training and cross-validation */
+
+  if(args->cv < 0 || args->cv == 1){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "cv must be at least 2");
+    errflag++;
+  }else if(args->cv > 0 && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %d\n", "cv", args->cv);
+  }
+
+  if(args->cv_block < 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "cv_block must be non-negative");
+    errflag++;
+  }else if(args->cv_block > 0 && args->cv == 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "cv_block requires --cv");
+    errflag++;
+  }else if(args->cv_block > 0 && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %d\n", "cv_block", args->cv_block);
+  }
+
+  /* validation and early stopping */
+
+  if(args->val_frac < 0 || args->val_frac >= 1){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "val must be in [0, 1)");
+    errflag++;
+  }else if(args->val_frac > 0 &&
+	   (args->sparse != 0 || args->batch_acc != NULL ||
+	    args->batch_hic != NULL || args->cv > 0)){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "val does not support --sparse, --batch_acc, --batch_hic and --cv");
+    errflag++;
+  }else if(args->val_frac > 0 && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %f\n", "val", args->val_frac);
+  }
+
+  if(args->patience < 0 || args->tol < 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "patience and tol must be non-negative");
+    errflag++;
+  }else if((args->patience > 0 || args->tol > 0) && args->val_frac == 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "patience and tol require --val");
+    errflag++;
+  }else if(args->val_frac > 0 && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %d, %s : %e\n",
+	    "patience", args->patience, "tol", args->tol);
+  }
+
+  /* multi-process training */
+
+  if(args->procs < 0 || args->procs > L2_SHM_PROCS_MAX){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "procs must be in [0, %d]\n", L2_SHM_PROCS_MAX);
+    errflag++;
+  }else if(args->procs > 0 &&
+	   (args->sparse != 0 || args->batch_acc != NULL ||
+	    args->batch_hic != NULL || args->cv > 0 || args->val_frac > 0 ||
+	    args->cand_num > 0 || args->screen != 0 || args->shadow > 0 ||
+	    args->numa != NUMA_OFF)){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "procs does not support --sparse, --batch_acc, --batch_hic, --cv, --val, --cand, --screen, --shadow and --numa");
+    errflag++;
+  }else if(args->procs > 0 && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %d\n", "procs", args->procs);
+  }
+
+  /* out-of-core training */
+
+  if(args->stream < 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "stream must be non-negative");
+    errflag++;
+  }else if(args->stream > 0 &&
+	   (args->sparse != 0 || args->batch_acc != NULL ||
+	    args->batch_hic != NULL || args->cv > 0 || args->val_frac > 0 ||
+	    args->procs > 0 || args->cand_num > 0 || args->screen != 0 ||
+	    args->shadow > 0 || args->numa != NUMA_OFF)){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "stream does not support --sparse, --batch_acc, --batch_hic, --cv, --val, --procs, --cand, --screen, --shadow and --numa");
+    errflag++;
+  }else if(args->stream > 0 && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %d\n", "stream", args->stream);
+  }
+
+  /* memory budget */
+
+  if(args->mem_limit < 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "mem_limit must be bytes with an optional K, M, G or T suffix");
+    errflag++;
+  }else if(args->mem_limit > 0 &&
+	   (args->sparse != 0 || args->batch_acc != NULL ||
+	    args->batch_hic != NULL || args->cv > 0 || args->procs > 0)){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "mem_limit does not support --sparse, --batch_acc, --batch_hic, --cv and --procs");
+    errflag++;
+  }else if(args->mem_limit > 0 && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %ld\n", "mem_limit", args->mem_limit);
+  }
+
+  if(args->batch_acc != NULL || args->batch_hic != NULL || args->cv > 0){
+    if(args->sparse != 0 || args->cand_num > 0 || args->screen != 0 ||
+       args->shadow > 0 || args->numa != NUMA_OFF || args->pri_file != NULL){
+      fprintf(stderr, "%s [ERROR] ", args->prog_name);
+      fprintf(stderr, "%s\n", "batch_acc, batch_hic and cv do not support --sparse, --cand, --screen, --shadow, --numa and --pri");
+      errflag++;
+    }else if(errflag == 0){
+      if(args->batch_acc != NULL){
+	fprintf(stderr, "%s [INFO] ", args->prog_name);
+	fprintf(stderr, "%s : %s\n", "batch_acc", args->batch_acc);
+      }
+      if(args->batch_hic != NULL){
+	fprintf(stderr, "%s [INFO] ", args->prog_name);
+	fprintf(stderr, "%s : %s\n", "batch_hic", args->batch_hic);
+      }
+    }
+  }
 
   if(errflag > 0){
     show_usage(stderr, args->prog_name);
@@ -252,13 +609,64 @@ int cmd_args_chk_pred(const cmd_args *args){
     fprintf(stderr, "%s : %s\n", "hic_file", args->hic_file);
   }
 
-  if(args->kmer_pair == NULL){
+  if(args->hic_chr != NULL){
+    if(args->sparse != 0){
+      fprintf(stderr, "%s [ERROR] ", args->prog_name);
+      fprintf(stderr, "%s\n", "hic_chr does not support --sparse");
+      errflag++;
+    }else if(args->hic_band < 0 ||
+	     (args->hic_band > 0 && args->hic_dmin > args->hic_dmax)){
+      fprintf(stderr, "%s [ERROR] ", args->prog_name);
+      fprintf(stderr, "%s\n", "hic_band must be d1,d2 (bp) with d1 <= d2");
+      errflag++;
+    }else if(errflag == 0){
+      fprintf(stderr, "%s [INFO] ", args->prog_name);
+      fprintf(stderr, "%s : %s, %s : %s, %s : %s\n",
+	      "hic_chr", args->hic_chr, "hic_norm", args->hic_norm,
+	      "hic_oe", (args->hic_oe != 0) ? "on" : "off");
+      if(args->hic_band > 0){
+	fprintf(stderr, "%s [INFO] ", args->prog_name);
+	fprintf(stderr, "%s : %ld - %ld\n", "hic_band",
+		args->hic_dmin, args->hic_dmax);
+      }
+    }
+  }else if(args->hic_band != 0 || args->hic_oe != 0 ||
+	   strcmp(args->hic_norm, "NONE") != 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "hic_norm, hic_oe and hic_band require --hic_chr (Juicer .hic file)");
+    errflag++;
+  }
+
+  if(args->sparse != 0){
+    if(args->k > SPARSE_K_MAX){
+      fprintf(stderr, "%s [ERROR] ", args->prog_name);
+      fprintf(stderr, "sparse mode supports k <= %d\n", SPARSE_K_MAX);
+      errflag++;
+    }else if(errflag == 0){
+      fprintf(stderr, "%s [INFO] ", args->prog_name);
+      fprintf(stderr, "%s : %s\n", "sparse", "on (canonical k-mer pairs are enumerated)");
+    }
+    if(args->exclude != NULL){
+      fprintf(stderr, "%s [ERROR] ", args->prog_name);
+      fprintf(stderr, "%s\n", "exclude does not support --sparse");
+      errflag++;
+    }
+  }else if(args->kmer_pair != NULL && args->exclude != NULL){
     fprintf(stderr, "%s [ERROR] ", args->prog_name);
-    fprintf(stderr, "%s\n", "k-mer pair file is not specified");
+    fprintf(stderr, "%s\n", "exclude applies to the enumerated k-mer pairs, not to --kmer");
+    errflag++;
+  }else if(args->kmer_pair == NULL && args->k > SPARSE_K_MIN){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "k-mer pairs are enumerated for k <= %d (use --sparse)\n", SPARSE_K_MIN);
     errflag++;
   }else if(errflag == 0){
     fprintf(stderr, "%s [INFO] ", args->prog_name);
-    fprintf(stderr, "%s : %s\n", "kmer_pair", args->kmer_pair);
+    fprintf(stderr, "%s : %s\n", "kmer_pair",
+	    (args->kmer_pair != NULL) ? args->kmer_pair : "enumerated");
+    if(args->exclude != NULL){
+      fprintf(stderr, "%s [INFO] ", args->prog_name);
+      fprintf(stderr, "%s : %s\n", "exclude", args->exclude);
+    }
   }
 
   /* output */
@@ -299,6 +707,41 @@ int cmd_args_chk_pred(const cmd_args *args){
     fprintf(stderr, "%s : %d\n", "f_norm", args->f_norm);
   }
 
+  if(args->metrics_file != NULL && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %s\n", "metrics", args->metrics_file);
+  }
+
+  if(args->perf != 0 && args->metrics_file == NULL){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "perf requires --metrics");
+    errflag++;
+  }else if(args->perf != 0 && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %s\n", "perf", "on");
+  }
+
+  if(args->trace_file != NULL && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %s\n", "trace", args->trace_file);
+  }
+
+  /* memory budget */
+
+  if(args->mem_limit < 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "mem_limit must be bytes with an optional K, M, G or T suffix");
+    errflag++;
+  }else if(args->mem_limit > 0 &&
+	   args->sparse != 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "mem_limit does not support --sparse");
+    errflag++;
+  }else if(args->mem_limit > 0 && errflag == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%s : %ld\n", "mem_limit", args->mem_limit);
+  }
+
   if(errflag > 0){
     show_usage_pred(stderr, args->prog_name);
     exit(EXIT_FAILURE);
@@ -309,6 +752,23 @@ int cmd_args_chk_pred(const cmd_args *args){
 }
 
 
+/* bytes of "B[K|M|G|T]" (binary units), -1 : malformed */
+static inline long cmd_args_bytes(const char *str){
+  char *end;
+  const double v = strtod(str, &end);
+  double unit = 1;
+  switch(*end){
+    case 'K': case 'k': unit = 1024.0; end++; break;
+    case 'M': case 'm': unit = 1048576.0; end++; break;
+    case 'G': case 'g': unit = 1073741824.0; end++; break;
+    case 'T': case 't': unit = 1099511627776.0; end++; break;
+  }
+  if(end == str || *end != '\0' || v < 0){
+    return -1;
+  }
+  return (long)(v * unit);
+}
+
 int cmd_args_parse(const int argc, char **argv,	       
 		   cmd_args **args){
   
@@ -336,12 +796,57 @@ int cmd_args_parse(const int argc, char **argv,
     {"verbose",   required_argument, NULL, 'V'},
     {"thread",    required_argument, NULL, 't'},
     {"f_norm",    required_argument, NULL, 'L'},
+    /* lazy axis search */
+    {"cand",         required_argument, NULL, OPT_CAND},
+    {"cand_refresh", required_argument, NULL, OPT_CAND_REFRESH},
+    /* safe screening of axes */
+    {"screen",       no_argument,       NULL, OPT_SCREEN},
+    /* precision */
+    {"precision",    required_argument, NULL, OPT_PRECISION},
+    {"shadow",       required_argument, NULL, OPT_SHADOW},
+    /* NUMA */
+    {"numa",         required_argument, NULL, OPT_NUMA},
+    /* cache blocking */
+    {"tile_rows",    required_argument, NULL, OPT_TILE_ROWS},
+    {"tile_cols",    required_argument, NULL, OPT_TILE_COLS},
+    {"no_tile",      no_argument,       NULL, OPT_NO_TILE},
+    /* large k */
+    {"sparse",       no_argument,       NULL, OPT_SPARSE},
+    /* metrics */
+    {"metrics",      required_argument, NULL, OPT_METRICS},
+    {"perf",         no_argument,       NULL, OPT_PERF},
+    {"trace",        required_argument, NULL, OPT_TRACE},
+    /* batched training */
+    {"batch_acc",    required_argument, NULL, OPT_BATCH_ACC},
+    {"batch_hic",    required_argument, NULL, OPT_BATCH_HIC},
+    {"cv",           required_argument, NULL, OPT_CV},
+    {"cv_block",     required_argument, NULL, OPT_CV_BLOCK},
+    /* validation and early stopping */
+    {"val",          required_argument, NULL, OPT_VAL},
+    {"patience",     required_argument, NULL, OPT_PATIENCE},
+    {"tol",          required_argument, NULL, OPT_TOL},
+    /* multi-process training */
+    {"procs",        required_argument, NULL, OPT_PROCS},
+    /* out-of-core training */
+    {"stream",       required_argument, NULL, OPT_STREAM},
+    {"exclude",      required_argument, NULL, OPT_EXCLUDE},
+    /* Juicer .hic input */
+    {"hic_chr",      required_argument, NULL, OPT_HIC_CHR},
+    {"hic_norm",     required_argument, NULL, OPT_HIC_NORM},
+    {"hic_oe",       no_argument,       NULL, OPT_HIC_OE},
+    {"hic_band",     required_argument, NULL, OPT_HIC_BAND},
+    /* memory budget */
+    {"mem_limit",    required_argument, NULL, OPT_MEM_LIMIT},
     {0, 0, 0, 0}
   };
 
   *args = calloc_errchk(1, sizeof(cmd_args), 
 			"calloc: command line args");
   (*args)->f_norm = NONE;
+  (*args)->precision = DOUBLE;
+  (*args)->cand_refresh = 10;
+  (*args)->tile = 1;
+  (*args)->hic_norm = "NONE";
 
   while((opt = getopt_long(argc, argv, "hvk:r:M:n:m:a:f:H:c:o:p:s:V:t:L:",
 			   long_opts, &opt_idx)) != -1){
@@ -413,6 +918,130 @@ int cmd_args_parse(const int argc, char **argv,
 	}
 	break;
 
+      /* lazy axis search */
+      case OPT_CAND: /* cand */
+	(*args)->cand_num = atoi(optarg);
+	break;
+      case OPT_CAND_REFRESH: /* cand_refresh */
+	(*args)->cand_refresh = atoi(optarg);
+	break;
+
+      /* safe screening of axes */
+      case OPT_SCREEN: /* screen */
+	(*args)->screen = 1;
+	break;
+
+      /* precision */
+      case OPT_PRECISION: /* precision */
+	if(strcmp(optarg, "single") == 0){
+	  (*args)->precision = SINGLE;
+	}else if(strcmp(optarg, "double") == 0){
+	  (*args)->precision = DOUBLE;
+	}
+	break;
+      case OPT_SHADOW: /* shadow */
+	(*args)->shadow = atoi(optarg);
+	break;
+
+      /* NUMA */
+      case OPT_NUMA: /* numa */
+	if(strcmp(optarg, "off") == 0){
+	  (*args)->numa = NUMA_OFF;
+	}else if(strcmp(optarg, "pin") == 0){
+	  (*args)->numa = NUMA_PIN;
+	}else if(strcmp(optarg, "replicate") == 0){
+	  (*args)->numa = NUMA_REPLICATE;
+	}else if(strcmp(optarg, "interleave") == 0){
+	  (*args)->numa = NUMA_INTERLEAVE;
+	}
+	break;
+
+      /* cache blocking */
+      case OPT_TILE_ROWS: /* tile_rows */
+	(*args)->tile_rows = atoi(optarg);
+	break;
+      case OPT_TILE_COLS: /* tile_cols */
+	(*args)->tile_cols = atoi(optarg);
+	break;
+      case OPT_NO_TILE: /* no_tile */
+	(*args)->tile = 0;
+	break;
+
+      /* large k */
+      case OPT_SPARSE: /* sparse */
+	(*args)->sparse = 1;
+	break;
+
+      /* metrics */
+      case OPT_METRICS: /* metrics */
+	(*args)->metrics_file = optarg;
+	break;
+      case OPT_PERF: /* perf */
+	(*args)->perf = 1;
+	break;
+      case OPT_TRACE: /* trace */
+	(*args)->trace_file = optarg;
+	break;
+
+      /* batched training */
+      case OPT_BATCH_ACC: /* batch_acc */
+	(*args)->batch_acc = optarg;
+	break;
+      case OPT_BATCH_HIC: /* batch_hic */
+	(*args)->batch_hic = optarg;
+	break;
+      case OPT_CV: /* cv */
+	(*args)->cv = atoi(optarg);
+	break;
+      case OPT_CV_BLOCK: /* cv_block */
+	(*args)->cv_block = atoi(optarg);
+	break;
+
+      /* validation and early stopping */
+      case OPT_VAL: /* val */
+	(*args)->val_frac = atof(optarg);
+	break;
+      case OPT_PATIENCE: /* patience */
+	(*args)->patience = atoi(optarg);
+	break;
+      case OPT_TOL: /* tol */
+	(*args)->tol = atof(optarg);
+	break;
+
+      /* multi-process training */
+      case OPT_PROCS: /* procs */
+	(*args)->procs = atoi(optarg);
+	break;
+
+      /* out-of-core training */
+      case OPT_STREAM: /* stream */
+	(*args)->stream = atoi(optarg);
+	break;
+      case OPT_EXCLUDE: /* exclude */
+	(*args)->exclude = optarg;
+	break;
+
+      /* Juicer .hic input */
+      case OPT_HIC_CHR: /* hic_chr */
+	(*args)->hic_chr = optarg;
+	break;
+      case OPT_HIC_NORM: /* hic_norm */
+	(*args)->hic_norm = optarg;
+	break;
+      case OPT_HIC_OE: /* hic_oe */
+	(*args)->hic_oe = 1;
+	break;
+      case OPT_HIC_BAND: /* hic_band */
+	(*args)->hic_band =
+	  (sscanf(optarg, "%lu,%lu", &(*args)->hic_dmin, &(*args)->hic_dmax) == 2) ?
+	  1 : -1;
+	break;
+
+      /* memory budget */
+      case OPT_MEM_LIMIT: /* mem_limit */
+	(*args)->mem_limit = cmd_args_bytes(optarg);
+	break;
+
     }
   }
 
@@ -433,6 +1062,11 @@ int cmd_args_parse(const int argc, char **argv,
     (*args)->margin = 0;
   }
 
+  /* dense feature tables (4^k per bin) are infeasible for large k */
+  if((*args)->k >= SPARSE_K_MIN){
+    (*args)->sparse = 1;
+  }
+
   return 0;
 
 }
@@ -1,10 +1,14 @@
 #ifndef __FASTA_H__
 #define __FASTA_H__
 
+#include <ctype.h>
+
 #include "constant.h"
 #include "mywc.h"
 #include "calloc_errchk.h"
 #include "cmd_args.h"
+#include "metrics.h"
+#include "qio.h"
 
 /**
  * This header file contains some functions to perform the following tasks
@@ -12,58 +16,85 @@
  * - compute k-mer frequencies for bins
  */
 
-int fasta_read(const char *, char **, char **, unsigned long *);
+int fasta_read(const char *, const int, char **, char **, unsigned long *);
 int c2i(const char);
 int set_kmer_freq_odds(const cmd_args *, double ***);
+int set_features(const cmd_args *, double ***);
+int set_features_bins(const cmd_args *, double ***, unsigned long *);
+int features_f32(const cmd_args *, double **, const unsigned long,
+		 float ***, const int);
+void *features_block(const void **, const unsigned long, const size_t);
 		  
-/* read fasta file */
+/**
+ * read the first sequence of a fasta file (plain, gzip or BGZF, see
+ * qio.h, inflated on thread_num threads)
+ *  seq_head : the name of the sequence (up to the first blank)
+ */
 int fasta_read(const char *fasta_file, 
+	       const int thread_num,
 	       char **seq_head,
 	       char **seq,
 	       unsigned long *seq_len){
+  metrics_phase ph;
+  /* a plain sequence is shorter than its file, a compressed one grows */
+  unsigned long size = mywc_b(fasta_file) + 1, i = 0;
+  qio *q = qio_open(fasta_file, thread_num);
+  char buf[QIO_BGZF_BLOCK];
+  size_t n, c;
+  /* 0 : before the header, 1 : its name, 2 : the rest of its line,
+   * 3 : the sequence */
+  int state = 0, bol = 1, head_len = 0, done = 0;
 
-  *seq_len = mywc_b(fasta_file);
+  metrics_begin(&ph);
+  *seq_head = calloc_errchk(FASTA_HEADER_LEN, sizeof(char), "seq_head");
+  *seq = calloc_errchk(size, sizeof(char), "seq");
 
-  {
-    FILE *fp;
-    char buf[BUF_SIZE];
-
-    /* file open */
-    if((fp = fopen(fasta_file, "r")) == NULL){
-      fprintf(stderr, "error: fopen %s\n%s\n",
-	      fasta_file, strerror(errno));
-      exit(EXIT_FAILURE);
-    }
-
-    /* get sequence header */
-    {
-      unsigned int i;
-      *seq_head = calloc_errchk(FASTA_HEADER_LEN, sizeof(char), "seq_head");
-      fscanf(fp, "%s", *seq_head);
-      for(i = 0; i < strlen(*seq_head) - 1; i++){
-	(*seq_head)[i] = (*seq_head)[i + 1];
+  while(done == 0 && (n = qio_read(buf, sizeof(buf), q)) > 0){
+    for(c = 0; c < n; c++){
+      const char ch = buf[c];
+      if(ch == '\n'){
+	bol = 1;
+	state = (state == 1 || state == 2) ? 3 : state;
+	continue;
       }
-      (*seq_head)[i] = '\0';
-    }
-
-    /* get sequence body */ 
-    {
-      unsigned long i = 0;
-      *seq = calloc_errchk(*seq_len, sizeof(char), "seq");
-      while(fscanf(fp, "%s", buf) != EOF && i < *seq_len){	
-	strncpy(&((*seq)[i]), buf, strlen(buf));
-	i += strlen(buf);
+      if(bol != 0 && ch == '>'){
+	if(state == 3){
+	  /* the next sequence */
+	  done = 1;
+	  break;
+	}
+	state = 1;
+	bol = 0;
+	continue;
       }
-      *seq_len = i;
-      (*seq)[i++] = '\0';
-      if((*seq = realloc(*seq, i * sizeof(char))) == NULL){
-	fprintf(stderr, "realloc: seq\n");
-	exit(EXIT_FAILURE);
+      bol = 0;
+      if(state == 1){
+	if(isspace((unsigned char)ch)){
+	  state = 2;
+	}else if(head_len < FASTA_HEADER_LEN - 1){
+	  (*seq_head)[head_len++] = ch;
+	}
+      }else if(state != 2 && !isspace((unsigned char)ch)){
+	if(i + 1 >= size){
+	  size *= 2;
+	  if((*seq = realloc(*seq, size * sizeof(char))) == NULL){
+	    fprintf(stderr, "realloc: seq\n");
+	    exit(EXIT_FAILURE);
+	  }
+	}
+	(*seq)[i++] = ch;
       }
-    }    
-    fclose(fp);
+    }
+  }
+  qio_close(q);
 
+  *seq_len = i;
+  (*seq)[i++] = '\0';
+  if((*seq = realloc(*seq, i * sizeof(char))) == NULL){
+    fprintf(stderr, "realloc: seq\n");
+    exit(EXIT_FAILURE);
   }
+  metrics_end(&ph, "fasta_read", -1, *seq_len, NULL, 0);
   return 0;
 }
 
@@ -88,14 +119,79 @@ inline int c2i(const char c){
   }
 }
 
+/**
+ * count the k-mers of seq[begin, end) (the first k - 1 letters only
+ * prime the encoder) into row[] and sum[]. Instantiated with a constant
+ * k below, so that the mask is folded by the compiler.
+ */
+static inline void fasta_count_kmers(const char *seq,
+				     const unsigned long begin,
+				     const unsigned long end,
+				     const int k,
+				     double *row,
+				     unsigned int *sum){
+  const unsigned int bit_mask = (1 << (2 * k)) - 1;
+  unsigned int kmer = 0;
+  unsigned long i;
+  /* convert first (k-1)-mer to bit-encoded sequence */
+  for(i = begin; i < begin + k - 1; i++){
+    kmer <<= 2;
+    kmer += (c2i(seq[i]) & 3);
+  }
+  /* count k-mer frequency */
+  for(; i < end; i++){
+    kmer = ((kmer << 2) + (c2i(seq[i]) & 3)) & bit_mask;
+    row[kmer] += 1.0;
+    sum[kmer] += 1;
+  }
+}
+
+#define FASTA_COUNT_KMERS_K(K)					\
+  static void fasta_count_kmers_k ## K(const char *seq,		\
+				       const unsigned long begin,	\
+				       const unsigned long end,	\
+				       double *row,			\
+				       unsigned int *sum){		\
+    fasta_count_kmers(seq, begin, end, K, row, sum);		\
+  }
+FASTA_COUNT_KMERS_K(3)
+FASTA_COUNT_KMERS_K(4)
+FASTA_COUNT_KMERS_K(5)
+FASTA_COUNT_KMERS_K(6)
+#undef FASTA_COUNT_KMERS_K
+
+/**
+ * base of the block holding the rows of a feature table: the row of
+ * bin b is block + b * row_size (bytes), rows of invalid bins are NULL
+ */
+void *features_block(const void **features,
+		     const unsigned long bin_num,
+		     const size_t row_size){
+  unsigned long bin;
+  for(bin = 0; bin < bin_num; bin++){
+    if(features[bin] != NULL){
+      return (char *)features[bin] - bin * row_size;
+    }
+  }
+  return NULL;
+}
+
 int set_features(const cmd_args *args,
 		 double ***features){
+  return set_features_bins(args, features, NULL);
+}
+
+/* set_features() that also reports the number of bins */
+int set_features_bins(const cmd_args *args,
+		      double ***features,
+		      unsigned long *bins){
   char *seq_head, *seq;
   unsigned long seq_len, bin_num;
+  metrics_phase ph;
 
   {
     /* read fasta file */
-    fasta_read(args->fasta_file, 
+    fasta_read(args->fasta_file, args->thread_num,
 	       &seq_head, &seq, &seq_len);
     
     bin_num = (seq_len / args->res);
@@ -111,6 +207,14 @@ int set_features(const cmd_args *args,
 				    "features");			      
   }
 
+  metrics_begin(&ph);
+
+  /* the rows are views into a single block of bin_num x 4^k values
+   * (see features_block()), so that the kernels can index the table
+   * with a constant row width */
+  double *block = calloc_errchk(bin_num * ((size_t)1 << (2 * args->k)),
+				sizeof(double), "calloc features block");
+
   {
     const int k = args->k;
     const int res = args->res;
@@ -136,24 +240,31 @@ int set_features(const cmd_args *args,
       if(contain_n != 0){
 	(*features)[bin] = NULL;
       }else{       
-	unsigned int kmer = 0;
-	/* For bins not containing 'N', allocate memory */
-	(*features)[bin] = calloc_errchk(bit_mask + 1,
-					       sizeof(double),
-					       "calloc (*features)[]");
-	/* convert first (k-1)-mer to bit-encoded sequence */
-	for(i = bin * res - margin;
-	    i < bin * res - margin + k - 1; i++){
-	  kmer <<= 2;
-	  kmer += (c2i(seq[i]) & 3);
-	}
+	const unsigned long begin = bin * res - margin;
+	const unsigned long end = (bin + 1) * res + k - 1 + margin;
+	/* For bins not containing 'N', use a row of the block */
+	(*features)[bin] = block + bin * (bit_mask + 1);
 	/* count k-mer frequency */
-	for(;
-	    i < (bin + 1) * res + k - 1 + margin; i++){
-	  kmer <<= 2;
-	  kmer += (c2i(seq[i]) & 3);
-	  (*features)[bin][(kmer & bit_mask)] += 1.0;
-	  kmer_freq_sum[(kmer & bit_mask)] += 1;
+	switch(k){
+	  case 3:
+	    fasta_count_kmers_k3(seq, begin, end, (*features)[bin],
+				 kmer_freq_sum);
+	    break;
+	  case 4:
+	    fasta_count_kmers_k4(seq, begin, end, (*features)[bin],
+				 kmer_freq_sum);
+	    break;
+	  case 5:
+	    fasta_count_kmers_k5(seq, begin, end, (*features)[bin],
+				 kmer_freq_sum);
+	    break;
+	  case 6:
+	    fasta_count_kmers_k6(seq, begin, end, (*features)[bin],
+				 kmer_freq_sum);
+	    break;
+	  default:
+	    fasta_count_kmers(seq, begin, end, k, (*features)[bin],
+			      kmer_freq_sum);
 	}
 	valid_bin_num++;
       }    
@@ -195,6 +306,52 @@ int set_features(const cmd_args *args,
 
   fprintf(stderr, "%s [INFO] ", args->prog_name);
   fprintf(stderr, "computation of feature vectors finished\n");
+  metrics_end(&ph, "features", -1,
+	      seq_len + bin_num * ((size_t)1 << (2 * args->k)) * sizeof(double),
+	      NULL, 0);
+
+  if(bins != NULL){
+    *bins = bin_num;
+  }
+
+  return 0;
+}
+
+/**
+ * single precision copy of the feature table
+ *  the double precision rows are released unless keep != 0
+ */
+int features_f32(const cmd_args *args,
+		 double **features,
+		 const unsigned long bin_num,
+		 float ***features_f,
+		 const int keep){
+  const unsigned int bit_mask = (1 << (2 * args->k)) - 1;
+  double *block = features_block((const void **)features, bin_num,
+				 (bit_mask + 1) * sizeof(double));
+  float *block_f = calloc_errchk(bin_num * (bit_mask + 1), sizeof(float),
+				 "calloc features_f block");
+  unsigned long bin;
+  unsigned int kmer;
+
+  *features_f = calloc_errchk(bin_num, sizeof(float *), "features_f");
+  for(bin = 0; bin < bin_num; bin++){
+    if(features[bin] != NULL){
+      (*features_f)[bin] = block_f + bin * (bit_mask + 1);
+      for(kmer = 0; kmer < bit_mask + 1; kmer++){
+	(*features_f)[bin][kmer] = (float)features[bin][kmer];
+      }
+      if(keep == 0){
+	features[bin] = NULL;
+      }
+    }
+  }
+  if(keep == 0){
+    free(block);
+  }
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "feature vectors converted to single precision\n");
 
   return 0;
 }
@@ -3,12 +3,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 
 #include "constant.h"
 #include "cmd_args.h"
+#include "metrics.h"
 #include "mywc.h"
 #include "calloc_errchk.h"
+#include "qio.h"
 
 /* Hi-C data */
 typedef struct _hic {
@@ -18,7 +21,143 @@ typedef struct _hic {
   double *mij;
 } hic;
 
+/* number of bins referenced by the rows of data (the last one + 1) */
+static inline unsigned long hic_bin_num(const hic *data){
+  unsigned long bin_num = 0, i;
+  for(i = 0; i < data->nrow; i++){
+    if(data->j[i] + 1 > bin_num){
+      bin_num = data->j[i] + 1;
+    }
+    if(data->i[i] + 1 > bin_num){
+      bin_num = data->i[i] + 1;
+    }
+  }
+  return bin_num;
+}
+
+/**
+ * binary Hi-C file (written by qloop prep --binary) : a header, then
+ * nrow records of the positions i, j (bp) and of mij, in the byte order
+ * of the host. Text files hold the rows "i\tj\tmij" (bp). Both can be
+ * gzip or BGZF compressed (see qio.h).
+ */
+#define HIC_BIN_MAGIC "QLHICB1"
+
+typedef struct _hic_bin_header {
+  char magic[8];
+  uint64_t nrow;
+} hic_bin_header;
+
+typedef struct _hic_bin_row {
+  uint32_t i;
+  uint32_t j;
+  double mij;
+} hic_bin_row;
+
+/* open Hi-C file of either format */
+typedef struct _hic_file {
+  qio *q;
+  int binary;
+  unsigned long nrow;
+  unsigned long row;
+} hic_file;
+
+int hic_open(const cmd_args *, hic_file *);
+int hic_next(const cmd_args *, hic_file *,
+	     unsigned int *, unsigned int *, double *);
+long hic_close(hic_file *);
 int hic_read(const cmd_args *, hic **);
+int hic_split(const cmd_args *, const hic *, hic **, hic **);
+int hic_keep_bins(const cmd_args *, hic *, const unsigned char *,
+		  const unsigned long);
+int hic_free(hic *);
+
+/* Juicer .hic files (--hic_chr) */
+#include "juicer.h"
+
+/* fixed pseudo-random 32 bit hash of row i (row splits of --val, --cv) */
+static inline unsigned long hic_row_hash(const unsigned long i){
+  return ((i + 1) * 0x9E3779B97F4A7C15UL) >> 32;
+}
+
+/**
+ * open args->hic_file, binary when it starts with HIC_BIN_MAGIC
+ *  hf->nrow : number of rows (of the header, or lines of a text file)
+ */
+int hic_open(const cmd_args *args,
+	     hic_file *hf){
+  hic_bin_header header;
+
+  hf->q = qio_open(args->hic_file, args->thread_num);
+  hf->row = 0;
+  if(qio_read(&header, sizeof(hic_bin_header), hf->q) ==
+     sizeof(hic_bin_header) &&
+     memcmp(header.magic, HIC_BIN_MAGIC, sizeof(header.magic)) == 0){
+    hf->binary = 1;
+    hf->nrow = header.nrow;
+    if(hf->q->format == QIO_PLAIN &&
+       mywc_b(args->hic_file) != sizeof(hic_bin_header) +
+       hf->nrow * sizeof(hic_bin_row)){
+      fprintf(stderr, "%s [ERROR] ", args->prog_name);
+      fprintf(stderr, "%s : %ld bytes, the header announces %ld rows\n",
+	      args->hic_file, mywc_b(args->hic_file), hf->nrow);
+      exit(EXIT_FAILURE);
+    }
+  }else{
+    /* count the lines, then read them from the start */
+    hf->binary = 0;
+    qio_close(hf->q);
+    hf->nrow = qio_wc(args->hic_file, args->thread_num);
+    hf->q = qio_open(args->hic_file, args->thread_num);
+  }
+  return 0;
+}
+
+/**
+ * next row of hf, as bins i <= j
+ *  returns 0 at the end of the file (or of the data of a truncated one)
+ */
+int hic_next(const cmd_args *args,
+	     hic_file *hf,
+	     unsigned int *i,
+	     unsigned int *j,
+	     double *mij){
+  unsigned int tmp_i = 0, tmp_j = 0;
+
+  if(hf->row >= hf->nrow){
+    return 0;
+  }
+  if(hf->binary != 0){
+    hic_bin_row r;
+    if(qio_read(&r, sizeof(hic_bin_row), hf->q) != sizeof(hic_bin_row)){
+      return 0;
+    }
+    tmp_i = r.i;
+    tmp_j = r.j;
+    *mij = r.mij;
+  }else{
+    char buf[BUF_SIZE], tmp_mij_str[BUF_SIZE];
+    if(qio_gets(buf, BUF_SIZE, hf->q) == NULL){
+      return 0;
+    }
+    sscanf(buf, "%d\t%d\t%s", &tmp_i, &tmp_j, (char *)(&tmp_mij_str));
+    *mij = strtod(tmp_mij_str, NULL);
+  }
+  if(tmp_i <= tmp_j){
+    *i = tmp_i / args->res;
+    *j = tmp_j / args->res;
+  }else{
+    *i = tmp_j / args->res;
+    *j = tmp_i / args->res;
+  }
+  hf->row++;
+  return 1;
+}
+
+/* close hf, returns the (compressed) bytes read */
+long hic_close(hic_file *hf){
+  return qio_close(hf->q);
+}
 	     
 /**
  * read Hi-C data from a file 
@@ -26,11 +165,21 @@ int hic_read(const cmd_args *, hic **);
 
 int hic_read(const cmd_args *args,
 	     hic **data){
+  metrics_phase ph;
+  long bytes = 0;
+  hic_file hf;
 
+  if(args->hic_chr != NULL){
+    return juicer_read(args, data);
+  }
+
+  metrics_begin(&ph);
+
+  hic_open(args, &hf);
   {
     /* allocate memory */
     *data         = calloc_errchk(1, sizeof(hic), "calloc hic");   
-    (*data)->nrow = mywc(args->hic_file);  
+    (*data)->nrow = hf.nrow;
     (*data)->i    = calloc_errchk((*data)->nrow, sizeof(unsigned int),
 				  "calloc hic (*data)->i");
     (*data)->j    = calloc_errchk((*data)->nrow, sizeof(unsigned int),
@@ -41,35 +190,25 @@ int hic_read(const cmd_args *args,
 
   /* read from a file */
   {
-    FILE *fp;
-    char buf[BUF_SIZE], tmp_mij_str[BUF_SIZE];
-    unsigned int tmp_i = 0, tmp_j = 0;
     unsigned long row = 0;
 
     fprintf(stderr, "%s [INFO] ", args->prog_name);
-    fprintf(stderr, "start reading Hi-C file from %s\n",
-	    args->hic_file);
+    fprintf(stderr, "start reading %sHi-C file from %s\n",
+	    (hf.binary != 0) ? "binary " : "", args->hic_file);
 
-    if((fp = fopen(args->hic_file, "r")) == NULL){
-      fprintf(stderr, "error: fopen %s\n%s\n",
-	      args->hic_file, strerror(errno));
-      exit(EXIT_FAILURE);
-    }
-    
-    while(fgets(buf, BUF_SIZE, fp) && row < (*data)->nrow){
-      sscanf(buf, "%d\t%d\t%s", &tmp_i, &tmp_j, (char *)(&tmp_mij_str));	 
-      ((*data)->mij)[row] = strtod(tmp_mij_str, NULL);	  
-      if(tmp_i <= tmp_j){
-	((*data)->i)[row] = tmp_i / args->res;
-	((*data)->j)[row] = tmp_j / args->res;
-      }else{
-	((*data)->i)[row] = tmp_j / args->res;
-	((*data)->j)[row] = tmp_i / args->res;
-      }
+    while(row < (*data)->nrow &&
+	  hic_next(args, &hf, &((*data)->i)[row], &((*data)->j)[row],
+		   &((*data)->mij)[row]) != 0){
       row++;
     }
+    if(row < (*data)->nrow){
+      fprintf(stderr, "%s [ERROR] ", args->prog_name);
+      fprintf(stderr, "%s is truncated : %ld of %ld rows read\n",
+	      args->hic_file, row, (*data)->nrow);
+      exit(EXIT_FAILURE);
+    }
   
-    fclose(fp);
+    bytes = hic_close(&hf);
 
     fprintf(stderr, "%s [INFO] ", args->prog_name);
     fprintf(stderr, "# of Hi-C data points = %ld\n",
@@ -77,6 +216,89 @@ int hic_read(const cmd_args *args,
 
   }
 
+  metrics_end(&ph, "hic_read", -1, bytes, NULL, 0);
+  return 0;
+}
+
+/**
+ * split the rows into training and validation rows (--val : fraction of
+ * the rows, drawn with hic_row_hash())
+ */
+int hic_split(const cmd_args *args,
+	      const hic *data,
+	      hic **train,
+	      hic **val){
+  const double cut = args->val_frac * 4294967296.0;
+  unsigned long i, num = 0;
+  for(i = 0; i < data->nrow; i++){
+    num += (hic_row_hash(i) < cut);
+  }
+  if(num == 0 || num == data->nrow){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "val leaves %ld of %ld rows for validation\n",
+	    num, data->nrow);
+    exit(EXIT_FAILURE);
+  }
+
+  *train = calloc_errchk(1, sizeof(hic), "calloc hic");
+  *val   = calloc_errchk(1, sizeof(hic), "calloc hic");
+  (*train)->i   = calloc_errchk(data->nrow - num, sizeof(unsigned int),
+				"calloc hic (*train)->i");
+  (*train)->j   = calloc_errchk(data->nrow - num, sizeof(unsigned int),
+				"calloc hic (*train)->j");
+  (*train)->mij = calloc_errchk(data->nrow - num, sizeof(double),
+				"calloc hic (*train)->mij");
+  (*val)->i     = calloc_errchk(num, sizeof(unsigned int),
+				"calloc hic (*val)->i");
+  (*val)->j     = calloc_errchk(num, sizeof(unsigned int),
+				"calloc hic (*val)->j");
+  (*val)->mij   = calloc_errchk(num, sizeof(double),
+				"calloc hic (*val)->mij");
+  for(i = 0; i < data->nrow; i++){
+    hic *h = (hic_row_hash(i) < cut) ? *val : *train;
+    h->i[h->nrow]   = data->i[i];
+    h->j[h->nrow]   = data->j[i];
+    h->mij[h->nrow] = data->mij[i];
+    h->nrow++;
+  }
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "# of Hi-C data points = %ld (training), %ld (validation)\n",
+	  (*train)->nrow, (*val)->nrow);
+  return 0;
+}
+
+/**
+ * drop the rows of the bins i with keep[i] == 0 (or i >= bin_num) : the
+ * bins with N of the rows of a Juicer .hic file
+ */
+int hic_keep_bins(const cmd_args *args,
+		  hic *data,
+		  const unsigned char *keep,
+		  const unsigned long bin_num){
+  unsigned long r, m = 0;
+  for(r = 0; r < data->nrow; r++){
+    if(data->i[r] >= bin_num || data->j[r] >= bin_num ||
+       keep[data->i[r]] == 0 || keep[data->j[r]] == 0){
+      continue;
+    }
+    data->i[m]   = data->i[r];
+    data->j[m]   = data->j[r];
+    data->mij[m] = data->mij[r];
+    m++;
+  }
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "# of Hi-C data points = %ld (%ld with N dropped)\n",
+	  m, data->nrow - m);
+  data->nrow = m;
+  return 0;
+}
+
+int hic_free(hic *data){
+  free(data->i);
+  free(data->j);
+  free(data->mij);
+  free(data);
   return 0;
 }
 
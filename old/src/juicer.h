@@ -0,0 +1,767 @@
+#ifndef __JUICER_H__
+#define __JUICER_H__
+
+/**
+ * Juicer .hic contact files (versions 6 to 9), read straight into the
+ * hic struct of hic.h (which includes this file) : the matrix of one
+ * chromosome (--hic_chr) at the resolution --res (bp), as the rows
+ *  - mij = count / (norm[i] norm[j]) with the normalization vector
+ *    --hic_norm of the file (NONE : the raw counts)
+ *  - mij = log_2(count / (norm[i] norm[j] exp[|j - i|])) with --hic_oe,
+ *    exp : the expected counts of the normalization in the file, as
+ *    qloop prep -n -e -l on the dumped .RAWobserved
+ *  - rows with a non-finite mij are dropped
+ * Only the blocks of the matrix that overlap the distance band
+ * --hic_band d1,d2 (bp) are read and inflated, and only their rows with
+ * d1 <= |j - i| res <= d2 are kept. The rows of bins with N are dropped
+ * by qloop_load(), once the features are known.
+ * The fields of the file are little-endian, as the host.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <math.h>
+#include <zlib.h>
+
+#include "constant.h"
+#include "cmd_args.h"
+#include "metrics.h"
+#include "calloc_errchk.h"
+
+#define JUICER_MAGIC "HIC"
+#define JUICER_VERSION_MIN 6
+#define JUICER_VERSION_MAX 9
+
+/* open .hic file */
+typedef struct _juicer {
+  FILE *fp;
+  const char *file_name;
+  int version;
+  long master;
+  /* index of the normalization vectors (version 9, 0 : after the
+   * expected counts) */
+  long norm_index;
+  /* index and length of the chromosome args->hic_chr */
+  int chr;
+  long chr_len;
+  unsigned long bytes;
+} juicer;
+
+/* blocks of the matrix at one resolution */
+typedef struct _juicer_zoom {
+  int bin_size;
+  int block_bin_count;
+  int block_column_count;
+  int block_num;
+  /* occupied cells of the matrix (0 : not recorded) */
+  unsigned long cells;
+  int *number;
+  long *pos;
+  int *size;
+} juicer_zoom;
+
+/* cursor over an inflated block */
+typedef struct _juicer_mem {
+  const char *file_name;
+  const unsigned char *p;
+  const unsigned char *end;
+} juicer_mem;
+
+int juicer_is_hic(const char *);
+int juicer_open(const cmd_args *, juicer *);
+int juicer_footer(const cmd_args *, juicer *, long *, long *,
+		  double **, unsigned long *);
+double *juicer_norm(const cmd_args *, juicer *, const long, unsigned long *);
+int juicer_zoom_read(const cmd_args *, juicer *, const long, juicer_zoom *);
+int juicer_block_band(const cmd_args *, const juicer *, const juicer_zoom *,
+		      const int);
+unsigned char *juicer_block_inflate(juicer *, const long, const int, size_t *);
+unsigned long juicer_cells(const cmd_args *);
+int juicer_read(const cmd_args *, hic **);
+
+static inline void juicer_get(juicer *jf,
+			      void *p,
+			      const size_t n){
+  if(fread(p, 1, n, jf->fp) != n){
+    fprintf(stderr, "error: fread %s\n%s\n", jf->file_name,
+	    "truncated Juicer .hic file");
+    exit(EXIT_FAILURE);
+  }
+  jf->bytes += n;
+}
+
+static inline int32_t juicer_i32(juicer *jf){
+  int32_t v;
+  juicer_get(jf, &v, sizeof(int32_t));
+  return v;
+}
+
+static inline int64_t juicer_i64(juicer *jf){
+  int64_t v;
+  juicer_get(jf, &v, sizeof(int64_t));
+  return v;
+}
+
+static inline float juicer_f32(juicer *jf){
+  float v;
+  juicer_get(jf, &v, sizeof(float));
+  return v;
+}
+
+static inline double juicer_f64(juicer *jf){
+  double v;
+  juicer_get(jf, &v, sizeof(double));
+  return v;
+}
+
+/* NUL terminated string, truncated to size - 1 bytes */
+static inline void juicer_str(juicer *jf,
+			      char *buf,
+			      const size_t size){
+  size_t n = 0;
+  int c;
+  while((c = fgetc(jf->fp)) != EOF && c != '\0'){
+    if(n + 1 < size){
+      buf[n++] = c;
+    }
+    jf->bytes++;
+  }
+  if(c == EOF){
+    fprintf(stderr, "error: fread %s\n%s\n", jf->file_name,
+	    "truncated Juicer .hic file");
+    exit(EXIT_FAILURE);
+  }
+  jf->bytes++;
+  buf[n] = '\0';
+}
+
+static inline void juicer_seek(juicer *jf,
+			       const long off,
+			       const int whence){
+  if(fseeko(jf->fp, off, whence) != 0){
+    fprintf(stderr, "error: fseek %s\n%s\n", jf->file_name, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
+
+static inline const unsigned char *juicer_mem_get(juicer_mem *m,
+						  const size_t n){
+  const unsigned char *p = m->p;
+  if((size_t)(m->end - m->p) < n){
+    fprintf(stderr, "error: inflate %s\n%s\n", m->file_name,
+	    "corrupted block of Juicer .hic file");
+    exit(EXIT_FAILURE);
+  }
+  m->p += n;
+  return p;
+}
+
+static inline int juicer_mem_u8(juicer_mem *m){
+  return *juicer_mem_get(m, 1);
+}
+
+static inline int juicer_mem_i16(juicer_mem *m){
+  int16_t v;
+  memcpy(&v, juicer_mem_get(m, sizeof(int16_t)), sizeof(int16_t));
+  return v;
+}
+
+static inline int juicer_mem_i32(juicer_mem *m){
+  int32_t v;
+  memcpy(&v, juicer_mem_get(m, sizeof(int32_t)), sizeof(int32_t));
+  return v;
+}
+
+static inline float juicer_mem_f32(juicer_mem *m){
+  float v;
+  memcpy(&v, juicer_mem_get(m, sizeof(float)), sizeof(float));
+  return v;
+}
+
+/* chromosome names, with or without the prefix "chr" */
+static inline int juicer_chr_eq(const char *a,
+				const char *b){
+  if(strncasecmp(a, "chr", 3) == 0){
+    a += 3;
+  }
+  if(strncasecmp(b, "chr", 3) == 0){
+    b += 3;
+  }
+  return strcasecmp(a, b) == 0;
+}
+
+/* 1 if file starts with the magic of a Juicer .hic file */
+int juicer_is_hic(const char *file){
+  char magic[4];
+  FILE *fp;
+  int ret = 0;
+  if((fp = fopen(file, "rb")) != NULL){
+    ret = (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+	   memcmp(magic, JUICER_MAGIC, sizeof(magic)) == 0);
+    fclose(fp);
+  }
+  return ret;
+}
+
+/**
+ * open args->hic_file, read the header and find args->hic_chr (an exact
+ * match of the name first)
+ */
+int juicer_open(const cmd_args *args,
+		juicer *jf){
+  char magic[4], buf[BUF_SIZE];
+  long loose_len = 0;
+  int i, n, loose = -1;
+
+  memset(jf, 0, sizeof(juicer));
+  jf->file_name = args->hic_file;
+  jf->chr = -1;
+  if((jf->fp = fopen(args->hic_file, "rb")) == NULL){
+    fprintf(stderr, "error: fopen %s\n%s\n", args->hic_file, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  juicer_get(jf, magic, sizeof(magic));
+  jf->version = juicer_i32(jf);
+  if(memcmp(magic, JUICER_MAGIC, sizeof(magic)) != 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s is not a Juicer .hic file (--hic_chr)\n",
+	    args->hic_file);
+    exit(EXIT_FAILURE);
+  }
+  if(jf->version < JUICER_VERSION_MIN || jf->version > JUICER_VERSION_MAX){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s : Juicer .hic version %d is not supported (%d to %d)\n",
+	    args->hic_file, jf->version, JUICER_VERSION_MIN, JUICER_VERSION_MAX);
+    exit(EXIT_FAILURE);
+  }
+  jf->master = juicer_i64(jf);
+  juicer_str(jf, buf, BUF_SIZE); /* genome */
+  if(jf->version > 8){
+    jf->norm_index = juicer_i64(jf);
+    juicer_i64(jf);
+  }
+
+  /* attributes */
+  n = juicer_i32(jf);
+  for(i = 0; i < n; i++){
+    juicer_str(jf, buf, BUF_SIZE);
+    juicer_str(jf, buf, BUF_SIZE);
+  }
+
+  /* chromosomes */
+  n = juicer_i32(jf);
+  for(i = 0; i < n; i++){
+    long len;
+    juicer_str(jf, buf, BUF_SIZE);
+    len = (jf->version > 8) ? juicer_i64(jf) : juicer_i32(jf);
+    if(jf->chr < 0 && strcmp(buf, args->hic_chr) == 0){
+      jf->chr = i;
+      jf->chr_len = len;
+    }else if(loose < 0 && juicer_chr_eq(buf, args->hic_chr)){
+      loose = i;
+      loose_len = len;
+    }
+  }
+  if(jf->chr < 0){
+    jf->chr = loose;
+    jf->chr_len = loose_len;
+  }
+  if(jf->chr < 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "chromosome %s is not in %s\n",
+	    args->hic_chr, args->hic_file);
+    exit(EXIT_FAILURE);
+  }
+  return 0;
+}
+
+/**
+ * footer of jf
+ *  matrix : position of the matrix of the chromosome
+ *  norm : position of the normalization vector (-1 : none)
+ *  expected : expected counts of --hic_norm at --res, scaled for the
+ *             chromosome (--hic_oe, else NULL)
+ */
+int juicer_footer(const cmd_args *args,
+		  juicer *jf,
+		  long *matrix,
+		  long *norm,
+		  double **expected,
+		  unsigned long *expected_num){
+  const int v9 = (jf->version > 8);
+  char key[BUF_SIZE], type[BUF_SIZE], unit[BUF_SIZE];
+  int i, n, sec;
+
+  *matrix = -1;
+  *norm = -1;
+  *expected = NULL;
+  *expected_num = 0;
+
+  juicer_seek(jf, jf->master, SEEK_SET);
+  if(v9){
+    juicer_i64(jf);
+  }else{
+    juicer_i32(jf);
+  }
+
+  /* master index : "chr1_chr2" -> matrix */
+  {
+    char name[BUF_SIZE];
+    snprintf(name, BUF_SIZE, "%d_%d", jf->chr, jf->chr);
+    n = juicer_i32(jf);
+    for(i = 0; i < n; i++){
+      long pos;
+      juicer_str(jf, key, BUF_SIZE);
+      pos = juicer_i64(jf);
+      juicer_i32(jf);
+      if(strcmp(key, name) == 0){
+	*matrix = pos;
+      }
+    }
+  }
+  if(args->hic_oe == 0 && strcmp(args->hic_norm, "NONE") == 0){
+    return 0;
+  }
+
+  /* expected counts, of the raw counts (sec 0), of the normalized ones */
+  for(sec = 0; sec < 2; sec++){
+    if(sec == 1 && v9 && jf->norm_index > 0){
+      juicer_seek(jf, jf->norm_index, SEEK_SET);
+    }
+    n = juicer_i32(jf);
+    for(i = 0; i < n; i++){
+      long num, k;
+      int bin_size, f, nf, hit;
+      double factor = 1.0;
+
+      if(sec == 0){
+	strcpy(type, "NONE");
+      }else{
+	juicer_str(jf, type, BUF_SIZE);
+      }
+      juicer_str(jf, unit, BUF_SIZE);
+      bin_size = juicer_i32(jf);
+      num = v9 ? juicer_i64(jf) : juicer_i32(jf);
+      hit = (args->hic_oe != 0 && *expected == NULL &&
+	     strcmp(type, args->hic_norm) == 0 && strcmp(unit, "BP") == 0 &&
+	     bin_size == args->res);
+      if(hit){
+	*expected = calloc_errchk(num, sizeof(double), "calloc juicer expected");
+	*expected_num = num;
+	for(k = 0; k < num; k++){
+	  (*expected)[k] = v9 ? juicer_f32(jf) : juicer_f64(jf);
+	}
+      }else{
+	juicer_seek(jf, num * (v9 ? sizeof(float) : sizeof(double)), SEEK_CUR);
+      }
+      nf = juicer_i32(jf);
+      for(f = 0; f < nf; f++){
+	const int c = juicer_i32(jf);
+	const double x = v9 ? juicer_f32(jf) : juicer_f64(jf);
+	if(c == jf->chr){
+	  factor = x;
+	}
+      }
+      if(hit){
+	for(k = 0; k < num; k++){
+	  (*expected)[k] /= factor;
+	}
+      }
+    }
+  }
+
+  /* index of the normalization vectors */
+  n = juicer_i32(jf);
+  for(i = 0; i < n; i++){
+    int c, bin_size;
+    long pos;
+    juicer_str(jf, type, BUF_SIZE);
+    c = juicer_i32(jf);
+    juicer_str(jf, unit, BUF_SIZE);
+    bin_size = juicer_i32(jf);
+    pos = juicer_i64(jf);
+    if(v9){
+      juicer_i64(jf);
+    }else{
+      juicer_i32(jf);
+    }
+    if(*norm < 0 && strcmp(type, args->hic_norm) == 0 && c == jf->chr &&
+       strcmp(unit, "BP") == 0 && bin_size == args->res){
+      *norm = pos;
+    }
+  }
+  return 0;
+}
+
+/* normalization vector at pos */
+double *juicer_norm(const cmd_args *args,
+		    juicer *jf,
+		    const long pos,
+		    unsigned long *num){
+  const int v9 = (jf->version > 8);
+  double *norm;
+  unsigned long k;
+
+  juicer_seek(jf, pos, SEEK_SET);
+  *num = v9 ? juicer_i64(jf) : juicer_i32(jf);
+  norm = calloc_errchk(*num, sizeof(double), "calloc juicer norm");
+  for(k = 0; k < *num; k++){
+    norm[k] = v9 ? juicer_f32(jf) : juicer_f64(jf);
+  }
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "normalization %s : %ld bins\n", args->hic_norm, *num);
+  return norm;
+}
+
+/* block index of the matrix at pos, at the resolution --res (bp) */
+int juicer_zoom_read(const cmd_args *args,
+		     juicer *jf,
+		     const long pos,
+		     juicer_zoom *zoom){
+  char unit[BUF_SIZE];
+  int r, n;
+
+  memset(zoom, 0, sizeof(juicer_zoom));
+  juicer_seek(jf, pos, SEEK_SET);
+  juicer_i32(jf);
+  juicer_i32(jf);
+  n = juicer_i32(jf);
+  for(r = 0; r < n; r++){
+    int b, bin_size, block_bin_count, block_column_count, block_num;
+    float cells;
+    juicer_str(jf, unit, BUF_SIZE);
+    juicer_i32(jf); /* zoom index */
+    juicer_f32(jf); /* sum of the counts */
+    cells = juicer_f32(jf);
+    juicer_f32(jf); /* sd, 95% */
+    juicer_f32(jf);
+    bin_size = juicer_i32(jf);
+    block_bin_count = juicer_i32(jf);
+    block_column_count = juicer_i32(jf);
+    block_num = juicer_i32(jf);
+    if(strcmp(unit, "BP") != 0 || bin_size != args->res){
+      juicer_seek(jf, (long)block_num * 16, SEEK_CUR);
+      continue;
+    }
+    zoom->bin_size = bin_size;
+    zoom->block_bin_count = block_bin_count;
+    zoom->block_column_count = block_column_count;
+    zoom->block_num = block_num;
+    zoom->cells = (cells > 0) ? (unsigned long)cells : 0;
+    zoom->number = calloc_errchk(block_num, sizeof(int), "calloc juicer blocks");
+    zoom->pos = calloc_errchk(block_num, sizeof(long), "calloc juicer blocks");
+    zoom->size = calloc_errchk(block_num, sizeof(int), "calloc juicer blocks");
+    for(b = 0; b < block_num; b++){
+      zoom->number[b] = juicer_i32(jf);
+      zoom->pos[b] = juicer_i64(jf);
+      zoom->size[b] = juicer_i32(jf);
+    }
+    return 0;
+  }
+  fprintf(stderr, "%s [ERROR] ", args->prog_name);
+  fprintf(stderr, "resolution %d bp is not in %s\n", args->res, args->hic_file);
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * 1 if block b of zoom may hold rows of the band --hic_band
+ *  version < 9 : block (row, col) of the grid, bins x of the column and
+ *                y of the row
+ *  version 9   : block (depth, pos) along the diagonal, with depth
+ *                floor(log_2(1 + |x - y| / sqrt(2) / block_bin_count))
+ */
+int juicer_block_band(const cmd_args *args,
+		      const juicer *jf,
+		      const juicer_zoom *zoom,
+		      const int b){
+  const double w = zoom->block_bin_count;
+  double dlo, dhi;
+
+  if(args->hic_band == 0){
+    return 1;
+  }
+  if(jf->version > 8){
+    const int depth = zoom->number[b] / zoom->block_column_count;
+    if(depth >= 62){
+      return 1;
+    }
+    /* distances in bins, one bin of slack for the rounding */
+    dlo = (ldexp(1.0, depth) - 1) * M_SQRT2 * w - 1;
+    dhi = (ldexp(1.0, depth + 1) - 1) * M_SQRT2 * w + 1;
+  }else{
+    const double row = zoom->number[b] / zoom->block_column_count;
+    const double col = zoom->number[b] % zoom->block_column_count;
+    /* y - x in [row w - (col + 1) w + 1, (row + 1) w - 1 - col w] */
+    const double lo = (row - col - 1) * w + 1, hi = (row - col + 1) * w - 1;
+    dhi = (fabs(lo) > fabs(hi)) ? fabs(lo) : fabs(hi);
+    dlo = (lo <= 0 && hi >= 0) ? 0 : ((fabs(lo) < fabs(hi)) ? fabs(lo) : fabs(hi));
+  }
+  return (dhi * args->res >= args->hic_dmin &&
+	  dlo * args->res <= args->hic_dmax);
+}
+
+/* read and inflate the block at pos (size bytes), len : inflated bytes */
+unsigned char *juicer_block_inflate(juicer *jf,
+				    const long pos,
+				    const int size,
+				    size_t *len){
+  unsigned char *in, *out;
+  size_t out_size = 4 * (size_t)size + 1024;
+  z_stream zs;
+  int ret;
+
+  in = calloc_errchk(size, sizeof(unsigned char), "calloc juicer block");
+  juicer_seek(jf, pos, SEEK_SET);
+  juicer_get(jf, in, size);
+
+  out = calloc_errchk(out_size, sizeof(unsigned char), "calloc juicer block");
+  memset(&zs, 0, sizeof(z_stream));
+  if(inflateInit(&zs) != Z_OK){
+    fprintf(stderr, "error: inflateInit %s\n", jf->file_name);
+    exit(EXIT_FAILURE);
+  }
+  zs.next_in = in;
+  zs.avail_in = size;
+  zs.next_out = out;
+  zs.avail_out = out_size;
+  while((ret = inflate(&zs, Z_NO_FLUSH)) == Z_OK || ret == Z_BUF_ERROR){
+    if(zs.avail_out > 0){
+      /* Z_BUF_ERROR with room left : the input is truncated */
+      break;
+    }
+    if((out = realloc(out, 2 * out_size)) == NULL){
+      fprintf(stderr, "realloc: juicer block\n");
+      exit(EXIT_FAILURE);
+    }
+    zs.next_out = out + out_size;
+    zs.avail_out = out_size;
+    out_size *= 2;
+  }
+  if(ret != Z_STREAM_END){
+    fprintf(stderr, "error: inflate %s\n%s\n", jf->file_name,
+	    "corrupted block of Juicer .hic file");
+    exit(EXIT_FAILURE);
+  }
+  *len = zs.total_out;
+  inflateEnd(&zs);
+  free(in);
+  return out;
+}
+
+/* append row (x, y, count) to data if it is in the band and finite */
+static inline void juicer_row(const cmd_args *args,
+			      hic *data,
+			      unsigned long *size,
+			      const double *norm,
+			      const unsigned long norm_num,
+			      const double *expected,
+			      const unsigned long expected_num,
+			      const long x,
+			      const long y,
+			      const double count){
+  const unsigned long i = (x < y) ? x : y, j = (x < y) ? y : x;
+  double mij = count;
+
+  if(x < 0 || y < 0){
+    return;
+  }
+  if(args->hic_band != 0 &&
+     ((j - i) * args->res < args->hic_dmin ||
+      (j - i) * args->res > args->hic_dmax)){
+    return;
+  }
+  if(norm != NULL || expected != NULL){
+    const double ni = (norm == NULL) ? 1 : ((i < norm_num) ? norm[i] : NAN);
+    const double nj = (norm == NULL) ? 1 : ((j < norm_num) ? norm[j] : NAN);
+    if(expected != NULL){
+      mij = (j - i < expected_num) ?
+	log(count / (ni * nj * expected[j - i])) / log(2) : NAN;
+    }else{
+      mij = count / (ni * nj);
+    }
+  }
+  if(!isfinite(mij)){
+    return;
+  }
+  if(data->nrow == *size){
+    *size = (*size == 0) ? 4096 : 2 * (*size);
+    if((data->i = realloc(data->i, *size * sizeof(unsigned int))) == NULL ||
+       (data->j = realloc(data->j, *size * sizeof(unsigned int))) == NULL ||
+       (data->mij = realloc(data->mij, *size * sizeof(double))) == NULL){
+      fprintf(stderr, "realloc: juicer rows\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  data->i[data->nrow] = i;
+  data->j[data->nrow] = j;
+  data->mij[data->nrow] = mij;
+  data->nrow++;
+}
+
+/**
+ * occupied cells of the matrix of args->hic_chr at --res, as recorded
+ * in the Juicer .hic file args->hic_file (0 : not recorded)
+ */
+unsigned long juicer_cells(const cmd_args *args){
+  juicer jf;
+  juicer_zoom zoom;
+  long matrix, norm_pos;
+  double *expected;
+  unsigned long expected_num;
+
+  juicer_open(args, &jf);
+  juicer_footer(args, &jf, &matrix, &norm_pos, &expected, &expected_num);
+  free(expected);
+  if(matrix < 0){
+    fclose(jf.fp);
+    return 0;
+  }
+  juicer_zoom_read(args, &jf, matrix, &zoom);
+  fclose(jf.fp);
+  free(zoom.number);
+  free(zoom.pos);
+  free(zoom.size);
+  return zoom.cells;
+}
+
+/**
+ * read the Hi-C data of args->hic_chr from the Juicer .hic file
+ * args->hic_file
+ */
+int juicer_read(const cmd_args *args,
+		hic **data){
+  metrics_phase ph;
+  juicer jf;
+  juicer_zoom zoom;
+  long matrix, norm_pos;
+  double *norm = NULL, *expected = NULL;
+  unsigned long norm_num = 0, expected_num = 0, size = 0;
+  int b, block_read = 0;
+
+  metrics_begin(&ph);
+
+  juicer_open(args, &jf);
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "start reading Juicer .hic file (version %d) from %s\n",
+	  jf.version, args->hic_file);
+
+  juicer_footer(args, &jf, &matrix, &norm_pos, &expected, &expected_num);
+  if(matrix < 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "no contacts of chromosome %s in %s\n",
+	    args->hic_chr, args->hic_file);
+    exit(EXIT_FAILURE);
+  }
+  if(strcmp(args->hic_norm, "NONE") != 0){
+    if(norm_pos < 0){
+      fprintf(stderr, "%s [ERROR] ", args->prog_name);
+      fprintf(stderr, "no %s normalization of chromosome %s at %d bp in %s\n",
+	      args->hic_norm, args->hic_chr, args->res, args->hic_file);
+      exit(EXIT_FAILURE);
+    }
+    norm = juicer_norm(args, &jf, norm_pos, &norm_num);
+  }
+  if(args->hic_oe != 0 && expected == NULL){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "no %s expected counts at %d bp in %s\n",
+	    args->hic_norm, args->res, args->hic_file);
+    exit(EXIT_FAILURE);
+  }
+  juicer_zoom_read(args, &jf, matrix, &zoom);
+
+  *data = calloc_errchk(1, sizeof(hic), "calloc hic");
+  for(b = 0; b < zoom.block_num; b++){
+    unsigned char *buf;
+    size_t len;
+    juicer_mem m;
+    int n, r;
+
+    if(juicer_block_band(args, &jf, &zoom, b) == 0){
+      continue;
+    }
+    buf = juicer_block_inflate(&jf, zoom.pos[b], zoom.size[b], &len);
+    block_read++;
+    m.file_name = args->hic_file;
+    m.p = buf;
+    m.end = buf + len;
+
+    n = juicer_mem_i32(&m);
+    if(jf.version < 7){
+      /* records (x, y, count) */
+      for(r = 0; r < n; r++){
+	const long x = juicer_mem_i32(&m), y = juicer_mem_i32(&m);
+	juicer_row(args, *data, &size, norm, norm_num, expected, expected_num,
+		   x, y, juicer_mem_f32(&m));
+      }
+    }else{
+      const long x_off = juicer_mem_i32(&m), y_off = juicer_mem_i32(&m);
+      const int short_count = (juicer_mem_u8(&m) == 0);
+      const int short_x = (jf.version > 8) ? (juicer_mem_u8(&m) == 0) : 1;
+      const int short_y = (jf.version > 8) ? (juicer_mem_u8(&m) == 0) : 1;
+      const int type = juicer_mem_u8(&m);
+
+      if(type == 1){
+	/* rows of y, each with its columns x */
+	const int rows = short_y ? juicer_mem_i16(&m) : juicer_mem_i32(&m);
+	int c;
+	for(r = 0; r < rows; r++){
+	  const long y = y_off + (short_y ? juicer_mem_i16(&m) : juicer_mem_i32(&m));
+	  const int cols = short_x ? juicer_mem_i16(&m) : juicer_mem_i32(&m);
+	  for(c = 0; c < cols; c++){
+	    const long x = x_off + (short_x ? juicer_mem_i16(&m) : juicer_mem_i32(&m));
+	    const double count = short_count ? juicer_mem_i16(&m) : juicer_mem_f32(&m);
+	    juicer_row(args, *data, &size, norm, norm_num, expected, expected_num,
+		       x, y, count);
+	  }
+	}
+      }else if(type == 2){
+	/* dense rows of width w, missing counts : -32768 or NaN */
+	const int pts = juicer_mem_i32(&m);
+	const int w = juicer_mem_i16(&m);
+	for(r = 0; r < pts; r++){
+	  const long x = x_off + r % w, y = y_off + r / w;
+	  if(short_count){
+	    const int count = juicer_mem_i16(&m);
+	    if(count != -32768){
+	      juicer_row(args, *data, &size, norm, norm_num, expected,
+			 expected_num, x, y, count);
+	    }
+	  }else{
+	    const double count = juicer_mem_f32(&m);
+	    if(!isnan(count)){
+	      juicer_row(args, *data, &size, norm, norm_num, expected,
+			 expected_num, x, y, count);
+	    }
+	  }
+	}
+      }else{
+	fprintf(stderr, "error: inflate %s\n%s\n", args->hic_file,
+		"unknown block type of Juicer .hic file");
+	exit(EXIT_FAILURE);
+      }
+    }
+    free(buf);
+  }
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "read %d of %d blocks of chromosome %s at %d bp\n",
+	  block_read, zoom.block_num, args->hic_chr, args->res);
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "# of Hi-C data points = %ld\n", (*data)->nrow);
+
+  fclose(jf.fp);
+  free(zoom.number);
+  free(zoom.pos);
+  free(zoom.size);
+  free(norm);
+  free(expected);
+
+  metrics_end(&ph, "hic_read", -1, jf.bytes, NULL, 0);
+  return 0;
+}
+
+#endif
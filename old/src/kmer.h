@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include "calloc_errchk.h"
 #include "mywc.h"
+#include "metrics.h"
 
 typedef struct _canonical_kp{
   unsigned int *kmer1;
@@ -20,12 +21,126 @@ typedef struct _kmer{
   unsigned long num;
 } kmer;
 
+unsigned int *kmer_revcmp_table(const int);
+unsigned char *kmer_motif_table(const int, const char *, const char *);
 int canonical_kp_read(const cmd_args *, canonical_kp **);
+int canonical_kp_enum(const cmd_args *, canonical_kp **);
+int canonical_kp_load(const cmd_args *, canonical_kp **);
 
 int kmer_read(const cmd_args *, kmer **);
 
+/* largest number of motifs of --exclude */
+#define KMER_MOTIF_MAX 64
+
+/**
+ * reverse complement of a bit-encoded k-mer (k <= 16) : complement all
+ * the bases, reverse the 2-bit bases within the bytes, then the bytes
+ */
+static inline unsigned int kmer_revcmp(unsigned int kmer, const int k){
+  /* complement : A <-> T (0 <-> 3), C <-> G (1 <-> 2) */
+  kmer = ~kmer;
+  kmer = ((kmer >> 2) & 0x33333333U) | ((kmer & 0x33333333U) << 2);
+  kmer = ((kmer >> 4) & 0x0F0F0F0FU) | ((kmer & 0x0F0F0F0FU) << 4);
+  kmer = __builtin_bswap32(kmer);
+  return kmer >> (32 - 2 * k);
+}
+
+/**
+ * reverse complement of every bit-encoded k-mer (4^k entries)
+ */
+unsigned int *kmer_revcmp_table(const int k){
+  const unsigned int kmer_num = 1 << (2 * k);
+  unsigned int *table = calloc_errchk(kmer_num, sizeof(unsigned int),
+				      "calloc revcmp table");
+  unsigned int kmer;
+  for(kmer = 0; kmer < kmer_num; kmer++){
+    table[kmer] = kmer_revcmp(kmer, k);
+  }
+  return table;
+}
+
+/**
+ * k-mers containing one of the comma separated motifs on either strand
+ * (4^k entries, 1 : excluded). A motif of ACGT and N (any base) of
+ * length l <= k is compiled to a pair (code, mask) of 2l bits, N having
+ * a zero mask, and matched at every offset of the k-mer.
+ */
+unsigned char *kmer_motif_table(const int k,
+				const char *motifs,
+				const char *prog_name){
+  const unsigned int kmer_num = 1 << (2 * k);
+  unsigned char *table = calloc_errchk(kmer_num, sizeof(unsigned char),
+				       "calloc motif table");
+  unsigned int code[KMER_MOTIF_MAX], mask[KMER_MOTIF_MAX];
+  int len[KMER_MOTIF_MAX];
+  int num = 0, m, n;
+  const char *c = motifs;
+
+  /* compile the motifs */
+  while(*c != '\0'){
+    if(num == KMER_MOTIF_MAX){
+      fprintf(stderr, "%s [ERROR] ", prog_name);
+      fprintf(stderr, "more than %d motifs in %s\n", KMER_MOTIF_MAX, motifs);
+      exit(EXIT_FAILURE);
+    }
+    code[num] = mask[num] = 0;
+    len[num] = 0;
+    for(; *c != '\0' && *c != ','; c++){
+      unsigned int base = 0, bits = 3;
+      switch(*c){
+      case 'A': case 'a': base = 0; break;
+      case 'C': case 'c': base = 1; break;
+      case 'G': case 'g': base = 2; break;
+      case 'T': case 't': base = 3; break;
+      case 'N': case 'n': bits = 0; break;
+      default:
+	fprintf(stderr, "%s [ERROR] ", prog_name);
+	fprintf(stderr, "invalid base '%c' in motifs %s\n", *c, motifs);
+	exit(EXIT_FAILURE);
+      }
+      if(++len[num] > k){
+	fprintf(stderr, "%s [ERROR] ", prog_name);
+	fprintf(stderr, "motif longer than k = %d in %s\n", k, motifs);
+	exit(EXIT_FAILURE);
+      }
+      code[num] = (code[num] << 2) | base;
+      mask[num] = (mask[num] << 2) | bits;
+    }
+    if(len[num] == 0){
+      fprintf(stderr, "%s [ERROR] ", prog_name);
+      fprintf(stderr, "empty motif in %s\n", motifs);
+      exit(EXIT_FAILURE);
+    }
+    num++;
+    if(*c == ','){
+      c++;
+    }
+  }
+
+  /* match them */
+  {
+    unsigned int kmer;
+    for(kmer = 0; kmer < kmer_num; kmer++){
+      for(m = 0; m < num && table[kmer] == 0; m++){
+	for(n = 0; n <= k - len[m]; n++){
+	  if(((kmer >> (2 * n)) & mask[m]) == code[m]){
+	    /* the reverse complement carries the motif on the other strand */
+	    table[kmer] = table[kmer_revcmp(kmer, k)] = 1;
+	    break;
+	  }
+	}
+      }
+    }
+  }
+  return table;
+}
+
 int canonical_kp_read(const cmd_args *args,
 		      canonical_kp **ckps){
+  metrics_phase ph;
+  long bytes = 0;
+
+  metrics_begin(&ph);
   {
     /* allocate memory */
     *ckps        = calloc_errchk(1, sizeof(canonical_kp), "calloc ckps");   
@@ -70,6 +185,7 @@ int canonical_kp_read(const cmd_args *args,
       row++;
     }
   
+    bytes = ftell(fp);
     fclose(fp);
 
     fprintf(stderr, "%s [INFO] ", args->prog_name);
@@ -77,11 +193,120 @@ int canonical_kp_read(const cmd_args *args,
 	    (*ckps)->num);
   }
 
+  /* check the pairs against k : (revcmp1, revcmp2) = (rc(kmer2), rc(kmer1)) */
+  {
+    unsigned int *rc = kmer_revcmp_table(args->k);
+    const unsigned int kmer_num = 1 << (2 * args->k);
+    unsigned long row;
+    for(row = 0; row < (*ckps)->num; row++){
+      if(((*ckps)->kmer1)[row] >= kmer_num ||
+	 ((*ckps)->kmer2)[row] >= kmer_num ||
+	 ((*ckps)->revcmp1)[row] != rc[((*ckps)->kmer2)[row]] ||
+	 ((*ckps)->revcmp2)[row] != rc[((*ckps)->kmer1)[row]]){
+	fprintf(stderr, "%s [ERROR] ", args->prog_name);
+	fprintf(stderr, "line %ld of %s is not a canonical %d-mer pair\n",
+		row + 1, args->kmer_pair, args->k);
+	exit(EXIT_FAILURE);
+      }
+    }
+    free(rc);
+  }
+
+  metrics_end(&ph, "ckp_read", -1, bytes, NULL, 0);
   return 0;
 }
 
+/**
+ * canonical k-mer pairs of args->k, enumerated in the order of
+ * canonical_kmer_pair.py (and of the rows of a .ckp file) : (a, b) is
+ * canonical when a <= rc(b), by a then by b, so that consecutive axes
+ * share the feature row of kmer1. The pairs with a k-mer excluded by
+ * args->exclude (see kmer_motif_table()) are skipped.
+ */
+int canonical_kp_enum(const cmd_args *args,
+		      canonical_kp **ckps){
+  metrics_phase ph;
+  const unsigned int kmer_num = 1 << (2 * args->k);
+  unsigned int *rc = kmer_revcmp_table(args->k);
+  unsigned char *excluded = NULL;
+  unsigned int a, b;
+  unsigned long row;
+  int pass;
+
+  metrics_begin(&ph);
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "enumerating canonical %d-mer pairs\n", args->k);
+
+  if(args->exclude != NULL){
+    excluded = kmer_motif_table(args->k, args->exclude, args->prog_name);
+    for(row = 0, a = 0; a < kmer_num; a++){
+      row += excluded[a];
+    }
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "%ld out of %d k-mers are excluded by %s\n",
+	    row, kmer_num, args->exclude);
+  }
+
+  /* count the pairs, then fill them */
+  *ckps = calloc_errchk(1, sizeof(canonical_kp), "calloc ckps");
+  for(pass = 0; pass < 2; pass++){
+    row = 0;
+    for(a = 0; a < kmer_num; a++){
+      if(excluded != NULL && excluded[a] != 0){
+	continue;
+      }
+      for(b = 0; b < kmer_num; b++){
+	if(a > rc[b] || (excluded != NULL && excluded[b] != 0)){
+	  continue;
+	}
+	if(pass == 1){
+	  ((*ckps)->kmer1)[row]   = a;
+	  ((*ckps)->kmer2)[row]   = b;
+	  ((*ckps)->revcmp1)[row] = rc[b];
+	  ((*ckps)->revcmp2)[row] = rc[a];
+	}
+	row++;
+      }
+    }
+    if(pass == 0){
+      (*ckps)->num = row;
+      (*ckps)->kmer1    = calloc_errchk(row, sizeof(unsigned int),
+					"calloc ckps (*ckps)->kmer1");
+      (*ckps)->kmer2    = calloc_errchk(row, sizeof(unsigned int),
+					"calloc ckps (*ckps)->kmer2");
+      (*ckps)->revcmp1  = calloc_errchk(row, sizeof(unsigned int),
+					"calloc ckps (*ckps)->revcmp1");
+      (*ckps)->revcmp2  = calloc_errchk(row, sizeof(unsigned int),
+					"calloc ckps (*ckps)->revcmp2");
+    }
+  }
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "# of canonical k-mer pairs = %ld\n",
+	  (*ckps)->num);
+
+  free(rc);
+  free(excluded);
+  metrics_end(&ph, "ckp_enum", -1, 0, NULL, 0);
+  return 0;
+}
+
+/* canonical k-mer pairs from the file of --kmer, or enumerated */
+int canonical_kp_load(const cmd_args *args,
+		      canonical_kp **ckps){
+  if(args->kmer_pair != NULL){
+    return canonical_kp_read(args, ckps);
+  }
+  return canonical_kp_enum(args, ckps);
+}
+
 int kmer_read(const cmd_args *args,
 	      kmer **kmers){
+  metrics_phase ph;
+  long bytes = 0;
+
+  metrics_begin(&ph);
   {
     /* allocate memory */
     *kmers        = calloc_errchk(1, sizeof(kmer), "calloc kmers");   
@@ -115,6 +340,7 @@ int kmer_read(const cmd_args *args,
       row++;
     }
   
+    bytes = ftell(fp);
     fclose(fp);
 
     fprintf(stderr, "%s [INFO] ", args->prog_name);
@@ -122,6 +348,7 @@ int kmer_read(const cmd_args *args,
 	    (*kmers)->num);
   }
 
+  metrics_end(&ph, "kmer_read", -1, bytes, NULL, 0);
   return 0;
 }
 
@@ -0,0 +1,668 @@
+#ifndef __L2BATCH_H__
+#define __L2BATCH_H__
+
+/**
+ * batched L2 Boosting (--batch_acc, --batch_hic, --cv)
+ *  r models are trained together over one feature table and one row set:
+ *  every Hi-C response (--hic and the files of --batch_hic, which must
+ *  list the same rows) with every learning rate (--acc and the values of
+ *  --batch_acc). The residuals of the models are interleaved
+ *  (U[i * r + b]), so that a pass of l2_cmpUdX_batch() gathers the
+ *  pairwise features of a row once for all of them (a GEMM instead of r
+ *  GEMVs).
+ *  Model 0 (--hic, --acc) is written to the output file o, model b to
+ *  o.b<b>, and o.batch lists the models.
+ *
+ *  With --cv K, every configuration is trained K times, model b holding
+ *  out the rows of fold held[b] (rows hashed into folds, or blocks of
+ *  cv_block bins with --cv_block). The residuals of the held-out rows
+ *  stay 0 in U[], so that the shared passes only see the training rows,
+ *  and ||X^{(j)}||^2 of a fold model is that of all rows minus that of
+ *  the held-out rows. The held-out residuals are updated on the side
+ *  (O(held-out rows) per step), and o.cv reports the cross-validated
+ *  error of every configuration at every iteration. Every model is
+ *  written to o.b<b>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+
+#include "constant.h"
+#include "calloc_errchk.h"
+#include "cmd_args.h"
+#include "hic.h"
+#include "kmer.h"
+#include "l2boost.h"
+#include "metrics.h"
+
+typedef struct _l2_batch{
+  /* number of models */
+  unsigned long r;
+  /* learning rate, response, Hi-C file and output file of model b */
+  double *v;
+  const double **Y;
+  char **hic_file;
+  char **out_file;
+  /* Hi-C data of --batch_hic */
+  hic **extra;
+  int extra_num;
+  /* cross-validation (fold_num = 0 : off) : fold of every row, fold held
+   * out of model b, held-out rows of every fold, the responses of model
+   * b on its training rows (0 on the held-out rows) and on its held-out
+   * rows, and its held-out mean squared error at every iteration */
+  unsigned int fold_num;
+  unsigned int *fold;
+  unsigned int *held;
+  hic **heldout;
+  double **Y_train;
+  double **Y_held;
+  double **cv_err;
+} l2_batch;
+
+int l2_batch_prep(const cmd_args *args,
+		  const hic *data,
+		  l2_batch **batch);
+int l2_batch_free(l2_batch *batch);
+int l2_batch_dump(const cmd_args *args,
+		  const l2_batch *batch);
+int l2_batch_cv_dump(const cmd_args *args,
+		     const l2_batch *batch,
+		     const hic *data,
+		     boost **models);
+int l2_train_batch(const cmd_args *args,
+		   const double **feature,
+		   const float **feature_f,
+		   const hic *data,
+		   const canonical_kp *ckps,
+		   const l2_batch *batch,
+		   boost **models,
+		   FILE **fps);
+
+/* split a comma separated list into (a copy of) its items */
+static int l2_batch_split(const char *list,
+			  char ***items){
+  char *buf, *tok, *save = NULL;
+  int num = 1;
+  const char *q;
+  for(q = list; *q != '\0'; q++){
+    num += (*q == ',');
+  }
+  buf = calloc_errchk(strlen(list) + 1, sizeof(char), "calloc batch list");
+  strcpy(buf, list);
+  *items = calloc_errchk(num, sizeof(char *), "calloc batch items[]");
+  num = 0;
+  for(tok = strtok_r(buf, ",", &save); tok != NULL;
+      tok = strtok_r(NULL, ",", &save)){
+    (*items)[num++] = tok;
+  }
+  return num;
+}
+
+/**
+ * fold of row i : blocks of cv_block bins (by the first bin of the
+ * contact) dealt to the folds in turn, or a fixed pseudo-random fold
+ */
+static unsigned int l2_batch_fold(const cmd_args *args,
+				  const hic *data,
+				  const unsigned long i){
+  if(args->cv_block > 0){
+    return (data->i[i] / (unsigned int)args->cv_block) % (unsigned int)args->cv;
+  }
+  return (unsigned int)(hic_row_hash(i) % (unsigned long)args->cv);
+}
+
+/* the folds of the rows, and the held-out rows of every fold */
+static int l2_batch_cv_prep(const cmd_args *args,
+			    const hic *data,
+			    l2_batch *batch){
+  const unsigned int K = (unsigned int)args->cv;
+  unsigned long i, *num;
+  unsigned int f;
+
+  batch->fold_num = K;
+  batch->fold = calloc_errchk(data->nrow, sizeof(unsigned int),
+			      "calloc batch fold[]");
+  batch->heldout = calloc_errchk(K, sizeof(hic *), "calloc batch heldout[]");
+  num = calloc_errchk(K, sizeof(unsigned long), "calloc fold num[]");
+  for(i = 0; i < data->nrow; i++){
+    batch->fold[i] = l2_batch_fold(args, data, i);
+    num[batch->fold[i]]++;
+  }
+
+  for(f = 0; f < K; f++){
+    if(num[f] == 0){
+      fprintf(stderr, "%s [ERROR] ", args->prog_name);
+      fprintf(stderr, "fold %d has no Hi-C rows (use a smaller --cv_block)\n",
+	      f);
+      exit(EXIT_FAILURE);
+    }
+    batch->heldout[f] = calloc_errchk(1, sizeof(hic), "calloc hic");
+    batch->heldout[f]->i = calloc_errchk(num[f], sizeof(unsigned int),
+					 "calloc heldout->i");
+    batch->heldout[f]->j = calloc_errchk(num[f], sizeof(unsigned int),
+					 "calloc heldout->j");
+    batch->heldout[f]->mij = calloc_errchk(num[f], sizeof(double),
+					   "calloc heldout->mij");
+  }
+  for(i = 0; i < data->nrow; i++){
+    hic *h = batch->heldout[batch->fold[i]];
+    h->i[h->nrow] = data->i[i];
+    h->j[h->nrow] = data->j[i];
+    h->mij[h->nrow] = data->mij[i];
+    h->nrow++;
+  }
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "cv: %d folds of", K);
+  for(f = 0; f < K; f++){
+    fprintf(stderr, " %ld", num[f]);
+  }
+  fprintf(stderr, " rows\n");
+  free(num);
+  return 0;
+}
+
+/**
+ * the models of the batch : (--hic, --batch_hic) x (--acc, --batch_acc)
+ * (x the folds of --cv), reading the Hi-C files of --batch_hic
+ */
+int l2_batch_prep(const cmd_args *args,
+		  const hic *data,
+		  l2_batch **batch){
+  char **acc_str = NULL, **hic_str = NULL;
+  int acc_num = 0, hic_num = 0, a, h;
+  const unsigned int K = (args->cv > 0) ? (unsigned int)args->cv : 1;
+  unsigned int f;
+  unsigned long b, i;
+
+  if(args->batch_acc != NULL){
+    acc_num = l2_batch_split(args->batch_acc, &acc_str);
+  }
+  if(args->batch_hic != NULL){
+    hic_num = l2_batch_split(args->batch_hic, &hic_str);
+  }
+
+  *batch = calloc_errchk(1, sizeof(l2_batch), "calloc l2_batch");
+  (*batch)->r = (unsigned long)(1 + hic_num) * (1 + acc_num) * K;
+  if((*batch)->r > L2_BATCH_MAX){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "a batch holds at most %d models (%ld requested)\n",
+	    L2_BATCH_MAX, (*batch)->r);
+    exit(EXIT_FAILURE);
+  }
+  (*batch)->v        = calloc_errchk((*batch)->r, sizeof(double),
+				     "calloc batch v[]");
+  (*batch)->Y        = calloc_errchk((*batch)->r, sizeof(double *),
+				     "calloc batch Y[]");
+  (*batch)->hic_file = calloc_errchk((*batch)->r, sizeof(char *),
+				     "calloc batch hic_file[]");
+  (*batch)->out_file = calloc_errchk((*batch)->r, sizeof(char *),
+				     "calloc batch out_file[]");
+  (*batch)->held     = calloc_errchk((*batch)->r, sizeof(unsigned int),
+				     "calloc batch held[]");
+  (*batch)->extra    = calloc_errchk(hic_num + 1, sizeof(hic *),
+				     "calloc batch extra[]");
+  (*batch)->extra_num = hic_num;
+
+  /* responses on the rows of --hic */
+  for(h = 0; h < hic_num; h++){
+    cmd_args args_h = *args;
+    args_h.hic_file = hic_str[h];
+    hic_read(&args_h, &((*batch)->extra[h]));
+    if((*batch)->extra[h]->nrow != data->nrow){
+      fprintf(stderr, "%s [ERROR] ", args->prog_name);
+      fprintf(stderr, "%s has %ld rows, %s has %ld\n",
+	      hic_str[h], (*batch)->extra[h]->nrow,
+	      args->hic_file, data->nrow);
+      exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < data->nrow; i++){
+      if((*batch)->extra[h]->i[i] != data->i[i] ||
+	 (*batch)->extra[h]->j[i] != data->j[i]){
+	fprintf(stderr, "%s [ERROR] ", args->prog_name);
+	fprintf(stderr, "row %ld of %s differs from %s\n",
+		i + 1, hic_str[h], args->hic_file);
+	exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  for(h = 0; h <= hic_num; h++){
+    for(a = 0; a <= acc_num; a++){
+      for(f = 0; f < K; f++){
+	b = ((unsigned long)h * (1 + acc_num) + a) * K + f;
+	(*batch)->v[b] = (a == 0) ? args->acc : atof(acc_str[a - 1]);
+	if((*batch)->v[b] <= 0){
+	  fprintf(stderr, "%s [ERROR] ", args->prog_name);
+	  fprintf(stderr, "batch_acc must be positive (%s)\n", acc_str[a - 1]);
+	  exit(EXIT_FAILURE);
+	}
+	(*batch)->Y[b] = (h == 0) ? data->mij : (*batch)->extra[h - 1]->mij;
+	(*batch)->hic_file[b] = (h == 0) ? args->hic_file : hic_str[h - 1];
+	(*batch)->held[b] = f;
+	(*batch)->out_file[b] = calloc_errchk(F_NAME_LEN, sizeof(char),
+					      "calloc batch out_file");
+	if(b == 0 && args->cv == 0){
+	  snprintf((*batch)->out_file[b], F_NAME_LEN, "%s", args->out_file);
+	}else{
+	  snprintf((*batch)->out_file[b], F_NAME_LEN, "%s.b%ld",
+		   args->out_file, b);
+	}
+      }
+    }
+  }
+
+  if(args->cv > 0){
+    l2_batch_cv_prep(args, data, *batch);
+    (*batch)->Y_train = calloc_errchk((*batch)->r, sizeof(double *),
+				      "calloc batch Y_train[]");
+    (*batch)->Y_held  = calloc_errchk((*batch)->r, sizeof(double *),
+				      "calloc batch Y_held[]");
+    (*batch)->cv_err  = calloc_errchk((*batch)->r, sizeof(double *),
+				      "calloc batch cv_err[]");
+    for(b = 0; b < (*batch)->r; b++){
+      const unsigned int held = (*batch)->held[b];
+      unsigned long row = 0;
+      (*batch)->Y_train[b] = calloc_errchk(data->nrow, sizeof(double),
+					   "calloc batch Y_train");
+      (*batch)->Y_held[b] = calloc_errchk((*batch)->heldout[held]->nrow,
+					  sizeof(double), "calloc batch Y_held");
+      (*batch)->cv_err[b] = calloc_errchk(args->iter1 + 1, sizeof(double),
+					  "calloc batch cv_err");
+      for(i = 0; i < data->nrow; i++){
+	if((*batch)->fold[i] == held){
+	  (*batch)->Y_held[b][row++] = (*batch)->Y[b][i];
+	}else{
+	  (*batch)->Y_train[b][i] = (*batch)->Y[b][i];
+	}
+      }
+    }
+  }
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "batch: %ld models (%d Hi-C files x %d learning rates x %d folds)\n",
+	  (*batch)->r, 1 + hic_num, 1 + acc_num, K);
+  /* the items point into the copies of the lists, which are kept */
+  free(acc_str);
+  free(hic_str);
+  return 0;
+}
+
+int l2_batch_free(l2_batch *batch){
+  unsigned long b;
+  unsigned int f;
+  int h;
+  for(h = 0; h < batch->extra_num; h++){
+    hic_free(batch->extra[h]);
+  }
+  for(b = 0; b < batch->r; b++){
+    free(batch->out_file[b]);
+  }
+  if(batch->fold_num > 0){
+    for(f = 0; f < batch->fold_num; f++){
+      hic_free(batch->heldout[f]);
+    }
+    for(b = 0; b < batch->r; b++){
+      free(batch->Y_train[b]);
+      free(batch->Y_held[b]);
+      free(batch->cv_err[b]);
+    }
+    free(batch->heldout);
+    free(batch->fold);
+    free(batch->Y_train);
+    free(batch->Y_held);
+    free(batch->cv_err);
+  }
+  free(batch->extra);
+  free(batch->held);
+  free(batch->out_file);
+  free(batch->hic_file);
+  free(batch->Y);
+  free(batch->v);
+  free(batch);
+  return 0;
+}
+
+/* o.batch : model, Hi-C file, learning rate, held-out fold and output file */
+int l2_batch_dump(const cmd_args *args,
+		  const l2_batch *batch){
+  char file[F_NAME_LEN];
+  unsigned long b;
+  FILE *fp;
+  snprintf(file, F_NAME_LEN, "%s.batch", args->out_file);
+  if((fp = fopen(file, "w")) == NULL){
+    fprintf(stderr, "error: fopen %s\n%s\n",
+	    file, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  fprintf(fp, "model\thic\tacc\tfold\tout\n");
+  for(b = 0; b < batch->r; b++){
+    if(batch->fold_num > 0){
+      fprintf(fp, "%ld\t%s\t%e\t%d\t%s\n",
+	      b, batch->hic_file[b], batch->v[b], batch->held[b],
+	      batch->out_file[b]);
+    }else{
+      fprintf(fp, "%ld\t%s\t%e\t-\t%s\n",
+	      b, batch->hic_file[b], batch->v[b], batch->out_file[b]);
+    }
+  }
+  fclose(fp);
+  return 0;
+}
+
+/**
+ * o.cv : for every configuration (Hi-C file, learning rate) and
+ * iteration, the cross-validated mean squared error (held-out squared
+ * errors of all folds over all rows), its standard error over the folds
+ * and the mean training error of the fold models; and the iteration of
+ * the smallest error on stderr
+ */
+int l2_batch_cv_dump(const cmd_args *args,
+		     const l2_batch *batch,
+		     const hic *data,
+		     boost **models){
+  const unsigned int K = batch->fold_num;
+  char file[F_NAME_LEN];
+  unsigned long b0, b;
+  unsigned int m, f;
+  FILE *fp;
+  snprintf(file, F_NAME_LEN, "%s.cv", args->out_file);
+  if((fp = fopen(file, "w")) == NULL){
+    fprintf(stderr, "error: fopen %s\n%s\n",
+	    file, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  fprintf(fp, "hic\tacc\titer\tcv_mse\tcv_se\ttrain_mse\n");
+  for(b0 = 0; b0 < batch->r; b0 += K){
+    unsigned int best = 0;
+    double best_mse = 0;
+    for(m = 0; m <= models[b0]->iternum; m++){
+      double sse = 0, mean = 0, sq = 0, train = 0;
+      for(f = 0; f < K; f++){
+	b = b0 + f;
+	sse += batch->cv_err[b][m] * batch->heldout[batch->held[b]]->nrow;
+	mean += batch->cv_err[b][m] / K;
+	train += models[b]->res_sq[m] / K;
+      }
+      for(f = 0; f < K; f++){
+	sq += (batch->cv_err[b0 + f][m] - mean) *
+	  (batch->cv_err[b0 + f][m] - mean);
+      }
+      fprintf(fp, "%s\t%e\t%d\t%e\t%e\t%e\n",
+	      batch->hic_file[b0], batch->v[b0], m, sse / data->nrow,
+	      sqrt(sq / (K - 1)) / sqrt(K), train);
+      if(m == 0 || sse / data->nrow < best_mse){
+	best = m;
+	best_mse = sse / data->nrow;
+      }
+    }
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "cv: %s acc %e : smallest error %e at iteration %d\n",
+	    batch->hic_file[b0], batch->v[b0], best_mse, best);
+  }
+  fclose(fp);
+  return 0;
+}
+
+/* boost_select_axis() of model b over the interleaved UdX[j * r + b] */
+static unsigned long l2_batch_select(const double *UdX,
+				     const double *Xnormsq,
+				     const unsigned long p,
+				     const unsigned long r,
+				     const unsigned long b){
+  unsigned long argmax = 0, j;
+  double max = boost_score(UdX[b], Xnormsq[0]);
+  for(j = 1; j < p; j++){
+    const double score = boost_score(UdX[j * r + b], Xnormsq[j]);
+    if(max < score){
+      argmax = j;
+      max = score;
+    }
+  }
+  return argmax;
+}
+
+/**
+ * l2_train() of the models of the batch, models[b] written to fps[b]
+ * (no lazy axis search, screening, shadow run or NUMA placement)
+ */
+int l2_train_batch(const cmd_args *args,
+		   const double **feature,
+		   const float **feature_f,
+		   const hic *data,
+		   const canonical_kp *ckps,
+		   const l2_batch *batch,
+		   boost **models,
+		   FILE **fps){
+  const unsigned long n = data->nrow;
+  const unsigned long p = ckps->num;
+  const unsigned long r = batch->r;
+  const unsigned int K = batch->fold_num;
+  const int thread_num = args->thread_num;
+  const unsigned int iternum = models[0]->iternum;
+  /* kernels and feature table of the working precision */
+  const l2_kernels *kern = l2_kernels_select(args->precision, args->k);
+  const void *feat =
+    (args->precision == SINGLE) ? (const void *)feature_f : (const void *)feature;
+  /* metrics : bytes touched per (row, column) of Xnormsq and UdX (the
+   * features once, U[] of every model), per row of the update */
+  const double bytes_X = 2 * sizeof(unsigned int) + 4 * kern->real_size;
+  const double bytes_UdX = bytes_X + r * kern->real_size;
+  const double bytes_U = 2 * sizeof(unsigned int) + r * 6 * kern->real_size;
+  void *U, **U_held = NULL;
+  double *UdX, *Xnormsq, *Xnormsq_cv = NULL, *gamma, *step, *res_sq;
+  /* ||X^{(j)}||^2 over the training rows of model b, their number */
+  const double **Xn;
+  unsigned long *n_train;
+  unsigned long *s, b, j;
+  unsigned int m, f;
+  double time_start, time_prev, time;
+  cmpUdX_args *params;
+  pthread_t *threads;
+  metrics_phase ph, ph_iter;
+  double *busy = calloc_errchk(thread_num, sizeof(double), "calloc busy[]");
+  int t;
+
+  /* allocate memory */
+  {
+    U       = calloc_errchk(n * r, kern->real_size, "calloc U[]");
+    UdX     = calloc_errchk(p * r, sizeof(double), "calloc UdX[]");
+    Xnormsq = calloc_errchk(p, sizeof(double), "calloc Xnormsq[]");
+    Xn      = calloc_errchk(r, sizeof(double *), "calloc Xn[]");
+    n_train = calloc_errchk(r, sizeof(unsigned long), "calloc n_train[]");
+    gamma   = calloc_errchk(r, sizeof(double), "calloc gamma[]");
+    step    = calloc_errchk(r * ((K > 0) ? K : 1), sizeof(double),
+			    "calloc step[]");
+    res_sq  = calloc_errchk(r, sizeof(double), "calloc res_sq[]");
+    s       = calloc_errchk(r, sizeof(unsigned long), "calloc s[]");
+    if(K > 0){
+      Xnormsq_cv = calloc_errchk(p * K, sizeof(double), "calloc Xnormsq_cv[]");
+      U_held = calloc_errchk(r, sizeof(void *), "calloc U_held[]");
+      for(b = 0; b < r; b++){
+	U_held[b] = calloc_errchk(batch->heldout[batch->held[b]]->nrow,
+				  kern->real_size, "calloc U_held[][]");
+      }
+    }
+  }
+
+  /* initialize residuals U[i * r + b] := Y[b][i] (0 on held-out rows) */
+  kern->set_U_batch(U, res_sq, r, n,
+		    (K > 0) ? (const double **)batch->Y_train : batch->Y);
+  for(b = 0; b < r; b++){
+    n_train[b] = (K > 0) ? n - batch->heldout[batch->held[b]]->nrow : n;
+    (models[b]->res_sq)[0] = res_sq[b] * n / n_train[b];
+    if(K > 0){
+      const hic *h = batch->heldout[batch->held[b]];
+      batch->cv_err[b][0] = kern->set_U(U_held[b], h->nrow, batch->Y_held[b]);
+    }
+  }
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "start computation of Xnormsq with %d threads (%ld models, %s precision)\n",
+	  thread_num, r, (args->precision == SINGLE) ? "single" : "double");
+
+  /* compute Xnormsq ||X^{(j)}||^2, shared by the models */
+  time_prev = trace_now();
+  metrics_begin(&ph);
+  boost_pthread_prep(thread_num, n, p,
+		     feat, data, ckps, NULL,
+		     U, UdX, Xnormsq,
+		     &params, &threads);
+  boost_pthread_run(thread_num, kern->cmpXnormsq, params, threads, NULL);
+  boost_pthread_busy(thread_num, params, busy);
+  metrics_end(&ph, "Xnormsq", -1, bytes_X * n * p, busy, thread_num);
+  for(b = 0; b < r; b++){
+    Xn[b] = Xnormsq;
+  }
+
+  if(K > 0){
+    /* training rows of fold f : all rows minus the held-out rows */
+    metrics_begin(&ph);
+    for(f = 0; f < K; f++){
+      double *Xn_f = Xnormsq_cv + (unsigned long)f * p;
+      for(t = 0; t < thread_num; t++){
+	params[t].n = batch->heldout[f]->nrow;
+	params[t].data = batch->heldout[f];
+	params[t].Xnormsq = Xn_f;
+      }
+      boost_pthread_run(thread_num, kern->cmpXnormsq, params, threads, NULL);
+      for(j = 0; j < p; j++){
+	Xn_f[j] = (Xnormsq[j] > Xn_f[j]) ? Xnormsq[j] - Xn_f[j] : 0;
+      }
+    }
+    for(t = 0; t < thread_num; t++){
+      params[t].n = n;
+      params[t].data = data;
+      params[t].Xnormsq = Xnormsq;
+    }
+    for(b = 0; b < r; b++){
+      Xn[b] = Xnormsq_cv + (unsigned long)batch->held[b] * p;
+    }
+    metrics_end(&ph, "cv_Xnormsq", -1, bytes_X * n * p, NULL, 0);
+  }
+
+  /* cache blocking : a column block carries r partial sums per column */
+  boost_tile_prep(args, thread_num, n, kern->real_size, data, params);
+  for(t = 0; t < thread_num; t++){
+    params[t].batch = r;
+    if(params[t].tile_cols > 0){
+      params[t].tile_cols = (params[t].tile_cols + r - 1) / r;
+      free(params[t].tile_sum);
+      free(params[t].tile_c);
+      params[t].tile_sum = calloc_errchk(params[t].tile_cols * r,
+					 sizeof(double), "calloc tile_sum[]");
+      params[t].tile_c = calloc_errchk(params[t].tile_cols * r,
+				       sizeof(double), "calloc tile_c[]");
+    }
+  }
+  time = trace_now();
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "Xnormsq finished in %f sec.\n", (time - time_prev));
+
+  time_prev = time;
+  time_start = time;
+
+  for(m = 1; m <= iternum; m++){
+    metrics_begin(&ph_iter);
+
+    /* inner products U_b . X^{(j)} of every model */
+    metrics_begin(&ph);
+    boost_pthread_run(thread_num, kern->cmpUdX_batch, params, threads, NULL);
+    boost_pthread_busy(thread_num, params, busy);
+    metrics_end(&ph, "UdX", m, bytes_UdX * n * p, busy, thread_num);
+
+    /* select the axis of every model */
+    metrics_begin(&ph);
+    for(b = 0; b < r; b++){
+      s[b] = l2_batch_select((const double *)UdX, Xn[b], p, r, b);
+      gamma[b] = UdX[s[b] * r + b] / Xn[b][s[b]];
+      (models[b]->beta)[s[b]] += batch->v[b] * gamma[b];
+      if(K > 0){
+	/* no step on the rows held out of model b */
+	for(f = 0; f < K; f++){
+	  step[f * r + b] = (f == batch->held[b]) ? 0 : batch->v[b] * gamma[b];
+	}
+      }else{
+	step[b] = batch->v[b] * gamma[b];
+      }
+    }
+    metrics_end(&ph, "select", m, 2 * sizeof(double) * p * r, NULL, 0);
+
+    /* update U[] and the sums of residual squares */
+    metrics_begin(&ph);
+    kern->update_U_batch(U, res_sq, r, n, (const unsigned long *)s,
+			 feat, data, ckps,
+			 (const double *)step,
+			 (const unsigned int *)batch->fold);
+    metrics_end(&ph, "update", m, bytes_U * n, NULL, 0);
+
+    if(K > 0){
+      /* held-out residuals and errors */
+      metrics_begin(&ph);
+      for(b = 0; b < r; b++){
+	const hic *h = batch->heldout[batch->held[b]];
+	kern->update_U(U_held[b], batch->cv_err[b],
+		       m, h->nrow, s[b],
+		       feat, h, ckps,
+		       gamma[b], batch->v[b]);
+      }
+      metrics_end(&ph, "cv_update", m, bytes_U / r * n, NULL, 0);
+    }
+
+    time = trace_now();
+    for(b = 0; b < r; b++){
+      (models[b]->res_sq)[m] = res_sq[b] * n / n_train[b];
+      boost_step_dump(models[b],
+		      (const unsigned int)m,
+		      (const unsigned long)s[b],
+		      batch->v[b] * gamma[b],
+		      (const double)(time - time_prev),
+		      (const double)(time - time_start),
+		      fps[b]);
+      fprintf(stderr, "%s [INFO] model %ld \t ", args->prog_name, b);
+      boost_step_dump(models[b],
+		      (const unsigned int)m,
+		      (const unsigned long)s[b],
+		      batch->v[b] * gamma[b],
+		      (const double)(time - time_prev),
+		      (const double)(time - time_start),
+		      stderr);
+    }
+    time_prev = time;
+    metrics_end(&ph_iter, "iteration", m, 0, NULL, 0);
+  }
+
+  for(b = 0; b < r; b++){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "beta of model %ld\n", b);
+    boost_dump_beta((const boost *)models[b], p);
+  }
+
+  if(K > 0){
+    for(b = 0; b < r; b++){
+      free(U_held[b]);
+    }
+    free(U_held);
+    free(Xnormsq_cv);
+  }
+  boost_tile_free(thread_num, params);
+  free(params);
+  free(threads);
+  free(U);
+  free(UdX);
+  free(Xnormsq);
+  free(Xn);
+  free(n_train);
+  free(gamma);
+  free(step);
+  free(res_sq);
+  free(s);
+  free(busy);
+  return 0;
+}
+
+#endif
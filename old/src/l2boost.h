@@ -1,22 +1,87 @@
 #ifndef __l2boost_H__
 #define __l2boost_H__ 
 
-#include <sys/time.h>
 #include <math.h>
+#include <float.h>
+#include <stdint.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include "calloc_errchk.h"
-#include "diffSec.h"
 #include "kmer.h"
 #include "hic.h"
+#include "numa_topo.h"
+#include "metrics.h"
+
+/* relative margin on the screening bound against rounding errors (in
+ * double precision, see boost_screen_tol()) */
+#define SCREEN_TOL 1e-6
+/* smallest automatic row block of l2_cmpUdX() */
+#define TILE_ROWS_MIN 256
+/* k-mer lengths with specialized kernels (see l2kernel_k.h) */
+#define L2_K_MIN 3
+#define L2_K_MAX 6
+/* largest number of models of a batched training (see l2batch.h) */
+#define L2_BATCH_MAX 32
 
 /* boost results */
+/**
+ * sparse coefficients, keyed by the axis id (sparse mode, see sparse.h)
+ *  open addressing with linear probing, size is a power of 2
+ */
+typedef struct _sp_beta{
+  unsigned long size;
+  unsigned long num;
+  unsigned long *key;
+  double *val;
+} sp_beta;
+
+#define SP_BETA_EMPTY (~0UL)
+#define SP_BETA_INIT_SIZE 1024
+
 typedef struct _boost{
   double *res_sq;
   double *beta;
+  /* beta of the sparse mode (NULL : dense beta[]) */
+  sp_beta *beta_sp;
   unsigned int nextiter;
   unsigned int iternum;
 } boost;
 
+/**
+ * safe screening of axes
+ *  |U.X^{(j)}| / ||X^{(j)}|| is bounded by ||U|| and, after the last exact
+ *  evaluation of column j, by UdX_ref[j] + (drift - drift_ref[j]), where
+ *  drift accumulates ||U_m - U_{m-1}|| over the iterations.
+ */
+typedef struct _screen_state{
+  /* |U.X^{(j)}| / ||X^{(j)}|| at the last exact evaluation (< 0 : never) */
+  double *UdX_ref;
+  /* drift at the last exact evaluation of column j */
+  double *drift_ref;
+  double drift;
+  double Unorm;
+  /* relative margin on the bound (see boost_screen_tol()) */
+  double tol;
+  /* best score found so far in the current pass (shared by the workers) */
+  _Atomic double best;
+} screen_state;
+
+/**
+ * sign agreement bitsets of AdaBoost (see ada_cmpUdX_bits())
+ *  bit 2i (2i + 1) is the agreement of the value x at the first (second)
+ *  bin of Hi-C row i with the sign of Y[i] : (x Y > 0) || (x == 0 && Y >= 0)
+ */
+typedef struct _ada_bits{
+  /* 64 bit words per set */
+  unsigned long words;
+  /* F[j * words, ...] : x = feature[bin][kmer[j]], F_num[j] : its size */
+  uint64_t *F;
+  unsigned long *F_num;
+  /* A[] : x = beta_x[], A_num : its size */
+  uint64_t *A;
+  unsigned long A_num;
+} ada_bits;
+
 typedef struct _cmpUdX_args{
   /* thread specific info */
   int thread_id;
@@ -24,35 +89,178 @@ typedef struct _cmpUdX_args{
   unsigned long end;
   /* shared param(s) */
   unsigned long n;
-  /* shared data */
-  const double **feature;
+  /* column subset (NULL : columns begin, ..., end - 1) */
+  const unsigned long *idx;
+  /* shared data (feature : L2_REAL **, see l2kernel.h) */
+  const void *feature;
   const hic *data;
   const canonical_kp *ckps;
   const kmer *kmers;
-  /* shared data */
-  double *U;
+  /* shared data (U : L2_REAL *) */
+  void *U;
   double *UdX;
   double *Xnormsq;
+  /* number of interleaved residual vectors of l2_cmpUdX_batch() */
+  unsigned long batch;
+  /* safe screening (NULL : disabled) */
+  screen_state *screen;
+  unsigned long pruned;
+  /* sign agreement bitsets of ada_cmpUdX_bits() */
+  ada_bits *bits;
+  /* cache blocking of l2_cmpUdX() (0 : no blocking) and its
+   * per-thread partial sums (tile_cols entries each) */
+  unsigned long tile_rows;
+  unsigned long tile_cols;
+  unsigned long *tile_col;
+  double *tile_sum;
+  double *tile_c;
+  /* worker of the last boost_pthread_run() and its wall time (s) */
+  void *(*worker)(void *);
+  double busy;
+  /* hardware counters of the last run (--perf) */
+  perf_counts perf;
 } cmpUdX_args;
 
+/* L2 Boosting kernels of one scalar type (see l2kernel.h) */
+typedef struct _l2_kernels{
+  size_t real_size;
+  void *(*cmpXnormsq)(void *args);
+  void *(*cmpUdX)(void *args);
+  double (*cmpUdX_col)(const void *U,
+		       const unsigned long n,
+		       const unsigned long j,
+		       const void *feature,
+		       const hic *data,
+		       const canonical_kp *ckps);
+  double (*set_U)(void *U,
+		  const unsigned long n,
+		  const double *Y);
+  double (*Unormsq)(const void *U,
+		    const unsigned long n);
+  int (*update_U)(void *U,
+		  double *residual_square,
+		  const unsigned int m,
+		  const unsigned long n,
+		  const unsigned long s,
+		  const void *feature,
+		  const hic *data,
+		  const canonical_kp *ckps,
+		  const double gamma,
+		  const double v);
+  int (*apply_beta)(void *U,
+		    const unsigned long n,
+		    const unsigned long p,
+		    const double *beta,
+		    const void *feature,
+		    const hic *data,
+		    const canonical_kp *ckps);
+  int (*predict)(double *pred,
+		 const unsigned long n,
+		 const unsigned long p,
+		 const double *beta,
+		 const void *feature,
+		 const hic *data,
+		 const canonical_kp *ckps);
+  /* batched training (see l2batch.h) */
+  void *(*cmpUdX_batch)(void *args);
+  int (*set_U_batch)(void *U,
+		     double *res_sq,
+		     const unsigned long r,
+		     const unsigned long n,
+		     const double **Y);
+  int (*update_U_batch)(void *U,
+			double *res_sq,
+			const unsigned long r,
+			const unsigned long n,
+			const unsigned long *s,
+			const void *feature,
+			const hic *data,
+			const canonical_kp *ckps,
+			const double *step,
+			const unsigned int *group);
+} l2_kernels;
+
+const l2_kernels *l2_kernels_select(const precision prec,
+				    const int k);
 void *boost_cmpXnormsq(void *args);
 int boost_dump_beta(const boost *model, 
 		    const unsigned long p);
 int boost_pthread_prep(const int thread_num,
 		       const unsigned long n,
 		       const unsigned long p,		 
-		       const double **feature,
+		       const void *feature,
 		       const hic *data,
 		       const canonical_kp *ckps,
 		       const kmer *kmers,
-		       double *U,
+		       void *U,
 		       double *UdX,
 		       double *Xnormsq,
 		       cmpUdX_args **params,
 		       pthread_t **threads);
+int boost_pthread_set_idx(const int thread_num,
+			  const unsigned long *idx,
+			  const unsigned long num,
+			  cmpUdX_args *params);
+void *boost_pthread_timed(void *args);
+int boost_pthread_busy(const int thread_num,
+		       const cmpUdX_args *params,
+		       double *busy);
+int boost_pthread_run(const int thread_num,
+		      void *(*worker)(void *),
+		      cmpUdX_args *params,
+		      pthread_t *threads,
+		      const pthread_attr_t *attrs);
+unsigned long boost_cache_size(const int level,
+			       const unsigned long fallback);
+int boost_tile_prep(const cmd_args *args,
+		    const int thread_num,
+		    const unsigned long n,
+		    const size_t real_size,
+		    const hic *data,
+		    cmpUdX_args *params);
+int boost_tile_free(const int thread_num,
+		    cmpUdX_args *params);
 unsigned long boost_select_axis(const double *UdX, 
 				const double *Xnormsq,
 				const unsigned long p);
+double boost_score(const double UdX,
+		   const double Xnormsq);
+unsigned long boost_select_axis_idx(const double *UdX, 
+				    const double *Xnormsq,
+				    const unsigned long *idx,
+				    const unsigned long num);
+int boost_cand_select(const double *UdX, 
+		      const double *Xnormsq,
+		      const unsigned long p,
+		      const unsigned long cand_num,
+		      unsigned long *cand,
+		      double *bound);
+unsigned long boost_cand_expand(const canonical_kp *ckps,
+				const unsigned long p,
+				const unsigned long s,
+				const unsigned long *cand,
+				const unsigned long cand_num,
+				unsigned int *stamp,
+				const unsigned int m,
+				unsigned long *eval);
+int boost_screen_init(const unsigned long p,
+		      const double tol,
+		      screen_state **screen);
+double boost_screen_bound(const screen_state *screen,
+			  const unsigned long j);
+void boost_screen_record(screen_state *screen,
+			 const unsigned long j,
+			 const double UdX,
+			 const double Xnormsq);
+int sp_beta_init(const unsigned long size,
+		 sp_beta **beta);
+unsigned long sp_beta_slot(const sp_beta *beta,
+			   const unsigned long key);
+double sp_beta_get(const sp_beta *beta,
+		   const unsigned long key);
+int sp_beta_add(sp_beta *beta,
+		const unsigned long key,
+		const double val);
 int boost_step_dump_head(FILE *fp);
 int boost_step_dump(const boost *model,
 		    const unsigned int m,
@@ -70,19 +278,44 @@ int boost_init(const cmd_args *args,
 	       FILE *fp_out);
 
 void *l2_cmpUdX(void *args);
-int l2_update_U(double *U, 
+double l2_cmpUdX_col(const void *U,
+		     const unsigned long n,
+		     const unsigned long j,
+		     const void *feature,
+		     const hic *data,
+		     const canonical_kp *ckps);
+int l2_screen_seed(screen_state *screen,
+		   const l2_kernels *kern,
+		   const void *U,
+		   const unsigned long n,
+		   const unsigned long *idx,
+		   const unsigned long num,
+		   const void *feature,
+		   const hic *data,
+		   const canonical_kp *ckps,
+		   const double *Xnormsq);
+int l2_update_U(void *U, 
 		double *residual_square,
 		const unsigned int m,
 		const unsigned long n,
 		const unsigned long s,
-		const double **feature,
+		const void *feature,
 		const hic *data,
 		const canonical_kp *ckps,
 		const double gamma, 
 		const double v);
+int l2_shadow_check(const cmd_args *args,
+		    const unsigned int m,
+		    const unsigned long s,
+		    const double *UdX,
+		    const double *UdX_d,
+		    const double *Xnormsq_d,
+		    const unsigned long p);
 int l2_train(const cmd_args *args,
 	     const double **feature,
+	     const float **feature_f,
 	     const hic *data,
+	     const hic *val,
 	     const canonical_kp *ckps,
 	     const double v,
 	     boost **model,
@@ -93,35 +326,6 @@ int l2_train(const cmd_args *args,
  * Boosting common functions
  **/
 
-void *boost_cmpXnormsq(void *args){
-  /* unstack parameters */
-  const cmpUdX_args *params = (cmpUdX_args *)args;
-  const double **feature = params->feature;
-  const unsigned int *h_i = params->data->i;
-  const unsigned int *h_j = params->data->j;
-  const unsigned int *kmer1 = params->ckps->kmer1;
-  const unsigned int *kmer2 = params->ckps->kmer2;
-  const unsigned int *revcmp1 = params->ckps->revcmp1;
-  const unsigned int *revcmp2 = params->ckps->revcmp2;
-
-  /* compute ||X^{(j)}||^2 */
-  unsigned int i, j;
-  double sum, pf;
-  for(j = params->begin; j < params->end; j++){
-    sum = 0;
-    for(i = 0; i < params->n; i++){
-      /* pf : pairwise feature */
-      pf =  ((feature[h_i[i]][kmer1[j]] *
-	      feature[h_j[i]][kmer2[j]]) +
-	     (feature[h_i[i]][revcmp1[j]] *
-	      feature[h_j[i]][revcmp2[j]]));
-      sum += pf * pf;     
-    }
-    (params->Xnormsq)[j] = sum;
-  }
-  return NULL;
-}
-
 int boost_dump_beta(const boost *model, 
 	       const unsigned long p){
   unsigned long j;
@@ -137,11 +341,11 @@ int boost_dump_beta(const boost *model,
 int boost_pthread_prep(const int thread_num,
 		 const unsigned long n,
 		 const unsigned long p,		 
-		 const double **feature,
+		 const void *feature,
 		 const hic *data,
 		 const canonical_kp *ckps,
 		 const kmer *kmers,
-		 double *U,
+		 void *U,
 		 double *UdX,
 		 double *Xnormsq,
 		 cmpUdX_args **params,
@@ -161,6 +365,7 @@ int boost_pthread_prep(const int thread_num,
     (*params)[i].end =
       ((i == (thread_num - 1)) ? p : (p / thread_num) * (i + 1));
     (*params)[i].n = n;
+    (*params)[i].idx     = NULL;
     (*params)[i].feature = feature;
     (*params)[i].data    = data;
     (*params)[i].ckps    = ckps;
@@ -168,6 +373,203 @@ int boost_pthread_prep(const int thread_num,
     (*params)[i].U       = U;
     (*params)[i].UdX     = UdX;
     (*params)[i].Xnormsq = Xnormsq;
+    (*params)[i].batch   = 1;
+    (*params)[i].screen  = NULL;
+    (*params)[i].pruned  = 0;
+    (*params)[i].bits    = NULL;
+  }
+  return 0;
+}
+
+/**
+ * restrict the workers to the columns listed in idx[0, ..., num - 1]
+ * (idx == NULL restores the full range [0, num))
+ */
+int boost_pthread_set_idx(const int thread_num,
+			  const unsigned long *idx,
+			  const unsigned long num,
+			  cmpUdX_args *params){
+  int i = 0;
+  for(i = 0; i < thread_num; i++){
+    params[i].idx = idx;
+    params[i].begin = ((i == 0) ? 0 : params[i - 1].end);
+    params[i].end =
+      ((i == (thread_num - 1)) ? num : (num / thread_num) * (i + 1));
+  }
+  return 0;
+}
+
+/* run params->worker and record its wall time in params->busy
+ * (and its hardware counters in params->perf with --perf, its span in
+ * the timeline with --trace) */
+void *boost_pthread_timed(void *args){
+  cmpUdX_args *params = (cmpUdX_args *)args;
+  perf_group perf;
+  perf_counts perf_start;
+  double t0;
+  if(perf_enabled()){
+    perf_thread_begin(&perf, &perf_start);
+  }
+  trace_set_tid(params->thread_id + 1);
+  t0 = trace_now();
+  params->worker(args);
+  params->busy = trace_now() - t0;
+  trace_span("worker", -1, t0, t0 + params->busy);
+  if(perf_enabled()){
+    perf_thread_end(&perf, &perf_start, &params->perf);
+  }
+  return NULL;
+}
+
+/* busy[t] := wall time of worker t in the last boost_pthread_run() */
+int boost_pthread_busy(const int thread_num,
+		       const cmpUdX_args *params,
+		       double *busy){
+  int t = 0;
+  for(t = 0; t < thread_num; t++){
+    busy[t] = params[t].busy;
+  }
+  return 0;
+}
+
+/**
+ * run worker on params[0, ..., thread_num - 1] and wait for the threads
+ *  (attrs : per-thread attributes, e.g. cpu affinity, or NULL)
+ */
+int boost_pthread_run(const int thread_num,
+		      void *(*worker)(void *),
+		      cmpUdX_args *params,
+		      pthread_t *threads,
+		      const pthread_attr_t *attrs){
+  int t = 0;
+  for(t = 0; t < thread_num; t++){
+    params[t].worker = worker;
+    pthread_create(&threads[t], (attrs == NULL) ? NULL : &attrs[t],
+		   boost_pthread_timed, (void*)&params[t]);
+  }
+  for(t = 0; t < thread_num; t++){
+    pthread_join(threads[t], NULL);
+    metrics_perf_add(&params[t].perf);
+  }
+  return 0;
+}
+
+/**
+ * size (bytes) of the level-`level' data (or unified) cache of cpu0,
+ * read from sysfs
+ */
+unsigned long boost_cache_size(const int level,
+			       const unsigned long fallback){
+  char file_name[F_NAME_LEN], buf[BUF_SIZE];
+  unsigned long size = 0;
+  int index, lv;
+  char *end;
+  FILE *fp;
+  for(index = 0; index < 8 && size == 0; index++){
+    sprintf(file_name, "/sys/devices/system/cpu/cpu0/cache/index%d/level",
+	    index);
+    if((fp = fopen(file_name, "r")) == NULL){
+      break;
+    }
+    lv = (fgets(buf, sizeof(buf), fp) != NULL) ? atoi(buf) : 0;
+    fclose(fp);
+
+    sprintf(file_name, "/sys/devices/system/cpu/cpu0/cache/index%d/type",
+	    index);
+    if(lv != level || (fp = fopen(file_name, "r")) == NULL){
+      continue;
+    }
+    if(fgets(buf, sizeof(buf), fp) == NULL ||
+       strncmp(buf, "Instruction", 11) == 0){
+      fclose(fp);
+      continue;
+    }
+    fclose(fp);
+
+    sprintf(file_name, "/sys/devices/system/cpu/cpu0/cache/index%d/size",
+	    index);
+    if((fp = fopen(file_name, "r")) == NULL){
+      continue;
+    }
+    if(fgets(buf, sizeof(buf), fp) != NULL){
+      size = strtoul(buf, &end, 10);
+      if(*end == 'K'){
+	size <<= 10;
+      }else if(*end == 'M'){
+	size <<= 20;
+      }
+    }
+    fclose(fp);
+  }
+  return (size == 0) ? fallback : size;
+}
+
+/**
+ * set the cache blocking of l2_cmpUdX() and allocate the partial sums
+ *  tile_rows (auto) : the row block (U[], h_i[], h_j[] and its share of
+ *                     the feature rows) fills half of L2
+ *  tile_cols (auto) : the partial sums of the column block fill a quarter
+ *                     of L1d
+ */
+int boost_tile_prep(const cmd_args *args,
+		    const int thread_num,
+		    const unsigned long n,
+		    const size_t real_size,
+		    const hic *data,
+		    cmpUdX_args *params){
+  unsigned long tile_rows = 0, tile_cols = 0;
+  int t;
+
+  if(args->tile == 0){
+    return 0;
+  }
+
+  tile_rows = (unsigned long)args->tile_rows;
+  if(tile_rows == 0){
+    /* feature bytes per row : every row brings in (part of) two bins */
+    const size_t row_size = ((size_t)1 << (2 * args->k)) * real_size;
+    const unsigned long bin_num = hic_bin_num(data);
+    const size_t row_bytes = real_size + 2 * sizeof(unsigned int) +
+      (2 * row_size * bin_num + n - 1) / n;
+    tile_rows = boost_cache_size(2, 256 << 10) / 2 / row_bytes;
+    if(tile_rows < TILE_ROWS_MIN){
+      tile_rows = TILE_ROWS_MIN;
+    }
+  }
+  if(tile_rows >= n){
+    tile_rows = 0;
+  }
+
+  tile_cols = (unsigned long)args->tile_cols;
+  if(tile_cols == 0){
+    tile_cols = boost_cache_size(1, 32 << 10) / 4 /
+      (2 * sizeof(double) + sizeof(unsigned long));
+  }
+
+  for(t = 0; t < thread_num; t++){
+    params[t].tile_rows = tile_rows;
+    params[t].tile_cols = tile_cols;
+    params[t].tile_col = calloc_errchk(tile_cols, sizeof(unsigned long),
+				       "calloc tile_col[]");
+    params[t].tile_sum = calloc_errchk(tile_cols, sizeof(double),
+				       "calloc tile_sum[]");
+    params[t].tile_c = calloc_errchk(tile_cols, sizeof(double),
+				     "calloc tile_c[]");
+  }
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "UdX tiles: %ld rows x %ld columns\n",
+	  (tile_rows == 0) ? n : tile_rows, tile_cols);
+  return 0;
+}
+
+int boost_tile_free(const int thread_num,
+		    cmpUdX_args *params){
+  int t;
+  for(t = 0; t < thread_num; t++){
+    free(params[t].tile_col);
+    free(params[t].tile_sum);
+    free(params[t].tile_c);
   }
   return 0;
 }
@@ -187,6 +589,192 @@ unsigned long boost_select_axis(const double *UdX,
   return argmax;
 }
 
+/* score of an axis (0 for an empty column) */
+double boost_score(const double UdX,
+		   const double Xnormsq){
+  return (Xnormsq > 0) ? (UdX * UdX / Xnormsq) : 0;
+}
+
+/* boost_select_axis() over the columns idx[0, ..., num - 1] */
+unsigned long boost_select_axis_idx(const double *UdX, 
+				    const double *Xnormsq,
+				    const unsigned long *idx,
+				    const unsigned long num){
+  unsigned long argmax = idx[0];
+  double max = boost_score(UdX[argmax], Xnormsq[argmax]);
+  unsigned long t;
+  for(t = 1; t < num; t++){
+    const unsigned long j = idx[t];
+    const double score = boost_score(UdX[j], Xnormsq[j]);
+    if(max < score || (max == score && j < argmax)){
+      argmax = j;
+      max = score;
+    }
+  }
+  return argmax;
+}
+
+/**
+ * Lazy axis search
+ *  After a full pass over all p columns, only the top cand_num columns
+ *  (and the columns sharing a k-mer with the latest axis) are evaluated
+ *  until the next refresh.
+ **/
+
+typedef struct _cand_entry{
+  double score;
+  unsigned long j;
+} cand_entry;
+
+int cand_entry_cmp(const void *a, const void *b){
+  const cand_entry *x = (const cand_entry *)a;
+  const cand_entry *y = (const cand_entry *)b;
+  if(x->score > y->score){
+    return -1;
+  }else if(x->score < y->score){
+    return 1;
+  }else{
+    return (x->j < y->j) ? -1 : ((x->j > y->j) ? 1 : 0);
+  }
+}
+
+int cand_idx_cmp(const void *a, const void *b){
+  const unsigned long x = *(const unsigned long *)a;
+  const unsigned long y = *(const unsigned long *)b;
+  return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/**
+ * keep the top cand_num columns (sorted by column index) in cand[] and
+ * set *bound to the smallest score among them
+ */
+int boost_cand_select(const double *UdX, 
+		      const double *Xnormsq,
+		      const unsigned long p,
+		      const unsigned long cand_num,
+		      unsigned long *cand,
+		      double *bound){
+  cand_entry *entries = calloc_errchk(p, sizeof(cand_entry),
+				      "calloc cand_entry[]");
+  unsigned long j;
+  for(j = 0; j < p; j++){
+    entries[j].score = boost_score(UdX[j], Xnormsq[j]);
+    entries[j].j = j;
+  }
+  qsort(entries, p, sizeof(cand_entry), cand_entry_cmp);
+  for(j = 0; j < cand_num; j++){
+    cand[j] = entries[j].j;
+  }
+  *bound = entries[cand_num - 1].score;
+  qsort(cand, cand_num, sizeof(unsigned long), cand_idx_cmp);
+  free(entries);
+  return 0;
+}
+
+/**
+ * build the list of columns evaluated in a lazy step:
+ *  the candidate set plus every column sharing a k-mer with axis s
+ *  (those are the columns whose U.X^{(j)} moved the most when U was
+ *  updated along X^{(s)}). stamp[] marks columns already listed in
+ *  step m. returns the number of columns written to eval[].
+ */
+unsigned long boost_cand_expand(const canonical_kp *ckps,
+				const unsigned long p,
+				const unsigned long s,
+				const unsigned long *cand,
+				const unsigned long cand_num,
+				unsigned int *stamp,
+				const unsigned int m,
+				unsigned long *eval){
+  const unsigned int *kmer1 = ckps->kmer1;
+  const unsigned int *kmer2 = ckps->kmer2;
+  const unsigned int *revcmp1 = ckps->revcmp1;
+  const unsigned int *revcmp2 = ckps->revcmp2;
+  const unsigned int hit[4] = {kmer1[s], kmer2[s], revcmp1[s], revcmp2[s]};
+  unsigned long j, t, num = 0;
+  int h;
+
+  for(t = 0; t < cand_num; t++){
+    stamp[cand[t]] = m;
+    eval[num++] = cand[t];
+  }
+  for(j = 0; j < p; j++){
+    if(stamp[j] != m){
+      for(h = 0; h < 4; h++){
+	if(kmer1[j] == hit[h] || kmer2[j] == hit[h] ||
+	   revcmp1[j] == hit[h] || revcmp2[j] == hit[h]){
+	  stamp[j] = m;
+	  eval[num++] = j;
+	  break;
+	}
+      }
+    }
+  }
+  return num;
+}
+
+/**
+ * Safe screening of axes
+ **/
+
+/**
+ * relative margin on the screening bound for n rows : U[] and the inner
+ * products of single precision kernels carry rounding errors of up to
+ * n FLT_EPSILON (relative), far above SCREEN_TOL
+ */
+static inline double boost_screen_tol(const cmd_args *args,
+				      const unsigned long n){
+  return (args->precision == SINGLE) ? SCREEN_TOL + FLT_EPSILON * n :
+    SCREEN_TOL;
+}
+
+int boost_screen_init(const unsigned long p,
+		      const double tol,
+		      screen_state **screen){
+  unsigned long j;
+  *screen = calloc_errchk(1, sizeof(screen_state), "calloc screen_state");
+  (*screen)->UdX_ref   = calloc_errchk(p, sizeof(double), "calloc UdX_ref[]");
+  (*screen)->drift_ref = calloc_errchk(p, sizeof(double), "calloc drift_ref[]");
+  for(j = 0; j < p; j++){
+    (*screen)->UdX_ref[j] = -1;
+  }
+  (*screen)->drift = 0;
+  (*screen)->Unorm = 0;
+  (*screen)->tol = tol;
+  atomic_init(&((*screen)->best), 0.0);
+  return 0;
+}
+
+/* upper bound of (U.X^{(j)})^2 / ||X^{(j)}||^2 */
+double boost_screen_bound(const screen_state *screen,
+			  const unsigned long j){
+  double b = screen->Unorm;
+  if((screen->UdX_ref)[j] >= 0){
+    const double b_ref =
+      (screen->UdX_ref)[j] + (screen->drift - (screen->drift_ref)[j]);
+    if(b_ref < b){
+      b = b_ref;
+    }
+  }
+  return b * b;
+}
+
+/* record an exact evaluation of column j and raise the shared best score */
+void boost_screen_record(screen_state *screen,
+			 const unsigned long j,
+			 const double UdX,
+			 const double Xnormsq){
+  const double score = boost_score(UdX, Xnormsq);
+  double best = atomic_load_explicit(&(screen->best), memory_order_relaxed);
+  (screen->UdX_ref)[j] = (Xnormsq > 0) ? fabs(UdX) / sqrt(Xnormsq) : 0;
+  (screen->drift_ref)[j] = screen->drift;
+  while(best < score &&
+	!atomic_compare_exchange_weak_explicit(&(screen->best), &best, score,
+					       memory_order_relaxed,
+					       memory_order_relaxed)){
+  }
+}
+
 int boost_step_dump_head(FILE *fp){
   fprintf(fp, "iter \t axis \t gamma \t residuals \t step t \t total t\n");
   return 0;
@@ -205,6 +793,69 @@ int boost_step_dump(const boost *model,
   return 0;
 }
 
+int sp_beta_init(const unsigned long size,
+		 sp_beta **beta){
+  unsigned long slot;
+  *beta = calloc_errchk(1, sizeof(sp_beta), "calloc sp_beta");
+  (*beta)->size = size;
+  (*beta)->key = calloc_errchk(size, sizeof(unsigned long),
+			       "calloc sp_beta -> key");
+  (*beta)->val = calloc_errchk(size, sizeof(double),
+			       "calloc sp_beta -> val");
+  for(slot = 0; slot < size; slot++){
+    ((*beta)->key)[slot] = SP_BETA_EMPTY;
+  }
+  return 0;
+}
+
+/* slot of key (or the empty slot where it would be inserted) */
+unsigned long sp_beta_slot(const sp_beta *beta,
+			   const unsigned long key){
+  unsigned long slot = (key * 0x9E3779B97F4A7C15UL) & (beta->size - 1);
+  while((beta->key)[slot] != SP_BETA_EMPTY && (beta->key)[slot] != key){
+    slot = (slot + 1) & (beta->size - 1);
+  }
+  return slot;
+}
+
+double sp_beta_get(const sp_beta *beta,
+		   const unsigned long key){
+  const unsigned long slot = sp_beta_slot(beta, key);
+  return ((beta->key)[slot] == key) ? (beta->val)[slot] : 0;
+}
+
+/* beta[key] += val */
+int sp_beta_add(sp_beta *beta,
+		const unsigned long key,
+		const double val){
+  unsigned long slot;
+  if(2 * (beta->num + 1) > beta->size){
+    /* rehash into a table twice as large */
+    sp_beta *tmp;
+    sp_beta_init(2 * beta->size, &tmp);
+    for(slot = 0; slot < beta->size; slot++){
+      if((beta->key)[slot] != SP_BETA_EMPTY){
+	const unsigned long s = sp_beta_slot(tmp, (beta->key)[slot]);
+	(tmp->key)[s] = (beta->key)[slot];
+	(tmp->val)[s] = (beta->val)[slot];
+      }
+    }
+    free(beta->key);
+    free(beta->val);
+    beta->size = tmp->size;
+    beta->key = tmp->key;
+    beta->val = tmp->val;
+    free(tmp);
+  }
+  slot = sp_beta_slot(beta, key);
+  if((beta->key)[slot] == SP_BETA_EMPTY){
+    (beta->key)[slot] = key;
+    beta->num++;
+  }
+  (beta->val)[slot] += val;
+  return 0;
+}
+
 int boost_init(const cmd_args *args,
 	       const canonical_kp *ckps,
 	       const kmer *kmers,
@@ -212,11 +863,13 @@ int boost_init(const cmd_args *args,
 	       const char *file,
 	       boost **model,
 	       FILE *fp_out){  
-  unsigned long p;
+  unsigned long p = 0;
   if(ckps != NULL){
     p = ckps->num;
   }else if(kmers != NULL){
     p = kmers->num;
+  }else if(args->sparse != 0){
+    /* beta is kept in a sparse map */
   }else{
     fprintf(stderr, "%s [ERROR] ", args->prog_name);
     fprintf(stderr, "ckps and kmers are NULL\n");
@@ -228,8 +881,12 @@ int boost_init(const cmd_args *args,
     *model = calloc_errchk(1, sizeof(boost), "calloc boost");
     (*model)->res_sq = calloc_errchk(iternum + 1, sizeof(double),
 				     "calloc boost -> res_sq");
-    (*model)->beta   = calloc_errchk(p, sizeof(double),
+    if(p > 0){
+      (*model)->beta = calloc_errchk(p, sizeof(double),
 				     "calloc boost -> beta");
+    }else{
+      sp_beta_init(SP_BETA_INIT_SIZE, &((*model)->beta_sp));
+    }
     (*model)->iternum = iternum;
     (*model)->nextiter = 1;
   }
@@ -287,7 +944,11 @@ int boost_init(const cmd_args *args,
 	  exit(EXIT_FAILURE);
 	}
 	
-	(*model)->beta[axis] += strtod(gamma_str, NULL);
+	if((*model)->beta_sp != NULL){
+	  sp_beta_add((*model)->beta_sp, axis, strtod(gamma_str, NULL));
+	}else{
+	  (*model)->beta[axis] += strtod(gamma_str, NULL);
+	}
 	(*model)->res_sq[m] = strtod(residuals_str, NULL);      
 	
 	boost_step_dump(*model, m, axis, 
@@ -316,67 +977,133 @@ int boost_init(const cmd_args *args,
  * L2 Boosting 
  **/
 
-void *l2_cmpUdX(void *args){
-  /* unstack parameters */
-  const cmpUdX_args *params = (cmpUdX_args *)args;
-  const double **feature = params->feature;
-  const unsigned int *h_i = params->data->i;
-  const unsigned int *h_j = params->data->j;
-  const unsigned int *kmer1 = params->ckps->kmer1;
-  const unsigned int *kmer2 = params->ckps->kmer2;
-  const unsigned int *revcmp1 = params->ckps->revcmp1;
-  const unsigned int *revcmp2 = params->ckps->revcmp2;
+/* double precision kernels: boost_cmpXnormsq(), l2_cmpUdX(), ... 
+ * and their specializations on k = 3, ..., 6: *_k3(), ... */
+#define L2_REAL double
+#define L2_KAHAN 0
+#define L2_K 0
+#define L2_FN(name) name
+#define L2_KERNELS l2_kernels_f64
+#include "l2kernel.h"
+#undef L2_K
+#undef L2_FN
+#undef L2_KERNELS
+#define L2_FN_K(name, k) name ## _k ## k
+#define L2_KERNELS_K(k) l2_kernels_f64_k ## k
+#include "l2kernel_k.h"
+#undef L2_FN_K
+#undef L2_KERNELS_K
+#undef L2_REAL
+#undef L2_KAHAN
 
-  /* compute the dot product between U and X^{(j)} */
-  unsigned int i, j;
-  double sum;
-  for(j = params->begin; j < params->end; j++){
-    sum = 0;
-    for(i = 0; i < params->n; i++){
-      sum += (params->U)[i] * ((feature[h_i[i]][kmer1[j]] *
-				feature[h_j[i]][kmer2[j]]) +
-			       (feature[h_i[i]][revcmp1[j]] *
-				feature[h_j[i]][revcmp2[j]]));
+/* single precision kernels with compensated accumulation: *_f32(),
+ * *_f32_k3(), ... */
+#define L2_REAL float
+#define L2_KAHAN 1
+#define L2_K 0
+#define L2_FN(name) name ## _f32
+#define L2_KERNELS l2_kernels_f32
+#include "l2kernel.h"
+#undef L2_K
+#undef L2_FN
+#undef L2_KERNELS
+#define L2_FN_K(name, k) name ## _f32_k ## k
+#define L2_KERNELS_K(k) l2_kernels_f32_k ## k
+#include "l2kernel_k.h"
+#undef L2_FN_K
+#undef L2_KERNELS_K
+#undef L2_REAL
+#undef L2_KAHAN
+
+/**
+ * kernels of the given precision, specialized on k when available
+ */
+const l2_kernels *l2_kernels_select(const precision prec,
+				    const int k){
+  static const l2_kernels *f64[] = {
+    &l2_kernels_f64_k3, &l2_kernels_f64_k4,
+    &l2_kernels_f64_k5, &l2_kernels_f64_k6
+  };
+  static const l2_kernels *f32[] = {
+    &l2_kernels_f32_k3, &l2_kernels_f32_k4,
+    &l2_kernels_f32_k5, &l2_kernels_f32_k6
+  };
+  if(k < L2_K_MIN || k > L2_K_MAX){
+    return (prec == SINGLE) ? &l2_kernels_f32 : &l2_kernels_f64;
+  }
+  return (prec == SINGLE) ? f32[k - L2_K_MIN] : f64[k - L2_K_MIN];
+}
+
+/**
+ * prepare a screened pass over idx[0, ..., num - 1] (idx == NULL : all):
+ *  set ||U|| and seed the shared best score with the column that has
+ *  the largest lower bound (UdX_ref[j] - (drift - drift_ref[j]))^2
+ */
+int l2_screen_seed(screen_state *screen,
+		   const l2_kernels *kern,
+		   const void *U,
+		   const unsigned long n,
+		   const unsigned long *idx,
+		   const unsigned long num,
+		   const void *feature,
+		   const hic *data,
+		   const canonical_kp *ckps,
+		   const double *Xnormsq){
+  unsigned long t, j, seed = (idx == NULL) ? 0 : idx[0];
+  double lb, seed_lb = -1;
+
+  screen->Unorm = sqrt(kern->Unormsq(U, n));
+
+  for(t = 0; t < num; t++){
+    j = (idx == NULL) ? t : idx[t];
+    if((screen->UdX_ref)[j] >= 0){
+      lb = (screen->UdX_ref)[j] - (screen->drift - (screen->drift_ref)[j]);
+      if(lb > seed_lb){
+	seed_lb = lb;
+	seed = j;
+      }
     }
-    (params->UdX)[j] = sum;
   }
-  return NULL;
+
+  atomic_store_explicit(&(screen->best), 0.0, memory_order_relaxed);
+  boost_screen_record(screen, seed,
+		      kern->cmpUdX_col(U, n, seed, feature, data, ckps),
+		      Xnormsq[seed]);
+  return 0;
 }
 
-int l2_update_U(double *U, 
-		double *residual_square,
-		const unsigned int m,
-		const unsigned long n,
-		const unsigned long s,
-		const double **feature,
-		const hic *data,
-		const canonical_kp *ckps,
-		const double gamma, 
-		const double v){
-  const unsigned int *h_i = data->i;
-  const unsigned int *h_j = data->j;
-  const unsigned int *kmer1 = ckps->kmer1;
-  const unsigned int *kmer2 = ckps->kmer2;
-  const unsigned int *revcmp1 = ckps->revcmp1;
-  const unsigned int *revcmp2 = ckps->revcmp2;
-  unsigned long i;
-  double sum = 0, pf = 0;
-  for(i = 0; i < n; i++){
-    /* pf : pairwise feature */
-    pf =  ((feature[h_i[i]][kmer1[s]] *
-	    feature[h_j[i]][kmer2[s]]) +
-	   (feature[h_i[i]][revcmp1[s]] *
-	    feature[h_j[i]][revcmp2[s]]));
-    U[i] -= v * gamma * pf;
-    sum += 1.0 * U[i] * U[i] / n;
-  }
-  residual_square[m] = sum;
+/**
+ * report how far the axis selected in single precision is from the
+ * double precision shadow run (same model, U[] kept in double)
+ */
+int l2_shadow_check(const cmd_args *args,
+		    const unsigned int m,
+		    const unsigned long s,
+		    const double *UdX,
+		    const double *UdX_d,
+		    const double *Xnormsq_d,
+		    const unsigned long p){
+  const unsigned long s_d = boost_select_axis(UdX_d, Xnormsq_d, p);
+  const double score = boost_score(UdX_d[s], Xnormsq_d[s]);
+  unsigned long j, rank = 0;
+  for(j = 0; j < p; j++){
+    if(boost_score(UdX_d[j], Xnormsq_d[j]) > score){
+      rank++;
+    }
+  }
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "shadow: iter %d axis f32 %ld f64 %ld (rank %ld) score ratio %e UdX rel. err. %e\n",
+	  m, s, s_d, rank,
+	  score / boost_score(UdX_d[s_d], Xnormsq_d[s_d]),
+	  (UdX_d[s] != 0) ? fabs(UdX[s] - UdX_d[s]) / fabs(UdX_d[s]) : 0);
   return 0;
 }
 			  
 int l2_train(const cmd_args *args,
 		  const double **feature,
+		  const float **feature_f,
 		  const hic *data,
+		  const hic *val,
 		  const canonical_kp *ckps,
 		  const double v,
 		  boost **model,
@@ -384,28 +1111,61 @@ int l2_train(const cmd_args *args,
   const unsigned long n = data->nrow;
   const unsigned long p = ckps->num;
   const int thread_num = args->thread_num;
+  /* kernels and feature table of the working precision */
+  const l2_kernels *kern = l2_kernels_select(args->precision, args->k);
+  const void *feat =
+    (args->precision == SINGLE) ? (const void *)feature_f : (const void *)feature;
+  /* double precision shadow run (single precision only) */
+  const int shadow = (args->precision == SINGLE && feature != NULL) ?
+    args->shadow : 0;
   unsigned long s = 0;
   double gamma = 0;
-  double *U, *UdX, *Xnormsq;
+  void *U;
+  double *UdX, *Xnormsq;
+  double *U_d = NULL, *UdX_d = NULL, *Xnormsq_d = NULL, *res_sq_d = NULL;
+  /* validation rows (val != NULL) : residuals, errors, the model and the
+   * end of the output file at the best iteration */
+  void *U_val = NULL;
+  double *val_err = NULL, *beta_best = NULL;
+  unsigned int val_best = 0, val_last = 0;
+  long pos_best = 0;
   unsigned int m = 0;
-  struct timeval time_start, time_prev, time;
+  double time_start, time_prev, time;
+  /* metrics : bytes touched per (row, column) of the column kernels
+   * (2 bin indices, 4 feature values and U[i] for UdX), per row of the
+   * update (2 bin indices, 4 feature values, U[i] read and written) */
+  const double bytes_X = 2 * sizeof(unsigned int) + 4 * kern->real_size;
+  const double bytes_UdX = bytes_X + kern->real_size;
+  const double bytes_U = bytes_X + 2 * kern->real_size;
+  metrics_phase ph;
+  double *busy = calloc_errchk(thread_num, sizeof(double), "calloc busy[]");
 
   /* allocate memory */
   {
-    U       = calloc_errchk(n, sizeof(double), "calloc U[]");
+    U       = calloc_errchk(n, kern->real_size, "calloc U[]");
     UdX     = calloc_errchk(p, sizeof(double), "calloc UdX[]");
     Xnormsq = calloc_errchk(p, sizeof(double), "calloc Xnormsq[]");
+    if(shadow > 0){
+      U_d       = calloc_errchk(n, sizeof(double), "calloc U_d[]");
+      UdX_d     = calloc_errchk(p, sizeof(double), "calloc UdX_d[]");
+      Xnormsq_d = calloc_errchk(p, sizeof(double), "calloc Xnormsq_d[]");
+      res_sq_d  = calloc_errchk((*model)->iternum + 1, sizeof(double),
+				"calloc res_sq_d[]");
+    }
+    if(val != NULL){
+      U_val     = calloc_errchk(val->nrow, kern->real_size, "calloc U_val[]");
+      val_err   = calloc_errchk((*model)->iternum + 1, sizeof(double),
+				"calloc val_err[]");
+      beta_best = calloc_errchk(p, sizeof(double), "calloc beta_best[]");
+    }
   }
 
   /* initialize residuals U[] := Y[] and 
    * compute \sum_i U[i]^2                */
   {
-    const double *Y = data->mij;
-    unsigned long i;
-    ((*model)->res_sq)[0] = 0;
-    for(i = 0; i < n; i++){
-      U[i] = Y[i];
-      ((*model)->res_sq)[0] += U[i] * U[i] / n;
+    ((*model)->res_sq)[0] = kern->set_U(U, n, data->mij);
+    if(shadow > 0){
+      res_sq_d[0] = l2_set_U(U_d, n, data->mij);
     }
   }
 
@@ -413,59 +1173,85 @@ int l2_train(const cmd_args *args,
   if(((*model)->nextiter) > 1){
     fprintf(stderr, "%s [INFO] ", args->prog_name);
     fprintf(stderr, "start computation of residuals\n");
-    const unsigned int *h_i = data->i;
-    const unsigned int *h_j = data->j;
-    const unsigned int *kmer1 = ckps->kmer1;
-    const unsigned int *kmer2 = ckps->kmer2;
-    const unsigned int *revcmp1 = ckps->revcmp1;
-    const unsigned int *revcmp2 = ckps->revcmp2;
-    unsigned long i, j;
-    double pf;
-    /* pf : pairwise feature */
-    for(j = 0; j < p; j++){
-      if(((*model)->beta[j]) != 0){
-	for(i = 0; i < n; i++){
-	  pf =  ((feature[h_i[i]][kmer1[j]] *
-		  feature[h_j[i]][kmer2[j]]) +
-		 (feature[h_i[i]][revcmp1[j]] *
-		  feature[h_j[i]][revcmp2[j]]));
-	  U[i] -= ((*model)->beta[j]) * pf;
-	}
-      }
+    kern->apply_beta(U, n, p, (*model)->beta, feat, data, ckps);
+    if(shadow > 0){
+      l2_apply_beta(U_d, n, p, (*model)->beta, feature, data, ckps);
     }
   }
 
+  /* validation residuals and error of the initial model */
+  if(val != NULL){
+    kern->set_U(U_val, val->nrow, val->mij);
+    if(((*model)->nextiter) > 1){
+      kern->apply_beta(U_val, val->nrow, p, (*model)->beta, feat, val, ckps);
+    }
+    val_best = (*model)->nextiter - 1;
+    val_last = val_best;
+    val_err[val_best] = kern->Unormsq(U_val, val->nrow) / val->nrow;
+    memcpy(beta_best, (*model)->beta, p * sizeof(double));
+    fflush(fp);
+    pos_best = ftell(fp);
+  }
+
   if(thread_num >= 1){
     int t = 0;
-    cmpUdX_args *params;
-    pthread_t *threads;
+    cmpUdX_args *params, *params_d = NULL;
+    pthread_t *threads, *threads_d = NULL;
+    /* NUMA placement */
+    numa_topo *topo = NULL;
+    numa_replica *replica = NULL;
+    pthread_attr_t *attrs = NULL;
+    int *worker_node = NULL;
 
     fprintf(stderr, "%s [INFO] ", args->prog_name);
-    fprintf(stderr, "start computation of Xnormsq with %d threads\n",
-	    thread_num);
+    fprintf(stderr, "start computation of Xnormsq with %d threads (%s precision, %s kernels)\n",
+	    thread_num, (args->precision == SINGLE) ? "single" : "double",
+	    (args->k >= L2_K_MIN && args->k <= L2_K_MAX) ?
+	    "k-specialized" : "generic");
 
     /* compute Xnormsq ||X^{(j)}||^2 */
     {
-      gettimeofday(&time_prev, NULL);
+      time_prev = trace_now();
+      metrics_begin(&ph);
 
       /* prepare for thread programming */
       boost_pthread_prep(thread_num, n, p, 
-			 feature, data, ckps, NULL,
+			 feat, data, ckps, NULL,
 			 U, UdX, Xnormsq, 
 			 &params, &threads);
+
+      if(args->numa != NUMA_OFF){
+	/* pin the workers and give them the data placed on their node */
+	numa_topo_probe(args, &topo);
+	numa_attr_prep(topo, thread_num, &attrs, &worker_node);
+	if(args->numa == NUMA_REPLICATE || args->numa == NUMA_INTERLEAVE){
+	  numa_replicate(args, topo, (const void **)feat, kern->real_size,
+			 data, &replica);
+	  for(t = 0; t < thread_num; t++){
+	    params[t].feature = replica[worker_node[t]].feature;
+	    params[t].data = &(replica[worker_node[t]].data);
+	  }
+	}
+      }
 		   
-      for(t = 0; t < thread_num; t++){
-	pthread_create(&threads[t], NULL, 
-		       boost_cmpXnormsq, (void*)&params[t]);		       
-      } 
-      for(t = 0; t < thread_num; t++){
-	pthread_join(threads[t], NULL);
+      boost_pthread_run(thread_num, kern->cmpXnormsq, params, threads, attrs);
+      boost_pthread_busy(thread_num, params, busy);
+      metrics_end(&ph, "Xnormsq", -1, bytes_X * n * p, busy, thread_num);
+      boost_tile_prep(args, thread_num, n, kern->real_size, data, params);
+
+      if(shadow > 0){
+	boost_pthread_prep(thread_num, n, p, 
+			   feature, data, ckps, NULL,
+			   U_d, UdX_d, Xnormsq_d, 
+			   &params_d, &threads_d);
+	boost_pthread_run(thread_num, boost_cmpXnormsq, params_d, threads_d,
+			  attrs);
       }
-      gettimeofday(&time, NULL);
+      time = trace_now();
     }
 
     fprintf(stderr, "%s [INFO] ", args->prog_name);
-    fprintf(stderr, "Xnormsq finished in %f sec.\n", diffSec(time_prev, time));
+    fprintf(stderr, "Xnormsq finished in %f sec.\n", (time - time_prev));
 
 #if 0
     {
@@ -477,63 +1263,244 @@ int l2_train(const cmd_args *args,
     }
 #endif
 
-    cpTimeval(time, &time_prev);
-    cpTimeval(time, &time_start);
+    time_prev = time;
+    time_start = time;
+
+    /* lazy axis search: candidate set */
+    const unsigned long cand_num =
+      ((unsigned long)args->cand_num < p) ? (unsigned long)args->cand_num : 0;
+    unsigned long *cand = NULL, *eval = NULL, eval_num = 0;
+    unsigned int *stamp = NULL, refreshed = 0;
+    double cand_bound = 0;
+    if(cand_num > 0){
+      cand  = calloc_errchk(cand_num, sizeof(unsigned long), "calloc cand[]");
+      eval  = calloc_errchk(p, sizeof(unsigned long), "calloc eval[]");
+      stamp = calloc_errchk(p, sizeof(unsigned int), "calloc stamp[]");
+      fprintf(stderr, "%s [INFO] ", args->prog_name);
+      fprintf(stderr, "lazy axis search: %ld candidates, full pass every %d iterations\n",
+	      cand_num, args->cand_refresh);
+    }
+
+    /* safe screening of axes */
+    screen_state *screen = NULL;
+    if(args->screen != 0){
+      boost_screen_init(p, boost_screen_tol(args, n), &screen);
+    }
     
     for(m = (*model)->nextiter; m <= (*model)->iternum; m++){
-      /* compute inner product $U \cdot X^{(j)}$ */
-      {
-	/* prepare for thread programming */
-	boost_pthread_prep(thread_num, n, p, 
-			   feature, data, ckps, NULL,
-			   U, UdX, Xnormsq, 
-			   &params, &threads);
-		   
+      int full = (cand_num == 0 || refreshed == 0 ||
+		  m - refreshed >= (unsigned int)args->cand_refresh);
+      unsigned long pruned = 0, evaluated = 0;
+      metrics_phase ph_iter;
+
+      metrics_begin(&ph_iter);
+
+      if(!full){
+	/* lazy step : evaluate the candidates only */
+	metrics_begin(&ph);
+	eval_num = boost_cand_expand(ckps, p, s, cand, cand_num,
+				     stamp, m, eval);
+	boost_pthread_set_idx(thread_num, eval, eval_num, params);
+	if(screen != NULL){
+	  l2_screen_seed(screen, kern, U, n, eval, eval_num,
+			 feat, data, ckps, Xnormsq);
+	}
 	for(t = 0; t < thread_num; t++){
-	  pthread_create(&threads[t], NULL, 
-			 l2_cmpUdX, (void*)&params[t]);		       
-	} 
+	  params[t].screen = screen;
+	}
+	boost_pthread_run(thread_num, kern->cmpUdX, params, threads, attrs);
 	for(t = 0; t < thread_num; t++){
-	  pthread_join(threads[t], NULL);
+	  pruned += params[t].pruned;
+	}
+	evaluated += eval_num;
+	boost_pthread_busy(thread_num, params, busy);
+	metrics_end(&ph, "UdX", m, bytes_UdX * n * eval_num, busy, thread_num);
+	metrics_begin(&ph);
+	s = boost_select_axis_idx((const double *)UdX, (const double *)Xnormsq,
+				  (const unsigned long *)eval, eval_num);
+	metrics_end(&ph, "select", m, 2 * sizeof(double) * eval_num, NULL, 0);
+	if(boost_score(UdX[s], Xnormsq[s]) < cand_bound){
+	  /* a column outside of the candidate set may win */
+	  full = 1;
 	}
       }
 
-      /* select axis */
-      s = boost_select_axis((const double *)UdX, (const double *)Xnormsq, p);			 
+      if(full){
+	/* compute inner product $U \cdot X^{(j)}$ 
+	 *  (the candidate set needs every score, hence no screening) */
+	screen_state *full_screen = (cand_num == 0) ? screen : NULL;
+	metrics_begin(&ph);
+	boost_pthread_set_idx(thread_num, NULL, p, params);
+	if(full_screen != NULL){
+	  l2_screen_seed(full_screen, kern, U, n, NULL, p,
+			 feat, data, ckps, Xnormsq);
+	}
+	for(t = 0; t < thread_num; t++){
+	  params[t].screen = full_screen;
+	}
+	boost_pthread_run(thread_num, kern->cmpUdX, params, threads, attrs);
+	for(t = 0; t < thread_num; t++){
+	  pruned += params[t].pruned;
+	}
+	evaluated += p;
+	boost_pthread_busy(thread_num, params, busy);
+	metrics_end(&ph, "UdX", m, bytes_UdX * n * p, busy, thread_num);
+
+	/* select axis */
+	metrics_begin(&ph);
+	s = boost_select_axis((const double *)UdX, (const double *)Xnormsq, p);
+
+	if(cand_num > 0){
+	  boost_cand_select((const double *)UdX, (const double *)Xnormsq, p,
+			    cand_num, cand, &cand_bound);
+	  refreshed = m;
+	}
+	metrics_end(&ph, "select", m, 2 * sizeof(double) * p, NULL, 0);
+      }
+
+      if(shadow > 0 && m % shadow == 0){
+	/* compare with a double precision pass over the shadow U_d[] */
+	boost_pthread_run(thread_num, l2_cmpUdX, params_d, threads_d, attrs);
+	l2_shadow_check(args, m, s, (const double *)UdX,
+			(const double *)UdX_d, (const double *)Xnormsq_d, p);
+      }
+
       gamma = UdX[s] / Xnormsq[s];
       
       ((*model)->beta)[s] += v * gamma;
 
       /* Update U[] and sum of residual square */
-      l2_update_U(U, (*model)->res_sq, 
-		  (const unsigned int)m, n, s, 
-		  feature, data, ckps,
-		  (const double)gamma, v);
+      metrics_begin(&ph);
+      kern->update_U(U, (*model)->res_sq, 
+		     (const unsigned int)m, n, s, 
+		     feat, data, ckps,
+		     (const double)gamma, v);
+      if(shadow > 0){
+	l2_update_U(U_d, res_sq_d,
+		    (const unsigned int)m, n, s, 
+		    feature, data, ckps,
+		    (const double)gamma, v);
+      }
+      metrics_end(&ph, "update", m, bytes_U * n, NULL, 0);
+
+      if(val != NULL){
+	/* O(n_val) : only the rows of the validation set move along X^{(s)} */
+	metrics_begin(&ph);
+	kern->update_U(U_val, val_err,
+		       (const unsigned int)m, val->nrow, s,
+		       feat, val, ckps,
+		       (const double)gamma, v);
+	metrics_end(&ph, "val_update", m, bytes_U * val->nrow, NULL, 0);
+      }
+
+      if(screen != NULL){
+	/* ||U_m - U_{m-1}|| = v |gamma| ||X^{(s)}|| */
+	screen->drift += v * fabs(gamma) * sqrt(Xnormsq[s]);
+	fprintf(stderr, "%s [INFO] ", args->prog_name);
+	fprintf(stderr, "screening: %ld / %ld columns pruned (%.1f%%)\n",
+		pruned, evaluated, 100.0 * pruned / evaluated);
+      }
       
-      gettimeofday(&time, NULL);
+      time = trace_now();
       boost_step_dump(*model,
 			(const unsigned int)m, 
 			(const unsigned long)s,
 			v * (const double)gamma,
-			(const double)diffSec(time_prev, time),
-			(const double)diffSec(time_start, time),
+			(const double)(time - time_prev),
+			(const double)(time - time_start),
 			fp);
       fprintf(stderr, "%s [INFO] \t ", args->prog_name);
       boost_step_dump(*model,
 			(const unsigned int)m, 
 			(const unsigned long)s,
 			v * (const double)gamma,
-			(const double)diffSec(time_prev, time),
-			(const double)diffSec(time_start, time),
+			(const double)(time - time_prev),
+			(const double)(time - time_start),
 			stderr);
-      cpTimeval(time, &time_prev);
+      time_prev = time;
+      metrics_end(&ph_iter, "iteration", m, 0, NULL, 0);
+
+      if(val != NULL){
+	/* early stopping : an improvement is a relative decrease of tol */
+	val_last = m;
+	if(val_err[m] < val_err[val_best] * (1 - args->tol)){
+	  val_best = m;
+	  memcpy(beta_best, (*model)->beta, p * sizeof(double));
+	  fflush(fp);
+	  pos_best = ftell(fp);
+	}
+	fprintf(stderr, "%s [INFO] ", args->prog_name);
+	fprintf(stderr, "validation: %d\t%e (best %e at iteration %d)\n",
+		m, val_err[m], val_err[val_best], val_best);
+	if(args->patience > 0 &&
+	   m - val_best >= (unsigned int)args->patience){
+	  fprintf(stderr, "%s [INFO] ", args->prog_name);
+	  fprintf(stderr, "validation: no improvement in %d iterations, stop at iteration %d\n",
+		  args->patience, m);
+	  break;
+	}
+      }
     }
 
+    if(val != NULL && val_best < val_last){
+      /* truncate the model and the output file to the best iteration */
+      fprintf(stderr, "%s [INFO] ", args->prog_name);
+      fprintf(stderr, "validation: model truncated to iteration %d (validation mse %e)\n",
+	      val_best, val_err[val_best]);
+      memcpy((*model)->beta, beta_best, p * sizeof(double));
+      (*model)->nextiter = val_best + 1;
+      fflush(fp);
+      if(ftruncate(fileno(fp), pos_best) != 0){
+	fprintf(stderr, "error: ftruncate\n%s\n", strerror(errno));
+	exit(EXIT_FAILURE);
+      }
+      fseek(fp, pos_best, SEEK_SET);
+    }
+
+    if(cand_num > 0){
+      free(cand);
+      free(eval);
+      free(stamp);
+    }
+    if(screen != NULL){
+      free(screen->UdX_ref);
+      free(screen->drift_ref);
+      free(screen);
+    }
+    if(shadow > 0){
+      free(params_d);
+      free(threads_d);
+      free(U_d);
+      free(UdX_d);
+      free(Xnormsq_d);
+      free(res_sq_d);
+    }
+    if(topo != NULL){
+      if(replica != NULL){
+	numa_replica_free(args, topo, replica);
+      }
+      for(t = 0; t < thread_num; t++){
+	pthread_attr_destroy(&attrs[t]);
+      }
+      free(attrs);
+      free(worker_node);
+      numa_topo_free(topo);
+    }
+    boost_tile_free(thread_num, params);
+    free(params);
+    free(threads);
+
   }
 
   {
     boost_dump_beta((const boost *)*model, p);
   }
+  if(val != NULL){
+    free(U_val);
+    free(val_err);
+    free(beta_best);
+  }
+  free(busy);
   return 0;
 }
 
@@ -545,7 +1512,7 @@ int l2_train(const cmd_args *args,
 void *ada_cmpUdX(void *args){
   /* unstack parameters */
   const cmpUdX_args *params = (cmpUdX_args *)args;
-  const double **feature = params->feature;
+  const double **feature = (const double **)params->feature;
   const unsigned int *h_i = params->data->i;
   const unsigned int *h_j = params->data->j;
   const double *Y = params->data->mij;
@@ -599,6 +1566,119 @@ void *ada_cmpUdX(void *args){
   return NULL;
 }
 
+/* sign agreement of x with y (see ada_bits) */
+static inline int ada_agree(const double x,
+			    const double y){
+  return ((x * y) > 0) || ((x == 0) && (y >= 0));
+}
+
+/* F[] and F_num[] of the columns of params */
+void *ada_bits_build(void *args){
+  cmpUdX_args *params = (cmpUdX_args *)args;
+  ada_bits *bits = params->bits;
+  const double **feature = (const double **)params->feature;
+  const unsigned int *h_i = params->data->i;
+  const unsigned int *h_j = params->data->j;
+  const double *Y = params->data->mij;
+  const unsigned int *kmer = params->kmers->kmer1;
+  unsigned long i, j;
+  for(j = params->begin; j < params->end; j++){
+    uint64_t *F = bits->F + j * bits->words;
+    unsigned long num = 0;
+    memset(F, 0, bits->words * sizeof(uint64_t));
+    for(i = 0; i < params->n; i++){
+      if(ada_agree(feature[h_i[i]][kmer[j]], Y[i])){
+	F[(2 * i) >> 6] |= (uint64_t)1 << ((2 * i) & 63);
+	num++;
+      }
+      if(ada_agree(feature[h_j[i]][kmer[j]], Y[i])){
+	F[(2 * i + 1) >> 6] |= (uint64_t)1 << ((2 * i + 1) & 63);
+	num++;
+      }
+    }
+    bits->F_num[j] = num;
+  }
+  return NULL;
+}
+
+/* A[] and A_num of beta_x[] (once per iteration) */
+int ada_bits_set_x(ada_bits *bits,
+		   const double *beta_x,
+		   const double *Y,
+		   const unsigned long n){
+  unsigned long i, num = 0;
+  memset(bits->A, 0, bits->words * sizeof(uint64_t));
+  for(i = 0; i < 2 * n; i++){
+    if(ada_agree(beta_x[i], Y[i / 2])){
+      bits->A[i >> 6] |= (uint64_t)1 << (i & 63);
+      num++;
+    }
+  }
+  bits->A_num = num;
+  return 0;
+}
+
+/**
+ * build the bitsets of the p columns (on the workers of params) and
+ * attach them to params
+ */
+int ada_bits_prep(const int thread_num,
+		  const unsigned long n,
+		  const unsigned long p,
+		  cmpUdX_args *params,
+		  pthread_t *threads,
+		  ada_bits **bits){
+  int t;
+  *bits = calloc_errchk(1, sizeof(ada_bits), "calloc ada_bits");
+  (*bits)->words = (2 * n + 63) / 64;
+  (*bits)->F = calloc_errchk(p * (*bits)->words, sizeof(uint64_t),
+			     "calloc ada_bits->F[]");
+  (*bits)->F_num = calloc_errchk(p, sizeof(unsigned long),
+				 "calloc ada_bits->F_num[]");
+  (*bits)->A = calloc_errchk((*bits)->words, sizeof(uint64_t),
+			     "calloc ada_bits->A[]");
+  for(t = 0; t < thread_num; t++){
+    params[t].bits = *bits;
+  }
+  boost_pthread_run(thread_num, ada_bits_build, params, threads, NULL);
+  return 0;
+}
+
+int ada_bits_free(ada_bits *bits){
+  free(bits->F);
+  free(bits->F_num);
+  free(bits->A);
+  free(bits);
+  return 0;
+}
+
+/**
+ * ada_cmpUdX() over the bitsets: TT = |A & F|, and TF, FT and FF follow
+ * from |A|, |F| and 2n (64 rows sides per AND and popcount)
+ */
+void *ada_cmpUdX_bits(void *args){
+  /* unstack parameters */
+  const cmpUdX_args *params = (cmpUdX_args *)args;
+  const ada_bits *bits = params->bits;
+  const unsigned long words = bits->words;
+  const uint64_t *A = bits->A;
+
+  unsigned long j, w;
+  unsigned long TT, TF, FT, FF;
+  for(j = params->begin; j < params->end; j++){
+    const uint64_t *F = bits->F + j * words;
+    TT = 0;
+    for(w = 0; w < words; w++){
+      TT += __builtin_popcountll(A[w] & F[w]);
+    }
+    TF = bits->A_num - TT;
+    FT = bits->F_num[j] - TT;
+    FF = 2 * params->n - TT - TF - FT;
+    (params->UdX)[j] = 1.0 * (TT - TF) * exp(-1) + 1.0 * (FT- FF) * exp(1);
+  }
+  return NULL;
+}
+
 int ada_update_beta_x(double *beta_x, 
 		      double *residual_square,
 		      const unsigned int m,
@@ -664,7 +1744,7 @@ int ada_train(const cmd_args *args,
   double gamma = 0;
   double *beta_x, *UdX, *Xnormsq;
   unsigned int m = 0;
-  struct timeval time_start, time_prev, time;
+  double time_start, time_prev, time;
 
   /* allocate memory */
   {
@@ -722,30 +1802,27 @@ int ada_train(const cmd_args *args,
 
 #if 1
   if(thread_num >= 1){
-    int t = 0;
     cmpUdX_args *params;
     pthread_t *threads;
+    ada_bits *bits;
+
+    /* prepare for thread programming, sign agreement of the features */
+    boost_pthread_prep(thread_num, n, p, 
+		       feature, data, NULL, kmers,
+		       beta_x, UdX, Xnormsq, 
+		       &params, &threads);
+    ada_bits_prep(thread_num, n, p, params, threads, &bits);
 
-    gettimeofday(&time, NULL);
-    cpTimeval(time, &time_prev);
-    cpTimeval(time, &time_start);
+    time = trace_now();
+    time_prev = time;
+    time_start = time;
 #if 1
     for(m = (*model)->nextiter; m <= (*model)->iternum; m++){
       /* compute inner product $U \cdot X^{(j)}$ */
       {
-	/* prepare for thread programming */
-	boost_pthread_prep(thread_num, n, p, 
-			   feature, data, NULL, kmers,
-			   beta_x, UdX, Xnormsq, 
-			   &params, &threads);
-		   
-	for(t = 0; t < thread_num; t++){
-	  pthread_create(&threads[t], NULL, 
-			 ada_cmpUdX, (void*)&params[t]);		       
-	} 
-	for(t = 0; t < thread_num; t++){
-	  pthread_join(threads[t], NULL);
-	}
+	ada_bits_set_x(bits, beta_x, data->mij, n);
+	boost_pthread_run(thread_num, ada_cmpUdX_bits, params, threads,
+			  NULL);
       }
 
       /* select axis */
@@ -760,27 +1837,30 @@ int ada_train(const cmd_args *args,
 			feature, data, kmers,
 			(const double)gamma, v);
       
-      gettimeofday(&time, NULL);
+      time = trace_now();
       boost_step_dump(*model,
 		      (const unsigned int)m, 
 		      (const unsigned long)s,
 		      v * (const double)gamma,
-		      (const double)diffSec(time_prev, time),
-		      (const double)diffSec(time_start, time),
+		      (const double)(time - time_prev),
+		      (const double)(time - time_start),
 		      fp);
       fprintf(stderr, "%s [INFO] \t ", args->prog_name);
       boost_step_dump(*model,
 		      (const unsigned int)m, 
 		      (const unsigned long)s,
 		      v * (const double)gamma,
-		      (const double)diffSec(time_prev, time),
-		      (const double)diffSec(time_start, time),
+		      (const double)(time - time_prev),
+		      (const double)(time - time_start),
 		      stderr);
-      cpTimeval(time, &time_prev);
+      time_prev = time;
 #endif
     }
 
 #endif
+    ada_bits_free(bits);
+    free(params);
+    free(threads);
   }
 
 #endif
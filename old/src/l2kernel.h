@@ -0,0 +1,454 @@
+/**
+ * L2 Boosting kernels, parameterized on the scalar type of the feature
+ * table and of the residuals U[].
+ *
+ * This file is included by l2boost.h once per scalar type with
+ *   L2_REAL      : scalar type (double, float)
+ *   L2_FN(name)  : name of the instantiated function
+ *   L2_KAHAN     : 1 to use Kahan-compensated accumulators
+ *   L2_K         : k-mer length the kernels are specialized on (0 : any k)
+ *   L2_KERNELS   : name of the l2_kernels table of the instantiation
+ * defined. The feature table (L2_REAL **) and U (L2_REAL *) are passed as
+ * (const) void pointers so that every instantiation shares one signature
+ * (see l2_kernels in l2boost.h). UdX[], Xnormsq[] and the residual sum
+ * are always returned in double precision.
+ */
+
+#ifndef L2_REAL
+#error "l2kernel.h must be included from l2boost.h"
+#endif
+
+#if L2_KAHAN
+#define L2_ACC(sum, c, x) {			\
+    const L2_REAL y_ = (x) - (c);		\
+    const L2_REAL t_ = (sum) + y_;		\
+    (c) = (t_ - (sum)) - y_;			\
+    (sum) = t_;					\
+  }
+#else
+#define L2_ACC(sum, c, x) { (sum) += (x); (void)(c); }
+#endif
+
+#if L2_K > 0
+/* the rows are views into one block (see features_block() in fasta.h):
+ * index the block directly, with a constant row width 4^k */
+#define L2_W ((unsigned long)1 << (2 * L2_K))
+#define L2_BASE(feature, h_i, n)					\
+  const L2_REAL *block_ =						\
+    ((n) > 0) ? (feature)[(h_i)[0]] - (h_i)[0] * L2_W : NULL
+
+/* pf : pairwise feature of row i for column j */
+#define L2_PF(feature, h_i, h_j, i, j)			\
+  ((block_[(h_i)[i] * L2_W + kmer1[j]] *		\
+    block_[(h_j)[i] * L2_W + kmer2[j]]) +		\
+   (block_[(h_i)[i] * L2_W + revcmp1[j]] *		\
+    block_[(h_j)[i] * L2_W + revcmp2[j]]))
+#else
+#define L2_BASE(feature, h_i, n) (void)(feature)
+
+/* pf : pairwise feature of row i for column j */
+#define L2_PF(feature, h_i, h_j, i, j)			\
+  (((feature)[(h_i)[i]][kmer1[j]] *			\
+    (feature)[(h_j)[i]][kmer2[j]]) +			\
+   ((feature)[(h_i)[i]][revcmp1[j]] *			\
+    (feature)[(h_j)[i]][revcmp2[j]]))
+#endif
+
+void *L2_FN(boost_cmpXnormsq)(void *args){
+  /* unstack parameters */
+  const cmpUdX_args *params = (cmpUdX_args *)args;
+  const L2_REAL **feature = (const L2_REAL **)params->feature;
+  const unsigned int *h_i = params->data->i;
+  const unsigned int *h_j = params->data->j;
+  const unsigned int *kmer1 = params->ckps->kmer1;
+  const unsigned int *kmer2 = params->ckps->kmer2;
+  const unsigned int *revcmp1 = params->ckps->revcmp1;
+  const unsigned int *revcmp2 = params->ckps->revcmp2;
+
+  /* compute ||X^{(j)}||^2 */
+  unsigned int i, j;
+  L2_REAL sum, c, pf;
+  L2_BASE(feature, h_i, params->n);
+  for(j = params->begin; j < params->end; j++){
+    sum = c = 0;
+    for(i = 0; i < params->n; i++){
+      pf = L2_PF(feature, h_i, h_j, i, j);
+      L2_ACC(sum, c, pf * pf);
+    }
+    (params->Xnormsq)[j] = sum;
+  }
+  return NULL;
+}
+
+/**
+ * UdX over a tile_rows x tile_cols blocking: a block of columns (canonical
+ * pairs sorted by kmer1, so that they share feature entries) is swept over
+ * a block of rows whose U[], h_i[], h_j[] and feature rows stay in cache.
+ * The partial sums of the columns are carried over the row blocks, so that
+ * every column is still summed in row order.
+ *  (tile_rows == 0 : all rows, tile_cols == 0 : one column per block)
+ */
+void *L2_FN(l2_cmpUdX)(void *args){
+  /* unstack parameters */
+  cmpUdX_args *params = (cmpUdX_args *)args;
+  screen_state *screen = params->screen;
+  const L2_REAL **feature = (const L2_REAL **)params->feature;
+  const L2_REAL *U = (const L2_REAL *)params->U;
+  const unsigned int *h_i = params->data->i;
+  const unsigned int *h_j = params->data->j;
+  const unsigned int *kmer1 = params->ckps->kmer1;
+  const unsigned int *kmer2 = params->ckps->kmer2;
+  const unsigned int *revcmp1 = params->ckps->revcmp1;
+  const unsigned int *revcmp2 = params->ckps->revcmp2;
+  const unsigned long tile_rows =
+    (params->tile_rows == 0) ? params->n : params->tile_rows;
+  const unsigned long tile_cols =
+    (params->tile_cols == 0) ? 1 : params->tile_cols;
+  unsigned long one_col;
+  double one_sum, one_c;
+  unsigned long *col = (params->tile_col == NULL) ? &one_col : params->tile_col;
+  double *tsum = (params->tile_sum == NULL) ? &one_sum : params->tile_sum;
+  double *tc = (params->tile_c == NULL) ? &one_c : params->tile_c;
+
+  /* compute the dot product between U and X^{(j)} */
+  unsigned int i, j;
+  unsigned long t, t0, t1, i0, i1, l, live;
+  L2_REAL sum, c;
+  L2_BASE(feature, h_i, params->n);
+  params->pruned = 0;
+  for(t0 = params->begin; t0 < params->end; t0 += tile_cols){
+    t1 = (t0 + tile_cols < params->end) ? t0 + tile_cols : params->end;
+
+    /* columns of the block that survive the screening */
+    live = 0;
+    for(t = t0; t < t1; t++){
+      j = (params->idx == NULL) ? t : (params->idx)[t];
+      if(screen != NULL &&
+	 boost_screen_bound(screen, j) * (1 + screen->tol) <
+	 atomic_load_explicit(&(screen->best), memory_order_relaxed)){
+	/* column j cannot beat the best score */
+	(params->UdX)[j] = 0;
+	params->pruned++;
+	continue;
+      }
+      col[live] = j;
+      tsum[live] = tc[live] = 0;
+      live++;
+    }
+
+    for(i0 = 0; i0 < params->n; i0 += tile_rows){
+      i1 = (i0 + tile_rows < params->n) ? i0 + tile_rows : params->n;
+      for(l = 0; l < live; l++){
+	j = col[l];
+	sum = tsum[l];
+	c = tc[l];
+	for(i = i0; i < i1; i++){
+	  L2_ACC(sum, c, U[i] * L2_PF(feature, h_i, h_j, i, j));
+	}
+	tsum[l] = sum;
+	tc[l] = c;
+      }
+    }
+
+    for(l = 0; l < live; l++){
+      (params->UdX)[col[l]] = tsum[l];
+      if(screen != NULL){
+	boost_screen_record(screen, col[l], tsum[l], (params->Xnormsq)[col[l]]);
+      }
+    }
+  }
+  return NULL;
+}
+
+/**
+ * l2_cmpUdX() of r models at once (batched training, see l2batch.h):
+ * U[i * r + b] is the residual of model b and UdX[j * r + b] its product
+ * with X^{(j)}. The pairwise feature of a row is gathered once for all of
+ * the models. Same blocking as l2_cmpUdX(), with r partial sums per
+ * column (tile_sum[], tile_c[] : tile_cols x r entries).
+ */
+void *L2_FN(l2_cmpUdX_batch)(void *args){
+  /* unstack parameters */
+  cmpUdX_args *params = (cmpUdX_args *)args;
+  const L2_REAL **feature = (const L2_REAL **)params->feature;
+  const L2_REAL *U = (const L2_REAL *)params->U;
+  const unsigned int *h_i = params->data->i;
+  const unsigned int *h_j = params->data->j;
+  const unsigned int *kmer1 = params->ckps->kmer1;
+  const unsigned int *kmer2 = params->ckps->kmer2;
+  const unsigned int *revcmp1 = params->ckps->revcmp1;
+  const unsigned int *revcmp2 = params->ckps->revcmp2;
+  const unsigned long r = params->batch;
+  const unsigned long tile_rows =
+    (params->tile_rows == 0) ? params->n : params->tile_rows;
+  const unsigned long tile_cols =
+    (params->tile_cols == 0) ? 1 : params->tile_cols;
+  double one_sum[L2_BATCH_MAX], one_c[L2_BATCH_MAX];
+  double *tsum = (params->tile_sum == NULL) ? one_sum : params->tile_sum;
+  double *tc = (params->tile_c == NULL) ? one_c : params->tile_c;
+
+  unsigned long i, j, t, t0, t1, i0, i1, b;
+  L2_REAL sum[L2_BATCH_MAX], c[L2_BATCH_MAX], pf;
+  L2_BASE(feature, h_i, params->n);
+  params->pruned = 0;
+  for(t0 = params->begin; t0 < params->end; t0 += tile_cols){
+    t1 = (t0 + tile_cols < params->end) ? t0 + tile_cols : params->end;
+    for(b = 0; b < (t1 - t0) * r; b++){
+      tsum[b] = tc[b] = 0;
+    }
+
+    for(i0 = 0; i0 < params->n; i0 += tile_rows){
+      i1 = (i0 + tile_rows < params->n) ? i0 + tile_rows : params->n;
+      for(t = t0; t < t1; t++){
+	double *ts = tsum + (t - t0) * r, *tcc = tc + (t - t0) * r;
+	j = (params->idx == NULL) ? t : (params->idx)[t];
+	for(b = 0; b < r; b++){
+	  sum[b] = ts[b];
+	  c[b] = tcc[b];
+	}
+	for(i = i0; i < i1; i++){
+	  const L2_REAL *U_i = U + i * r;
+	  pf = L2_PF(feature, h_i, h_j, i, j);
+	  for(b = 0; b < r; b++){
+	    L2_ACC(sum[b], c[b], U_i[b] * pf);
+	  }
+	}
+	for(b = 0; b < r; b++){
+	  ts[b] = sum[b];
+	  tcc[b] = c[b];
+	}
+      }
+    }
+
+    for(t = t0; t < t1; t++){
+      j = (params->idx == NULL) ? t : (params->idx)[t];
+      for(b = 0; b < r; b++){
+	(params->UdX)[j * r + b] = tsum[(t - t0) * r + b];
+      }
+    }
+  }
+  return NULL;
+}
+
+/* U.X^{(j)} for a single column */
+double L2_FN(l2_cmpUdX_col)(const void *U_,
+			    const unsigned long n,
+			    const unsigned long j,
+			    const void *feature_,
+			    const hic *data,
+			    const canonical_kp *ckps){
+  const L2_REAL **feature = (const L2_REAL **)feature_;
+  const L2_REAL *U = (const L2_REAL *)U_;
+  const unsigned int *h_i = data->i;
+  const unsigned int *h_j = data->j;
+  const unsigned int *kmer1 = ckps->kmer1;
+  const unsigned int *kmer2 = ckps->kmer2;
+  const unsigned int *revcmp1 = ckps->revcmp1;
+  const unsigned int *revcmp2 = ckps->revcmp2;
+  unsigned long i;
+  L2_REAL sum = 0, c = 0;
+  L2_BASE(feature, h_i, n);
+  for(i = 0; i < n; i++){
+    L2_ACC(sum, c, U[i] * L2_PF(feature, h_i, h_j, i, j));
+  }
+  return sum;
+}
+
+/* U[] := Y[], returns \sum_i U[i]^2 / n */
+double L2_FN(l2_set_U)(void *U_,
+		       const unsigned long n,
+		       const double *Y){
+  L2_REAL *U = (L2_REAL *)U_;
+  unsigned long i;
+  double sum = 0;
+  for(i = 0; i < n; i++){
+    U[i] = Y[i];
+    sum += U[i] * U[i] / n;
+  }
+  return sum;
+}
+
+/* ||U||^2 */
+double L2_FN(l2_Unormsq)(const void *U_,
+			 const unsigned long n){
+  const L2_REAL *U = (const L2_REAL *)U_;
+  unsigned long i;
+  L2_REAL sum = 0, c = 0;
+  for(i = 0; i < n; i++){
+    L2_ACC(sum, c, U[i] * U[i]);
+  }
+  return sum;
+}
+
+int L2_FN(l2_update_U)(void *U_,
+		       double *residual_square,
+		       const unsigned int m,
+		       const unsigned long n,
+		       const unsigned long s,
+		       const void *feature_,
+		       const hic *data,
+		       const canonical_kp *ckps,
+		       const double gamma,
+		       const double v){
+  const L2_REAL **feature = (const L2_REAL **)feature_;
+  L2_REAL *U = (L2_REAL *)U_;
+  const unsigned int *h_i = data->i;
+  const unsigned int *h_j = data->j;
+  const unsigned int *kmer1 = ckps->kmer1;
+  const unsigned int *kmer2 = ckps->kmer2;
+  const unsigned int *revcmp1 = ckps->revcmp1;
+  const unsigned int *revcmp2 = ckps->revcmp2;
+  const L2_REAL v_gamma = v * gamma;
+  unsigned long i;
+  L2_REAL sum = 0, c = 0, pf = 0;
+  L2_BASE(feature, h_i, n);
+  for(i = 0; i < n; i++){
+    /* pf : pairwise feature */
+    pf = L2_PF(feature, h_i, h_j, i, s);
+    U[i] -= v_gamma * pf;
+    L2_ACC(sum, c, U[i] * U[i] / n);
+  }
+  residual_square[m] = sum;
+  return 0;
+}
+
+/* U[i * r + b] := Y[b][i], res_sq[b] := \sum_i U[i * r + b]^2 / n */
+int L2_FN(l2_set_U_batch)(void *U_,
+			  double *res_sq,
+			  const unsigned long r,
+			  const unsigned long n,
+			  const double **Y){
+  L2_REAL *U = (L2_REAL *)U_;
+  unsigned long i, b;
+  for(b = 0; b < r; b++){
+    double sum = 0;
+    for(i = 0; i < n; i++){
+      U[i * r + b] = Y[b][i];
+      sum += U[i * r + b] * U[i * r + b] / n;
+    }
+    res_sq[b] = sum;
+  }
+  return 0;
+}
+
+/**
+ * l2_update_U() of r models in one pass over the rows: model b moves
+ * along its own axis s[b], U[i * r + b] -= step[g * r + b] X^{(s[b])}_i
+ * where g is the group of row i (group == NULL : every row in group 0).
+ * A zero step keeps the residuals of the rows held out of a model (see
+ * --cv in l2batch.h) at 0.
+ */
+int L2_FN(l2_update_U_batch)(void *U_,
+			     double *res_sq,
+			     const unsigned long r,
+			     const unsigned long n,
+			     const unsigned long *s,
+			     const void *feature_,
+			     const hic *data,
+			     const canonical_kp *ckps,
+			     const double *step,
+			     const unsigned int *group){
+  const L2_REAL **feature = (const L2_REAL **)feature_;
+  L2_REAL *U = (L2_REAL *)U_;
+  const unsigned int *h_i = data->i;
+  const unsigned int *h_j = data->j;
+  const unsigned int *kmer1 = ckps->kmer1;
+  const unsigned int *kmer2 = ckps->kmer2;
+  const unsigned int *revcmp1 = ckps->revcmp1;
+  const unsigned int *revcmp2 = ckps->revcmp2;
+  unsigned long i, b;
+  L2_REAL sum[L2_BATCH_MAX], c[L2_BATCH_MAX], pf;
+  L2_BASE(feature, h_i, n);
+  for(b = 0; b < r; b++){
+    sum[b] = c[b] = 0;
+  }
+  for(i = 0; i < n; i++){
+    L2_REAL *U_i = U + i * r;
+    const double *step_i = step + ((group == NULL) ? 0 : group[i] * r);
+    for(b = 0; b < r; b++){
+      const L2_REAL v_gamma = step_i[b];
+      pf = L2_PF(feature, h_i, h_j, i, s[b]);
+      U_i[b] -= v_gamma * pf;
+      L2_ACC(sum[b], c[b], U_i[b] * U_i[b] / n);
+    }
+  }
+  for(b = 0; b < r; b++){
+    res_sq[b] = sum[b];
+  }
+  return 0;
+}
+
+/* U[] -= \sum_j beta[j] X^{(j)} (residuals of a model loaded from a file) */
+int L2_FN(l2_apply_beta)(void *U_,
+			 const unsigned long n,
+			 const unsigned long p,
+			 const double *beta,
+			 const void *feature_,
+			 const hic *data,
+			 const canonical_kp *ckps){
+  const L2_REAL **feature = (const L2_REAL **)feature_;
+  L2_REAL *U = (L2_REAL *)U_;
+  const unsigned int *h_i = data->i;
+  const unsigned int *h_j = data->j;
+  const unsigned int *kmer1 = ckps->kmer1;
+  const unsigned int *kmer2 = ckps->kmer2;
+  const unsigned int *revcmp1 = ckps->revcmp1;
+  const unsigned int *revcmp2 = ckps->revcmp2;
+  unsigned long i, j;
+  L2_BASE(feature, h_i, n);
+  for(j = 0; j < p; j++){
+    if(beta[j] != 0){
+      for(i = 0; i < n; i++){
+	U[i] -= beta[j] * L2_PF(feature, h_i, h_j, i, j);
+      }
+    }
+  }
+  return 0;
+}
+
+/* pred[] += \sum_j beta[j] X^{(j)} (always double precision) */
+int L2_FN(l2_predict)(double *pred,
+		      const unsigned long n,
+		      const unsigned long p,
+		      const double *beta,
+		      const void *feature_,
+		      const hic *data,
+		      const canonical_kp *ckps){
+  const L2_REAL **feature = (const L2_REAL **)feature_;
+  const unsigned int *h_i = data->i;
+  const unsigned int *h_j = data->j;
+  const unsigned int *kmer1 = ckps->kmer1;
+  const unsigned int *kmer2 = ckps->kmer2;
+  const unsigned int *revcmp1 = ckps->revcmp1;
+  const unsigned int *revcmp2 = ckps->revcmp2;
+  unsigned long i, j;
+  L2_BASE(feature, h_i, n);
+  for(j = 0; j < p; j++){
+    if(beta[j] != 0){
+      for(i = 0; i < n; i++){
+	pred[i] += beta[j] * L2_PF(feature, h_i, h_j, i, j);
+      }
+    }
+  }
+  return 0;
+}
+
+const l2_kernels L2_KERNELS = {
+  sizeof(L2_REAL),
+  L2_FN(boost_cmpXnormsq),
+  L2_FN(l2_cmpUdX),
+  L2_FN(l2_cmpUdX_col),
+  L2_FN(l2_set_U),
+  L2_FN(l2_Unormsq),
+  L2_FN(l2_update_U),
+  L2_FN(l2_apply_beta),
+  L2_FN(l2_predict),
+  L2_FN(l2_cmpUdX_batch),
+  L2_FN(l2_set_U_batch),
+  L2_FN(l2_update_U_batch)
+};
+
+#undef L2_PF
+#undef L2_BASE
+#undef L2_W
+#undef L2_ACC
@@ -0,0 +1,45 @@
+/**
+ * Instantiations of l2kernel.h specialized on k = 3, ..., 6 for the
+ * current L2_REAL and L2_KAHAN.
+ *
+ * This file is included by l2boost.h with
+ *   L2_FN_K(name, k)  : name of the function instantiated for k
+ *   L2_KERNELS_K(k)   : name of the l2_kernels table instantiated for k
+ * defined. The tables are selected at run time by l2_kernels_select().
+ */
+
+#ifndef L2_FN_K
+#error "l2kernel_k.h must be included from l2boost.h"
+#endif
+
+#define L2_K 3
+#define L2_FN(name) L2_FN_K(name, 3)
+#define L2_KERNELS L2_KERNELS_K(3)
+#include "l2kernel.h"
+#undef L2_K
+#undef L2_FN
+#undef L2_KERNELS
+
+#define L2_K 4
+#define L2_FN(name) L2_FN_K(name, 4)
+#define L2_KERNELS L2_KERNELS_K(4)
+#include "l2kernel.h"
+#undef L2_K
+#undef L2_FN
+#undef L2_KERNELS
+
+#define L2_K 5
+#define L2_FN(name) L2_FN_K(name, 5)
+#define L2_KERNELS L2_KERNELS_K(5)
+#include "l2kernel.h"
+#undef L2_K
+#undef L2_FN
+#undef L2_KERNELS
+
+#define L2_K 6
+#define L2_FN(name) L2_FN_K(name, 6)
+#define L2_KERNELS L2_KERNELS_K(6)
+#include "l2kernel.h"
+#undef L2_K
+#undef L2_FN
+#undef L2_KERNELS
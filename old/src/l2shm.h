@@ -0,0 +1,501 @@
+#ifndef __L2SHM_H__
+#define __L2SHM_H__
+
+/**
+ * multi-process L2 Boosting over POSIX shared memory (--procs N)
+ *  The coordinator (the calling process) places the feature rows, the Hi-C
+ *  coordinates and responses, the residuals U[], UdX[] and Xnormsq[] in
+ *  one shared memory segment and forks N worker processes, which map it
+ *  at the same address. Worker w owns the shard [begin, end) of the
+ *  canonical k-mer pairs: at every iteration it computes U.X^{(j)} over
+ *  its shard and posts the best axis of the shard. The coordinator
+ *  reduces the N candidates, updates beta and U[] in the segment and
+ *  starts the next iteration.
+ *  A worker that dies stops the run with an error instead of a hang, and
+ *  the workers die with the coordinator (PR_SET_PDEATHSIG).
+ *  The selected axes are identical to l2_train().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "constant.h"
+#include "calloc_errchk.h"
+#include "cmd_args.h"
+#include "hic.h"
+#include "kmer.h"
+#include "l2boost.h"
+#include "metrics.h"
+#include "trace.h"
+
+/* alignment of the arrays of the segment (bytes) */
+#define L2_SHM_ALIGN 64
+
+/* commands of the coordinator to the workers */
+typedef enum { L2_SHM_XNORMSQ , L2_SHM_UDX , L2_SHM_EXIT } l2_shm_cmd;
+
+/* control block at the head of the segment */
+typedef struct _l2_shm_ctl{
+  l2_shm_cmd cmd;
+  /* go[w] : worker w runs cmd, done : posted by every worker when done */
+  sem_t go[L2_SHM_PROCS_MAX];
+  sem_t done;
+  /* best axis of the shard of worker w and its score */
+  unsigned long best[L2_SHM_PROCS_MAX];
+  double best_score[L2_SHM_PROCS_MAX];
+  /* wall time of the last command of worker w (s) */
+  double busy[L2_SHM_PROCS_MAX];
+} l2_shm_ctl;
+
+/* the segment and the worker processes */
+typedef struct _l2_shm{
+  int procs;
+  size_t size;
+  void *base;
+  l2_shm_ctl *ctl;
+  /* feature rows (L2_REAL **, the rows and the row pointers in the
+   * segment) */
+  void **feature;
+  /* Hi-C coordinates and responses (in the segment) */
+  hic data;
+  void *U;
+  double *UdX;
+  double *Xnormsq;
+  pid_t *pid;
+} l2_shm;
+
+int l2_shm_open(const cmd_args *args,
+		const l2_kernels *kern,
+		const void **feature,
+		const hic *data,
+		const unsigned long p,
+		l2_shm **shm);
+int l2_shm_fork(const cmd_args *args,
+		l2_shm *shm,
+		const l2_kernels *kern,
+		cmpUdX_args *params);
+int l2_shm_run(const cmd_args *args,
+	       l2_shm *shm,
+	       const l2_shm_cmd cmd,
+	       double *busy);
+unsigned long l2_shm_select(const l2_shm *shm);
+int l2_shm_close(l2_shm *shm);
+int l2_train_shm(const cmd_args *args,
+		 const double **feature,
+		 const float **feature_f,
+		 const hic *data,
+		 const canonical_kp *ckps,
+		 const double v,
+		 boost **model,
+		 FILE *fp);
+
+static inline size_t l2_shm_align(const size_t size){
+  return (size + L2_SHM_ALIGN - 1) / L2_SHM_ALIGN * L2_SHM_ALIGN;
+}
+
+/**
+ * create the segment and copy the feature rows referenced by data and
+ * the Hi-C rows into it
+ */
+int l2_shm_open(const cmd_args *args,
+		const l2_kernels *kern,
+		const void **feature,
+		const hic *data,
+		const unsigned long p,
+		l2_shm **shm){
+  const unsigned long n = data->nrow;
+  const size_t row_size = ((size_t)1 << (2 * args->k)) * kern->real_size;
+  unsigned long bin_num, i;
+  size_t off_feature, off_rows, off_i, off_j, off_mij, off_U, off_UdX,
+    off_Xnormsq;
+  char name[F_NAME_LEN];
+  char *base;
+  int fd, w;
+
+  /* only the rows referenced by the Hi-C data are placed */
+  bin_num = hic_bin_num(data);
+
+  *shm = calloc_errchk(1, sizeof(l2_shm), "calloc l2_shm");
+  (*shm)->procs = args->procs;
+  (*shm)->pid = calloc_errchk(args->procs, sizeof(pid_t), "calloc pid[]");
+
+  /* layout */
+  off_feature = l2_shm_align(sizeof(l2_shm_ctl));
+  off_rows    = off_feature + l2_shm_align(bin_num * sizeof(void *));
+  off_i       = off_rows    + l2_shm_align(bin_num * row_size);
+  off_j       = off_i       + l2_shm_align(n * sizeof(unsigned int));
+  off_mij     = off_j       + l2_shm_align(n * sizeof(unsigned int));
+  off_U       = off_mij     + l2_shm_align(n * sizeof(double));
+  off_UdX     = off_U       + l2_shm_align(n * kern->real_size);
+  off_Xnormsq = off_UdX     + l2_shm_align(p * sizeof(double));
+  (*shm)->size = off_Xnormsq + l2_shm_align(p * sizeof(double));
+
+  /* the name is removed once mapped : the workers inherit the mapping */
+  snprintf(name, F_NAME_LEN, "/qloop.%d", (int)getpid());
+  if((fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600)) < 0){
+    fprintf(stderr, "error: shm_open %s\n%s\n", name, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  if(ftruncate(fd, (off_t)(*shm)->size) != 0){
+    fprintf(stderr, "error: ftruncate %s\n%s\n", name, strerror(errno));
+    shm_unlink(name);
+    exit(EXIT_FAILURE);
+  }
+  (*shm)->base = mmap(NULL, (*shm)->size, PROT_READ | PROT_WRITE,
+		      MAP_SHARED, fd, 0);
+  if((*shm)->base == MAP_FAILED){
+    fprintf(stderr, "error: mmap %s\n%s\n", name, strerror(errno));
+    shm_unlink(name);
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+  shm_unlink(name);
+
+  base = (char *)(*shm)->base;
+  (*shm)->ctl       = (l2_shm_ctl *)base;
+  (*shm)->feature   = (void **)(base + off_feature);
+  (*shm)->data.nrow = n;
+  (*shm)->data.i    = (unsigned int *)(base + off_i);
+  (*shm)->data.j    = (unsigned int *)(base + off_j);
+  (*shm)->data.mij  = (double *)(base + off_mij);
+  (*shm)->U         = (void *)(base + off_U);
+  (*shm)->UdX       = (double *)(base + off_UdX);
+  (*shm)->Xnormsq   = (double *)(base + off_Xnormsq);
+
+  for(i = 0; i < bin_num; i++){
+    if(feature[i] != NULL){
+      (*shm)->feature[i] = base + off_rows + i * row_size;
+      memcpy((*shm)->feature[i], feature[i], row_size);
+    }
+  }
+  memcpy((*shm)->data.i, data->i, n * sizeof(unsigned int));
+  memcpy((*shm)->data.j, data->j, n * sizeof(unsigned int));
+  memcpy((*shm)->data.mij, data->mij, n * sizeof(double));
+
+  for(w = 0; w < args->procs; w++){
+    sem_init(&((*shm)->ctl->go[w]), 1, 0);
+  }
+  sem_init(&((*shm)->ctl->done), 1, 0);
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "shared memory: %ld bytes (%ld bins, %ld rows)\n",
+	  (long)(*shm)->size, bin_num, n);
+  return 0;
+}
+
+/* best axis of the shard of params and its score (ties : smallest j) */
+int l2_shm_best(const cmpUdX_args *params,
+		unsigned long *best,
+		double *best_score){
+  unsigned long j;
+  *best = params->begin;
+  *best_score = -1;
+  for(j = params->begin; j < params->end; j++){
+    const double score = boost_score(params->UdX[j], params->Xnormsq[j]);
+    if(*best_score < score){
+      *best = j;
+      *best_score = score;
+    }
+  }
+  return 0;
+}
+
+/* the loop of worker params->thread_id (never returns) */
+void l2_shm_worker(l2_shm *shm,
+		   const l2_kernels *kern,
+		   cmpUdX_args *params){
+  l2_shm_ctl *ctl = shm->ctl;
+  const int w = params->thread_id;
+  double t0;
+  for(;;){
+    while(sem_wait(&(ctl->go[w])) != 0){
+      if(errno != EINTR){
+	_exit(EXIT_FAILURE);
+      }
+    }
+    if(ctl->cmd == L2_SHM_EXIT){
+      _exit(EXIT_SUCCESS);
+    }
+    t0 = trace_now();
+    if(ctl->cmd == L2_SHM_XNORMSQ){
+      kern->cmpXnormsq(params);
+    }else{
+      kern->cmpUdX(params);
+      l2_shm_best(params, &(ctl->best[w]), &(ctl->best_score[w]));
+    }
+    ctl->busy[w] = trace_now() - t0;
+    sem_post(&(ctl->done));
+  }
+}
+
+/* fork the workers, worker w runs on the shard of params[w] */
+int l2_shm_fork(const cmd_args *args,
+		l2_shm *shm,
+		const l2_kernels *kern,
+		cmpUdX_args *params){
+  const pid_t parent = getpid();
+  int w;
+
+  /* nothing buffered may be written twice */
+  fflush(NULL);
+  for(w = 0; w < shm->procs; w++){
+    if((shm->pid[w] = fork()) < 0){
+      fprintf(stderr, "%s [ERROR] ", args->prog_name);
+      fprintf(stderr, "fork\n%s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }else if(shm->pid[w] == 0){
+      prctl(PR_SET_PDEATHSIG, SIGKILL);
+      if(getppid() != parent){
+	_exit(EXIT_FAILURE);
+      }
+      l2_shm_worker(shm, kern, &params[w]);
+    }
+  }
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "started %d worker processes\n", shm->procs);
+  return 0;
+}
+
+/* stop the run if a worker has exited */
+int l2_shm_check(const cmd_args *args,
+		 l2_shm *shm){
+  int w, v, status;
+  for(w = 0; w < shm->procs; w++){
+    if(waitpid(shm->pid[w], &status, WNOHANG) == shm->pid[w]){
+      fprintf(stderr, "%s [ERROR] ", args->prog_name);
+      if(WIFSIGNALED(status)){
+	fprintf(stderr, "worker %d (pid %d) killed by signal %d\n",
+		w, (int)shm->pid[w], WTERMSIG(status));
+      }else{
+	fprintf(stderr, "worker %d (pid %d) exited with status %d\n",
+		w, (int)shm->pid[w], WEXITSTATUS(status));
+      }
+      for(v = 0; v < shm->procs; v++){
+	if(v != w){
+	  kill(shm->pid[v], SIGKILL);
+	  waitpid(shm->pid[v], NULL, 0);
+	}
+      }
+      exit(EXIT_FAILURE);
+    }
+  }
+  return 0;
+}
+
+/**
+ * run cmd on every worker and wait for them
+ *  busy[w] : wall time of worker w (NULL : not needed)
+ */
+int l2_shm_run(const cmd_args *args,
+	       l2_shm *shm,
+	       const l2_shm_cmd cmd,
+	       double *busy){
+  l2_shm_ctl *ctl = shm->ctl;
+  struct timespec ts;
+  int w;
+
+  ctl->cmd = cmd;
+  for(w = 0; w < shm->procs; w++){
+    sem_post(&(ctl->go[w]));
+  }
+  for(w = 0; w < shm->procs; w++){
+    for(;;){
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += 1;
+      if(sem_timedwait(&(ctl->done), &ts) == 0){
+	break;
+      }else if(errno == ETIMEDOUT){
+	l2_shm_check(args, shm);
+      }
+    }
+  }
+  if(busy != NULL){
+    for(w = 0; w < shm->procs; w++){
+      busy[w] = ctl->busy[w];
+    }
+  }
+  return 0;
+}
+
+/* reduce the best axes of the shards (ties : smallest j, as
+ * boost_select_axis()) */
+unsigned long l2_shm_select(const l2_shm *shm){
+  const l2_shm_ctl *ctl = shm->ctl;
+  unsigned long s = ctl->best[0];
+  double max = ctl->best_score[0];
+  int w;
+  for(w = 1; w < shm->procs; w++){
+    if(max < ctl->best_score[w]){
+      s = ctl->best[w];
+      max = ctl->best_score[w];
+    }
+  }
+  return s;
+}
+
+/* stop the workers and unmap the segment */
+int l2_shm_close(l2_shm *shm){
+  int w;
+  shm->ctl->cmd = L2_SHM_EXIT;
+  for(w = 0; w < shm->procs; w++){
+    sem_post(&(shm->ctl->go[w]));
+  }
+  for(w = 0; w < shm->procs; w++){
+    waitpid(shm->pid[w], NULL, 0);
+  }
+  for(w = 0; w < shm->procs; w++){
+    sem_destroy(&(shm->ctl->go[w]));
+  }
+  sem_destroy(&(shm->ctl->done));
+  munmap(shm->base, shm->size);
+  free(shm->pid);
+  free(shm);
+  return 0;
+}
+
+/**
+ * l2_train() with the column passes on args->procs worker processes
+ */
+int l2_train_shm(const cmd_args *args,
+		 const double **feature,
+		 const float **feature_f,
+		 const hic *data,
+		 const canonical_kp *ckps,
+		 const double v,
+		 boost **model,
+		 FILE *fp){
+  const unsigned long n = data->nrow;
+  const unsigned long p = ckps->num;
+  const int procs = args->procs;
+  const l2_kernels *kern = l2_kernels_select(args->precision, args->k);
+  const void **feat =
+    (args->precision == SINGLE) ? (const void **)feature_f : (const void **)feature;
+  unsigned long s = 0;
+  double gamma = 0;
+  unsigned int m = 0;
+  double time_start, time_prev, time;
+  /* metrics : bytes touched, as in l2_train() */
+  const double bytes_X = 2 * sizeof(unsigned int) + 4 * kern->real_size;
+  const double bytes_UdX = bytes_X + kern->real_size;
+  const double bytes_U = bytes_X + 2 * kern->real_size;
+  metrics_phase ph;
+  double *busy = calloc_errchk(procs, sizeof(double), "calloc busy[]");
+  cmpUdX_args *params;
+  pthread_t *threads;
+  l2_shm *shm;
+
+  l2_shm_open(args, kern, feat, data, p, &shm);
+
+  /* initialize residuals U[] := Y[] and
+   * compute \sum_i U[i]^2                */
+  ((*model)->res_sq)[0] = kern->set_U(shm->U, n, shm->data.mij);
+
+  /* If we load some model from a file, update residuals */
+  if(((*model)->nextiter) > 1){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "start computation of residuals\n");
+    kern->apply_beta(shm->U, n, p, (*model)->beta,
+		     (const void *)shm->feature, &(shm->data), ckps);
+  }
+
+  /* shards of the workers */
+  boost_pthread_prep(procs, n, p,
+		     (const void *)shm->feature, &(shm->data), ckps, NULL,
+		     shm->U, shm->UdX, shm->Xnormsq,
+		     &params, &threads);
+  boost_tile_prep(args, procs, n, kern->real_size, &(shm->data), params);
+  l2_shm_fork(args, shm, kern, params);
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "start computation of Xnormsq with %d processes (%s precision, %s kernels)\n",
+	  procs, (args->precision == SINGLE) ? "single" : "double",
+	  (args->k >= L2_K_MIN && args->k <= L2_K_MAX) ?
+	  "k-specialized" : "generic");
+
+  /* compute Xnormsq ||X^{(j)}||^2 */
+  time_prev = trace_now();
+  metrics_begin(&ph);
+  l2_shm_run(args, shm, L2_SHM_XNORMSQ, busy);
+  metrics_end(&ph, "Xnormsq", -1, bytes_X * n * p, busy, procs);
+  time = trace_now();
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "Xnormsq finished in %f sec.\n", (time - time_prev));
+
+  time_prev = time;
+  time_start = time;
+
+  for(m = (*model)->nextiter; m <= (*model)->iternum; m++){
+    metrics_phase ph_iter;
+
+    metrics_begin(&ph_iter);
+
+    /* inner products $U \cdot X^{(j)}$ and the best axis of every shard */
+    metrics_begin(&ph);
+    l2_shm_run(args, shm, L2_SHM_UDX, busy);
+    metrics_end(&ph, "UdX", m, bytes_UdX * n * p, busy, procs);
+
+    /* select axis */
+    metrics_begin(&ph);
+    s = l2_shm_select(shm);
+    metrics_end(&ph, "select", m,
+		(sizeof(unsigned long) + sizeof(double)) * procs, NULL, 0);
+
+    gamma = (shm->UdX)[s] / (shm->Xnormsq)[s];
+
+    ((*model)->beta)[s] += v * gamma;
+
+    /* Update U[] and sum of residual square */
+    metrics_begin(&ph);
+    kern->update_U(shm->U, (*model)->res_sq,
+		   (const unsigned int)m, n, s,
+		   (const void *)shm->feature, &(shm->data), ckps,
+		   (const double)gamma, v);
+    metrics_end(&ph, "update", m, bytes_U * n, NULL, 0);
+
+    time = trace_now();
+    boost_step_dump(*model,
+		    (const unsigned int)m,
+		    (const unsigned long)s,
+		    v * (const double)gamma,
+		    (const double)(time - time_prev),
+		    (const double)(time - time_start),
+		    fp);
+    fprintf(stderr, "%s [INFO] \t ", args->prog_name);
+    boost_step_dump(*model,
+		    (const unsigned int)m,
+		    (const unsigned long)s,
+		    v * (const double)gamma,
+		    (const double)(time - time_prev),
+		    (const double)(time - time_start),
+		    stderr);
+    time_prev = time;
+    metrics_end(&ph_iter, "iteration", m, 0, NULL, 0);
+  }
+
+  l2_shm_close(shm);
+  boost_tile_free(procs, params);
+  free(params);
+  free(threads);
+
+  {
+    boost_dump_beta((const boost *)*model, p);
+  }
+  free(busy);
+  return 0;
+}
+
+#endif
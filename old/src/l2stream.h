@@ -0,0 +1,474 @@
+#ifndef __L2STREAM_H__
+#define __L2STREAM_H__
+
+/**
+ * out-of-core L2 Boosting (--stream C)
+ *  The Hi-C rows are never held in memory: the Hi-C file is converted
+ *  into a binary file o.stream (removed once open) of chunks of C rows,
+ *  each chunk holding the bins i[C], j[C] and the residuals U[C] of its
+ *  rows. Every iteration is one sequential pass over the chunks, which
+ *  applies the step of the previous iteration to U[] (written back in
+ *  place) and adds the column sums U.X^{(j)} of the chunk to UdX[]. The
+ *  next chunk is read ahead on a second thread while a chunk is
+ *  processed, so that only two chunks, the feature table and the
+ *  per-column accumulators UdX[] and Xnormsq[] are in memory.
+ *  The column sums are added up chunk by chunk, hence the results equal
+ *  those of l2_train() up to rounding.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "constant.h"
+#include "calloc_errchk.h"
+#include "cmd_args.h"
+#include "hic.h"
+#include "kmer.h"
+#include "l2boost.h"
+#include "metrics.h"
+#include "mywc.h"
+#include "trace.h"
+
+typedef struct _l2_stream{
+  int fd;
+  unsigned long n;
+  /* rows per chunk, number of chunks */
+  unsigned long chunk;
+  unsigned long chunk_num;
+  size_t real_size;
+  /* bytes of a chunk in the file (i[chunk], j[chunk], U[chunk]) */
+  size_t chunk_bytes;
+  /* two chunk buffers, their rows as Hi-C data and their residuals */
+  void *buf[2];
+  hic view[2];
+  void *U[2];
+} l2_stream;
+
+/* read-ahead of chunk c into buffer b */
+typedef struct _l2_stream_io{
+  const l2_stream *st;
+  unsigned long c;
+  int b;
+} l2_stream_io;
+
+int l2_stream_open(const cmd_args *args,
+		   const l2_kernels *kern,
+		   const void *feature,
+		   const canonical_kp *ckps,
+		   const boost *model,
+		   l2_stream **st,
+		   double *res_sq);
+double l2_stream_pass(l2_stream *st,
+		      const l2_kernels *kern,
+		      const void *feature,
+		      const canonical_kp *ckps,
+		      const int thread_num,
+		      cmpUdX_args *params,
+		      pthread_t *threads,
+		      void *(*worker)(void *),
+		      double *col,
+		      double *acc,
+		      const unsigned long s,
+		      const double gamma,
+		      const double v,
+		      double *busy);
+int l2_stream_close(l2_stream *st);
+int l2_train_stream(const cmd_args *args,
+		    const double **feature,
+		    const float **feature_f,
+		    const canonical_kp *ckps,
+		    const double v,
+		    boost **model,
+		    FILE *fp);
+
+/* bytes at offset of the stream file to / from buf (write != 0 : write) */
+int l2_stream_io_full(const int fd,
+		      void *buf,
+		      const size_t bytes,
+		      const off_t offset,
+		      const int write){
+  size_t done = 0;
+  ssize_t ret;
+  while(done < bytes){
+    ret = (write != 0) ?
+      pwrite(fd, (char *)buf + done, bytes - done, offset + done) :
+      pread(fd, (char *)buf + done, bytes - done, offset + done);
+    if(ret < 0 && errno == EINTR){
+      continue;
+    }else if(ret <= 0){
+      fprintf(stderr, "error: %s of the stream file\n%s\n",
+	      (write != 0) ? "pwrite" : "pread",
+	      (ret < 0) ? strerror(errno) : "unexpected end of file");
+      exit(EXIT_FAILURE);
+    }
+    done += ret;
+  }
+  return 0;
+}
+
+/* number of rows of chunk c */
+static inline unsigned long l2_stream_rows(const l2_stream *st,
+					   const unsigned long c){
+  return (c + 1 < st->chunk_num) ? st->chunk : st->n - c * st->chunk;
+}
+
+void *l2_stream_read(void *args){
+  const l2_stream_io *io = (l2_stream_io *)args;
+  l2_stream_io_full(io->st->fd, io->st->buf[io->b], io->st->chunk_bytes,
+		    (off_t)(io->c * io->st->chunk_bytes), 0);
+  return NULL;
+}
+
+/**
+ * write chunk c (nc rows of view[0], responses mij[]) with its residuals
+ * returns \sum_i Y[i]^2 over the chunk
+ */
+double l2_stream_put(l2_stream *st,
+		     const l2_kernels *kern,
+		     const void *feature,
+		     const canonical_kp *ckps,
+		     const boost *model,
+		     const unsigned long c,
+		     const unsigned long nc,
+		     const double *mij){
+  const double sum = kern->set_U(st->U[0], nc, mij) * nc;
+  st->view[0].nrow = nc;
+  if(model->nextiter > 1){
+    kern->apply_beta(st->U[0], nc, ckps->num, model->beta,
+		     feature, &(st->view[0]), ckps);
+  }
+  l2_stream_io_full(st->fd, st->buf[0], st->chunk_bytes,
+		    (off_t)(c * st->chunk_bytes), 1);
+  return sum;
+}
+
+/**
+ * convert args->hic_file into the stream file
+ *  res_sq : \sum_i Y[i]^2 / n
+ *  the residuals start from the model (--pri) if it has any steps
+ */
+int l2_stream_open(const cmd_args *args,
+		   const l2_kernels *kern,
+		   const void *feature,
+		   const canonical_kp *ckps,
+		   const boost *model,
+		   l2_stream **st,
+		   double *res_sq){
+  char file_name[F_NAME_LEN];
+  unsigned long row = 0, c = 0, nc = 0;
+  double *mij, sum = 0;
+  metrics_phase ph;
+  hic_file hf;
+  int b;
+
+  metrics_begin(&ph);
+
+  *st = calloc_errchk(1, sizeof(l2_stream), "calloc l2_stream");
+  hic_open(args, &hf);
+  (*st)->n = hf.nrow;
+  if((*st)->n == 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "no Hi-C data in %s\n", args->hic_file);
+    exit(EXIT_FAILURE);
+  }
+  (*st)->chunk = ((unsigned long)args->stream < (*st)->n) ?
+    (unsigned long)args->stream : (*st)->n;
+  (*st)->real_size = kern->real_size;
+  (*st)->chunk_bytes =
+    (*st)->chunk * (2 * sizeof(unsigned int) + kern->real_size);
+  for(b = 0; b < 2; b++){
+    (*st)->buf[b] = calloc_errchk((*st)->chunk_bytes, 1, "calloc stream buf[]");
+    (*st)->view[b].i = (unsigned int *)(*st)->buf[b];
+    (*st)->view[b].j = (*st)->view[b].i + (*st)->chunk;
+    (*st)->view[b].mij = NULL;
+    (*st)->U[b] = (void *)((*st)->view[b].j + (*st)->chunk);
+  }
+  mij = calloc_errchk((*st)->chunk, sizeof(double), "calloc stream mij[]");
+
+  /* the file is removed once open : nothing is left behind */
+  snprintf(file_name, F_NAME_LEN, "%s.stream", args->out_file);
+  if(((*st)->fd = open(file_name, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0){
+    fprintf(stderr, "error: open %s\n%s\n", file_name, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  unlink(file_name);
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "start streaming Hi-C file from %s to %s\n",
+	  args->hic_file, file_name);
+
+  while(row < (*st)->n &&
+	hic_next(args, &hf, &((*st)->view[0].i[nc]),
+		 &((*st)->view[0].j[nc]), &mij[nc]) != 0){
+    row++;
+    nc++;
+    if(nc == (*st)->chunk){
+      sum += l2_stream_put(*st, kern, feature, ckps, model, c++, nc, mij);
+      nc = 0;
+    }
+  }
+  if(row < (*st)->n){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s is truncated : %ld of %ld rows read\n",
+	    args->hic_file, row, (*st)->n);
+    exit(EXIT_FAILURE);
+  }
+  if(nc > 0){
+    sum += l2_stream_put(*st, kern, feature, ckps, model, c++, nc, mij);
+  }
+  (*st)->n = row;
+  (*st)->chunk_num = c;
+  hic_close(&hf);
+  free(mij);
+  *res_sq = sum / (*st)->n;
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "# of Hi-C data points = %ld (%ld chunks of %ld rows)\n",
+	  (*st)->n, (*st)->chunk_num, (*st)->chunk);
+
+  metrics_end(&ph, "hic_stream", -1,
+	      (double)(*st)->chunk_num * (*st)->chunk_bytes, NULL, 0);
+  return 0;
+}
+
+/**
+ * one sequential pass over the chunks
+ *  s < p  : apply the step U[] -= v gamma X^{(s)} first and write U[] back
+ *  worker : column kernel run on every chunk (NULL : none), its column
+ *           sums (col[]) are added to acc[]
+ *  busy[] : busy time of the workers over the pass
+ * returns \sum_i U[i]^2 / n after the step (0 without a step)
+ */
+double l2_stream_pass(l2_stream *st,
+		      const l2_kernels *kern,
+		      const void *feature,
+		      const canonical_kp *ckps,
+		      const int thread_num,
+		      cmpUdX_args *params,
+		      pthread_t *threads,
+		      void *(*worker)(void *),
+		      double *col,
+		      double *acc,
+		      const unsigned long s,
+		      const double gamma,
+		      const double v,
+		      double *busy){
+  const unsigned long p = ckps->num;
+  l2_stream_io io;
+  pthread_t reader;
+  unsigned long c, j;
+  double sum = 0, tmp[1];
+  int b, t;
+
+  for(t = 0; t < thread_num; t++){
+    busy[t] = 0;
+  }
+
+  io.st = st;
+  io.c = 0;
+  io.b = 0;
+  l2_stream_read(&io);
+  for(c = 0; c < st->chunk_num; c++){
+    const unsigned long nc = l2_stream_rows(st, c);
+    b = c % 2;
+    st->view[b].nrow = nc;
+
+    /* read ahead */
+    if(c + 1 < st->chunk_num){
+      io.c = c + 1;
+      io.b = 1 - b;
+      pthread_create(&reader, NULL, l2_stream_read, (void *)&io);
+    }
+
+    if(s < p){
+      kern->update_U(st->U[b], tmp, 0, nc, s,
+		     feature, &(st->view[b]), ckps, gamma, v);
+      sum += tmp[0] * nc;
+      l2_stream_io_full(st->fd, st->U[b], nc * st->real_size,
+			(off_t)(c * st->chunk_bytes +
+				2 * st->chunk * sizeof(unsigned int)), 1);
+    }
+
+    if(worker != NULL){
+      for(t = 0; t < thread_num; t++){
+	params[t].n = nc;
+	params[t].data = &(st->view[b]);
+	params[t].U = st->U[b];
+      }
+      boost_pthread_run(thread_num, worker, params, threads, NULL);
+      for(t = 0; t < thread_num; t++){
+	busy[t] += params[t].busy;
+      }
+      for(j = 0; j < p; j++){
+	acc[j] += col[j];
+      }
+    }
+
+    if(c + 1 < st->chunk_num){
+      pthread_join(reader, NULL);
+    }
+  }
+  return sum / st->n;
+}
+
+int l2_stream_close(l2_stream *st){
+  close(st->fd);
+  free(st->buf[0]);
+  free(st->buf[1]);
+  free(st);
+  return 0;
+}
+
+/* boost_step_dump() of step m to fp and stderr */
+int l2_stream_dump(const cmd_args *args,
+		   const boost *model,
+		   const unsigned int m,
+		   const unsigned long s,
+		   const double step,
+		   const double time_step,
+		   const double time_total,
+		   FILE *fp){
+  boost_step_dump(model, m, s, step, time_step, time_total, fp);
+  fprintf(stderr, "%s [INFO] \t ", args->prog_name);
+  boost_step_dump(model, m, s, step, time_step, time_total, stderr);
+  return 0;
+}
+
+/**
+ * l2_train() over the rows of args->hic_file streamed from disk
+ *  The pass of iteration m applies the step of iteration m - 1, so the
+ *  step of m - 1 is written once its residuals are known, and the last
+ *  step takes a pass of its own.
+ */
+int l2_train_stream(const cmd_args *args,
+		    const double **feature,
+		    const float **feature_f,
+		    const canonical_kp *ckps,
+		    const double v,
+		    boost **model,
+		    FILE *fp){
+  const unsigned long p = ckps->num;
+  const int thread_num = args->thread_num;
+  const l2_kernels *kern = l2_kernels_select(args->precision, args->k);
+  const void *feat =
+    (args->precision == SINGLE) ? (const void *)feature_f : (const void *)feature;
+  unsigned long s = p, n;
+  double gamma = 0, res;
+  double *UdX, *Xnormsq, *col;
+  unsigned int m = 0;
+  int t;
+  double time_start, time_prev, time;
+  /* metrics : bytes touched per (row, column) and per row of a pass
+   * (the chunk is read, U[] written back) */
+  const double bytes_X = 2 * sizeof(unsigned int) + 4 * kern->real_size;
+  const double bytes_UdX = bytes_X + kern->real_size;
+  metrics_phase ph;
+  double *busy = calloc_errchk(thread_num, sizeof(double), "calloc busy[]");
+  cmpUdX_args *params;
+  pthread_t *threads;
+  l2_stream *st;
+
+  UdX     = calloc_errchk(p, sizeof(double), "calloc UdX[]");
+  Xnormsq = calloc_errchk(p, sizeof(double), "calloc Xnormsq[]");
+  col     = calloc_errchk(p, sizeof(double), "calloc col[]");
+
+  l2_stream_open(args, kern, feat, ckps, *model, &st, &(((*model)->res_sq)[0]));
+  n = st->n;
+
+  boost_pthread_prep(thread_num, st->chunk, p,
+		     feat, &(st->view[0]), ckps, NULL,
+		     st->U[0], col, col,
+		     &params, &threads);
+  boost_tile_prep(args, thread_num, st->chunk, kern->real_size,
+		  &(st->view[0]), params);
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "start computation of Xnormsq with %d threads (%s precision, %s kernels, streamed)\n",
+	  thread_num, (args->precision == SINGLE) ? "single" : "double",
+	  (args->k >= L2_K_MIN && args->k <= L2_K_MAX) ?
+	  "k-specialized" : "generic");
+
+  /* compute Xnormsq ||X^{(j)}||^2 */
+  time_prev = trace_now();
+  metrics_begin(&ph);
+  l2_stream_pass(st, kern, feat, ckps, thread_num, params, threads,
+		 kern->cmpXnormsq, col, Xnormsq, p, 0, v, busy);
+  metrics_end(&ph, "Xnormsq", -1, bytes_X * n * p, busy, thread_num);
+  time = trace_now();
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "Xnormsq finished in %f sec.\n", (time - time_prev));
+
+  for(t = 0; t < thread_num; t++){
+    params[t].Xnormsq = Xnormsq;
+  }
+
+  time_prev = time;
+  time_start = time;
+
+  for(m = (*model)->nextiter; m <= (*model)->iternum; m++){
+    metrics_phase ph_iter;
+
+    metrics_begin(&ph_iter);
+
+    /* step of m - 1, then the inner products $U \cdot X^{(j)}$ */
+    metrics_begin(&ph);
+    memset(UdX, 0, p * sizeof(double));
+    res = l2_stream_pass(st, kern, feat, ckps, thread_num, params, threads,
+			 kern->cmpUdX, col, UdX, s, gamma, v, busy);
+    metrics_end(&ph, "UdX", m, bytes_UdX * n * p, busy, thread_num);
+
+    if(s < p){
+      ((*model)->res_sq)[m - 1] = res;
+      time = trace_now();
+      l2_stream_dump(args, *model, m - 1, s, v * gamma,
+		     time - time_prev, time - time_start, fp);
+      time_prev = time;
+    }
+
+    /* select axis */
+    metrics_begin(&ph);
+    s = boost_select_axis((const double *)UdX, (const double *)Xnormsq, p);
+    metrics_end(&ph, "select", m, 2 * sizeof(double) * p, NULL, 0);
+
+    gamma = UdX[s] / Xnormsq[s];
+
+    ((*model)->beta)[s] += v * gamma;
+    metrics_end(&ph_iter, "iteration", m, 0, NULL, 0);
+  }
+
+  if(s < p){
+    /* step of the last iteration */
+    metrics_begin(&ph);
+    res = l2_stream_pass(st, kern, feat, ckps, thread_num, params, threads,
+			 NULL, col, UdX, s, gamma, v, busy);
+    metrics_end(&ph, "update", m - 1, bytes_UdX * n, NULL, 0);
+    ((*model)->res_sq)[m - 1] = res;
+    time = trace_now();
+    l2_stream_dump(args, *model, m - 1, s, v * gamma,
+		   time - time_prev, time - time_start, fp);
+  }
+
+  l2_stream_close(st);
+  boost_tile_free(thread_num, params);
+  free(params);
+  free(threads);
+  free(UdX);
+  free(Xnormsq);
+  free(col);
+
+  {
+    boost_dump_beta((const boost *)*model, p);
+  }
+  free(busy);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,394 @@
+#ifndef __MEMPLAN_H__
+#define __MEMPLAN_H__
+
+/**
+ * memory budget planner (--mem_limit)
+ *  The peak memory of a run is predicted before anything is allocated,
+ *  from k, res, the length of the sequence, the number of Hi-C rows and
+ *  of canonical k-mer pairs (p) :
+ *   - load : the sequence and the feature table (bins x 4^k doubles, and
+ *            its single precision copy while it is made)
+ *   - run  : the sequence, the feature table of the working precision,
+ *            the Hi-C rows, the k-mer pairs, beta (p), then UdX[],
+ *            Xnormsq[] (p) and U[] (n) of l2_train() with the state of
+ *            --shadow, --val, --cand, --screen and --numa, or the two
+ *            chunks of --stream, and pred[] (n) of the prediction
+ *  While the peak exceeds the limit, the options are changed in turn,
+ *  each one kept only if it lowers the peak :
+ *   1. --numa replicate / interleave -> pin (one copy of the data)
+ *   2. --screen off (its reference of UdX[] and its drifts, 2 p doubles)
+ *   3. --precision single (4 byte features and residuals)
+ *   4. --stream C (twin only) with the largest C that fits
+ *  The plan is printed, and the run stops when it does not fit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "constant.h"
+#include "cmd_args.h"
+#include "calloc_errchk.h"
+#include "hic.h"
+#include "kmer.h"
+#include "mywc.h"
+#include "numa_topo.h"
+#include "qio.h"
+
+/* the program, its libraries and the read buffers of qio.h */
+#define MEM_PLAN_BASE (12UL << 20)
+/* fewest rows of a --stream chunk set by the planner */
+#define MEM_PLAN_CHUNK_MIN 1024
+
+typedef struct _mem_plan {
+  /* inputs */
+  unsigned long seq_len;
+  unsigned long bin_num;
+  unsigned long n;
+  unsigned long p;
+  int node_num;
+  /* bytes of the sequence while it is read, then kept */
+  unsigned long seq_read;
+  unsigned long seq;
+  /* bytes of the components */
+  unsigned long features;
+  unsigned long rows;
+  unsigned long pairs;
+  unsigned long model;
+  unsigned long work;
+  /* peaks : load, run and the larger one */
+  unsigned long load;
+  unsigned long run;
+  unsigned long peak;
+} mem_plan;
+
+unsigned long mem_plan_seq_len(const cmd_args *);
+int mem_plan_inputs(const cmd_args *, mem_plan *);
+int mem_plan_estimate(const cmd_args *, const int, const int, mem_plan *);
+int mem_plan_print(const cmd_args *, const int, const mem_plan *);
+int mem_plan_fit(cmd_args *, const int, const int);
+
+static inline double mem_plan_mib(const unsigned long bytes){
+  return bytes / 1048576.0;
+}
+
+/* bases of the first sequence of the fasta file, as fasta_read() */
+unsigned long mem_plan_seq_len(const cmd_args *args){
+  qio *q = qio_open(args->fasta_file, args->thread_num);
+  char buf[QIO_BGZF_BLOCK];
+  unsigned long len = 0;
+  size_t n, c;
+  /* head : on a header line, seqs : headers seen */
+  int bol = 1, head = 0, seqs = 0, done = 0;
+
+  while(done == 0 && (n = qio_read(buf, sizeof(buf), q)) > 0){
+    for(c = 0; c < n; c++){
+      const char ch = buf[c];
+      if(ch == '\n'){
+	bol = 1;
+	head = 0;
+	continue;
+      }
+      if(bol != 0 && ch == '>'){
+	if(++seqs > 1){
+	  done = 1;
+	  break;
+	}
+	head = 1;
+      }else if(head == 0 && !isspace((unsigned char)ch)){
+	len++;
+      }
+      bol = 0;
+    }
+  }
+  qio_close(q);
+  return len;
+}
+
+/* length of the sequence, rows, k-mer pairs and NUMA nodes of the run */
+int mem_plan_inputs(const cmd_args *args,
+		    mem_plan *plan){
+  const unsigned int kmer_num = 1 << (2 * args->k);
+
+  memset(plan, 0, sizeof(mem_plan));
+  plan->seq_len = mem_plan_seq_len(args);
+  plan->bin_num = plan->seq_len / args->res;
+
+  /* fasta_read() doubles its buffer from the size of the file */
+  plan->seq_read = mywc_b(args->fasta_file) + 1;
+  while(plan->seq_read <= plan->seq_len){
+    plan->seq_read *= 2;
+  }
+  plan->seq = plan->seq_len + 1;
+
+  if(args->hic_chr != NULL){
+    /* the rows of a Juicer .hic file are the occupied cells of its
+     * matrix, or at most every pair of bins in the band when the file
+     * does not record them, in arrays grown by doubling */
+    const unsigned long b = plan->bin_num;
+    unsigned long d_min = 0, d_max = (b > 0) ? b - 1 : 0, d, rows = 0;
+    const unsigned long cells = juicer_cells(args);
+    if(args->hic_band > 0){
+      d_min = (args->hic_dmin + args->res - 1) / args->res;
+      d_max = (args->hic_dmax / args->res < d_max) ?
+	args->hic_dmax / args->res : d_max;
+    }
+    for(d = d_min; d <= d_max && d < b; d++){
+      rows += b - d;
+    }
+    if(cells > 0 && cells < rows){
+      rows = cells;
+    }
+    plan->n = 4096;
+    while(plan->n < rows){
+      plan->n *= 2;
+    }
+  }else{
+    hic_file hf;
+    hic_open(args, &hf);
+    plan->n = hf.nrow;
+    hic_close(&hf);
+  }
+
+  if(args->kmer_pair != NULL){
+    plan->p = mywc(args->kmer_pair);
+  }else{
+    /* the kept k-mers are closed under the reverse complement, so that
+     * m of them make m (m + 1) / 2 pairs (see canonical_kp_enum()) */
+    unsigned long m = kmer_num;
+    if(args->exclude != NULL){
+      unsigned char *excluded =
+	kmer_motif_table(args->k, args->exclude, args->prog_name);
+      unsigned int a;
+      for(a = 0; a < kmer_num; a++){
+	m -= excluded[a];
+      }
+      free(excluded);
+    }
+    plan->p = m * (m + 1) / 2;
+  }
+
+  plan->node_num = 1;
+  if(args->numa == NUMA_REPLICATE){
+    numa_topo *topo;
+    numa_topo_probe(args, &topo);
+    plan->node_num = topo->node_num;
+    numa_topo_free(topo);
+  }
+  return 0;
+}
+
+/**
+ * bytes of the run with the options of args
+ *  train : twin (l2_train() or l2_train_stream()), predict : pred, both
+ *  for qloop pipeline
+ */
+int mem_plan_estimate(const cmd_args *args,
+		      const int train,
+		      const int predict,
+		      mem_plan *plan){
+  const unsigned long row_num = 1UL << (2 * args->k);
+  const unsigned long b = plan->bin_num, n = plan->n, p = plan->p;
+  const unsigned long iter = args->iter1 + 1;
+  const unsigned long real_size =
+    (train != 0 && args->precision == SINGLE) ? sizeof(float) : sizeof(double);
+  const unsigned long table_d = b * sizeof(double *) + b * row_num * sizeof(double);
+  const unsigned long table_f = b * sizeof(float *) + b * row_num * sizeof(float);
+  const int single = (real_size == sizeof(float));
+  /* qloop_load() keeps the doubles for --shadow and the pipeline */
+  const int keep = (args->shadow > 0 || predict != 0);
+  const int stream = (train != 0 && args->stream > 0);
+  const unsigned long hic_row = 2 * sizeof(unsigned int) + sizeof(double);
+
+  plan->features = (single != 0) ? table_f + ((keep != 0) ? table_d : 0) : table_d;
+  plan->rows = (stream != 0) ? 0 : n * hic_row;
+  plan->pairs = p * 4 * sizeof(unsigned int);
+  plan->model = p * sizeof(double) + iter * sizeof(double);
+
+  plan->work = 0;
+  if(train != 0 && stream != 0){
+    /* two chunks (i[], j[], U[]) and mij[] of a chunk, UdX[], Xnormsq[]
+     * and the column sums col[] */
+    const unsigned long chunk = ((unsigned long)args->stream < n) ?
+      (unsigned long)args->stream : n;
+    plan->work = 2 * chunk * (2 * sizeof(unsigned int) + real_size) +
+      chunk * sizeof(double) + 3 * p * sizeof(double);
+  }else if(train != 0){
+    plan->work = n * real_size + 2 * p * sizeof(double);
+    if(single != 0 && args->shadow > 0){
+      plan->work += n * sizeof(double) + 2 * p * sizeof(double) +
+	iter * sizeof(double);
+    }
+    if(args->val_frac > 0){
+      /* the training and validation rows are copies */
+      plan->work += n * hic_row + p * sizeof(double) + iter * sizeof(double);
+    }
+    if(args->cand_num > 0 && (unsigned long)args->cand_num < p){
+      /* eval[], stamp[] and the scores sorted by boost_cand_select() */
+      plan->work += p * (sizeof(unsigned long) + sizeof(unsigned int)) +
+	p * (sizeof(double) + sizeof(unsigned long)) +
+	args->cand_num * sizeof(unsigned long);
+    }
+    if(args->screen != 0){
+      plan->work += 2 * p * sizeof(double);
+    }
+    if(args->numa == NUMA_REPLICATE){
+      plan->work += plan->node_num *
+	(b * sizeof(void *) + b * row_num * real_size + n * hic_row);
+    }else if(args->numa == NUMA_INTERLEAVE){
+      plan->work += b * sizeof(void *) + b * row_num * real_size;
+    }
+  }
+  if(predict != 0 && plan->work < n * sizeof(double)){
+    /* pred[] of the prediction, once the training arrays are released */
+    plan->work = n * sizeof(double);
+  }
+
+  plan->load = MEM_PLAN_BASE + plan->seq + table_d +
+    ((single != 0) ? table_f : 0);
+  if(plan->load < MEM_PLAN_BASE + plan->seq_read){
+    plan->load = MEM_PLAN_BASE + plan->seq_read;
+  }
+  plan->run = MEM_PLAN_BASE + plan->seq + plan->features + plan->rows + plan->pairs +
+    plan->model + plan->work;
+  plan->peak = (plan->load > plan->run) ? plan->load : plan->run;
+  return 0;
+}
+
+int mem_plan_print(const cmd_args *args,
+		   const int train,
+		   const mem_plan *plan){
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "memory plan : %.1f MiB (load %.1f MiB), limit %.1f MiB, %s precision, %s\n",
+	  mem_plan_mib(plan->peak), mem_plan_mib(plan->load),
+	  mem_plan_mib(args->mem_limit),
+	  (train != 0 && args->precision == SINGLE) ? "single" : "double",
+	  (train != 0 && args->stream > 0) ? "out of core" : "in memory");
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "  base %.1f MiB, sequence %.1f MiB, features %.1f MiB, Hi-C rows %.1f MiB, k-mer pairs %.1f MiB, model %.1f MiB, work %.1f MiB\n",
+	  mem_plan_mib(MEM_PLAN_BASE), mem_plan_mib(plan->seq), mem_plan_mib(plan->features),
+	  mem_plan_mib(plan->rows), mem_plan_mib(plan->pairs),
+	  mem_plan_mib(plan->model), mem_plan_mib(plan->work));
+  return 0;
+}
+
+/**
+ * plan the run within args->mem_limit (bytes, 0 : no plan), changing
+ * the options of args as above; exits when the run does not fit
+ */
+int mem_plan_fit(cmd_args *args,
+		 const int train,
+		 const int predict){
+  const unsigned long limit = args->mem_limit;
+  mem_plan plan;
+  unsigned long peak;
+  int changed = 0;
+
+  if(args->mem_limit <= 0){
+    return 0;
+  }
+  mem_plan_inputs(args, &plan);
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "memory plan : %ld bins x %d k-mers, %ld Hi-C rows, %ld k-mer pairs\n",
+	  plan.bin_num, 1 << (2 * args->k), plan.n, plan.p);
+  mem_plan_estimate(args, train, predict, &plan);
+  mem_plan_print(args, train, &plan);
+  peak = plan.peak;
+
+  /* 1. one copy of the data */
+  if(peak > limit && train != 0 &&
+     (args->numa == NUMA_REPLICATE || args->numa == NUMA_INTERLEAVE)){
+    const numa_mode numa = args->numa;
+    args->numa = NUMA_PIN;
+    mem_plan_estimate(args, train, predict, &plan);
+    if(plan.peak < peak){
+      fprintf(stderr, "%s [INFO] ", args->prog_name);
+      fprintf(stderr, "memory plan : --numa pin (%.1f MiB)\n",
+	      mem_plan_mib(plan.peak));
+      peak = plan.peak;
+      changed++;
+    }else{
+      args->numa = numa;
+    }
+  }
+
+  /* 2. no screening state */
+  if(peak > limit && train != 0 && args->screen != 0){
+    args->screen = 0;
+    mem_plan_estimate(args, train, predict, &plan);
+    if(plan.peak < peak){
+      fprintf(stderr, "%s [INFO] ", args->prog_name);
+      fprintf(stderr, "memory plan : --screen off (%.1f MiB)\n",
+	      mem_plan_mib(plan.peak));
+      peak = plan.peak;
+      changed++;
+    }else{
+      args->screen = 1;
+    }
+  }
+
+  /* 3. single precision features and residuals */
+  if(peak > limit && train != 0 && args->precision == DOUBLE){
+    args->precision = SINGLE;
+    mem_plan_estimate(args, train, predict, &plan);
+    if(plan.peak < peak){
+      fprintf(stderr, "%s [INFO] ", args->prog_name);
+      fprintf(stderr, "memory plan : --precision single (%.1f MiB)\n",
+	      mem_plan_mib(plan.peak));
+      peak = plan.peak;
+      changed++;
+    }else{
+      args->precision = DOUBLE;
+    }
+  }
+
+  /* 4. out of core, the largest chunk that fits */
+  if(peak > limit && train != 0 && predict == 0 &&
+     args->val_frac == 0 && args->cand_num == 0 && args->shadow == 0 &&
+     args->screen == 0 && args->hic_chr == NULL &&
+     (args->numa == NUMA_OFF || args->numa == NUMA_PIN)){
+    const int stream = args->stream;
+    const unsigned long real_size =
+      (args->precision == SINGLE) ? sizeof(float) : sizeof(double);
+    const unsigned long row_bytes =
+      2 * (2 * sizeof(unsigned int) + real_size) + sizeof(double);
+    unsigned long chunk = 0;
+
+    /* the run of chunks of one row, plus row_bytes a row */
+    args->stream = 1;
+    mem_plan_estimate(args, train, predict, &plan);
+    if(plan.run < limit && plan.load <= limit){
+      chunk = (limit - plan.run) / row_bytes + 1;
+      chunk = (chunk < plan.n) ? chunk : plan.n;
+      if(stream > 0 && (unsigned long)stream < chunk){
+	chunk = stream;
+      }
+    }
+    if(chunk >= MEM_PLAN_CHUNK_MIN || (chunk > 0 && chunk == plan.n)){
+      args->stream = chunk;
+      args->numa = NUMA_OFF;
+      mem_plan_estimate(args, train, predict, &plan);
+      fprintf(stderr, "%s [INFO] ", args->prog_name);
+      fprintf(stderr, "memory plan : --stream %d (%.1f MiB)\n",
+	      args->stream, mem_plan_mib(plan.peak));
+      peak = plan.peak;
+      changed++;
+    }else{
+      args->stream = stream;
+    }
+  }
+
+  if(peak > limit){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "memory plan : %.1f MiB exceeds mem_limit (%.1f MiB)\n",
+	    mem_plan_mib(peak), mem_plan_mib(limit));
+    exit(EXIT_FAILURE);
+  }
+  if(changed > 0){
+    mem_plan_estimate(args, train, predict, &plan);
+    mem_plan_print(args, train, &plan);
+  }
+  return 0;
+}
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+/**
+ * metrics sink (--metrics FILE)
+ *  one JSON object per line:
+ *   {"event": "run", ...}    : program, parameters and start time
+ *   {"event": "phase", ...}  : a phase (iter = -1 outside of the boosting
+ *                              iterations) with its wall / CPU time,
+ *                              bytes touched and effective bandwidth,
+ *                              the busy time of the workers and the
+ *                              load imbalance (max / mean busy time) of a
+ *                              threaded phase, and the peak RSS
+ *   {"event": "end", ...}    : totals
+ *  With --perf, a phase also reports the hardware counters (see
+ *  perfctr.h) of the main thread and of the workers that ran in it
+ *  (metrics_perf_add()).
+ *  The phases are also spans of the timeline with --trace (trace.h).
+ *  Every function is a no-op unless metrics_open() opened the sink or
+ *  trace_open() the timeline.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "cmd_args.h"
+#include "perfctr.h"
+#include "trace.h"
+
+typedef struct _metrics_phase{
+  double wall;
+  double cpu;
+  /* counters of the main thread at the beginning (--perf) */
+  perf_counts perf;
+} metrics_phase;
+
+typedef struct _metrics_sink{
+  FILE *fp;
+  metrics_phase start;
+  /* counters of the main thread, and of the workers of the phase */
+  perf_group perf;
+  perf_counts perf_workers;
+} metrics_sink;
+
+static metrics_sink metrics_global;
+
+int metrics_open(const cmd_args *args);
+int metrics_close(void);
+int metrics_enabled(void);
+void metrics_begin(metrics_phase *ph);
+void metrics_perf_add(const perf_counts *c);
+void metrics_end(const metrics_phase *ph,
+		 const char *name,
+		 const long iter,
+		 const double bytes,
+		 const double *busy,
+		 const int busy_num);
+
+/* user + system time of the process, seconds */
+static double metrics_cpu(void){
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 +
+    ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+}
+
+/* peak resident set size, kB */
+static long metrics_rss_peak(void){
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_maxrss;
+}
+
+int metrics_enabled(void){
+  return metrics_global.fp != NULL;
+}
+
+int metrics_open(const cmd_args *args){
+  if(args->metrics_file == NULL){
+    return 0;
+  }
+  if((metrics_global.fp = fopen(args->metrics_file, "w")) == NULL){
+    fprintf(stderr, "error: fopen %s\n%s\n",
+	    args->metrics_file, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  if(perf_init(args) > 0){
+    perf_open(&metrics_global.perf);
+  }
+  metrics_begin(&metrics_global.start);
+  fprintf(metrics_global.fp,
+	  "{\"event\": \"run\", \"prog\": \"%s\", \"time\": %ld, "
+	  "\"k\": %d, \"res\": %d, \"iter1\": %d, \"iter2\": %d, "
+	  "\"threads\": %d, \"precision\": \"%s\"}\n",
+	  args->prog_name, (long)time(NULL), args->k, args->res,
+	  args->iter1, args->iter2, args->thread_num,
+	  (args->precision == SINGLE) ? "single" : "double");
+  fflush(metrics_global.fp);
+  return 0;
+}
+
+int metrics_close(void){
+  if(metrics_global.fp == NULL){
+    return 0;
+  }
+  fprintf(metrics_global.fp,
+	  "{\"event\": \"end\", \"wall_s\": %f, \"cpu_s\": %f, "
+	  "\"rss_peak_kb\": %ld}\n",
+	  trace_now() - metrics_global.start.wall,
+	  metrics_cpu() - metrics_global.start.cpu,
+	  metrics_rss_peak());
+  fclose(metrics_global.fp);
+  metrics_global.fp = NULL;
+  if(perf_enabled()){
+    perf_close(&metrics_global.perf);
+  }
+  return 0;
+}
+
+void metrics_begin(metrics_phase *ph){
+  if(metrics_global.fp == NULL){
+    ph->wall = trace_enabled() ? trace_now() : 0;
+    return;
+  }
+  ph->wall = trace_now();
+  ph->cpu = metrics_cpu();
+  if(perf_enabled()){
+    perf_read(&metrics_global.perf, &ph->perf);
+    perf_counts_clear(&metrics_global.perf_workers);
+  }
+}
+
+/* fold the counters of a worker into the current phase */
+void metrics_perf_add(const perf_counts *c){
+  if(metrics_global.fp != NULL && perf_enabled()){
+    perf_counts_add(&metrics_global.perf_workers, c);
+  }
+}
+
+/**
+ * close the phase started by metrics_begin(ph)
+ *  bytes : bytes touched (0 : unknown)
+ *  busy  : busy time (s) of each of the busy_num workers (NULL : serial)
+ */
+void metrics_end(const metrics_phase *ph,
+		 const char *name,
+		 const long iter,
+		 const double bytes,
+		 const double *busy,
+		 const int busy_num){
+  const double now = (metrics_global.fp != NULL || trace_enabled()) ?
+    trace_now() : 0;
+  const double wall = now - ph->wall;
+  FILE *fp = metrics_global.fp;
+  trace_span(name, iter, ph->wall, now);
+  if(fp == NULL){
+    return;
+  }
+
+  fprintf(fp, "{\"event\": \"phase\", \"name\": \"%s\", \"iter\": %ld, "
+	  "\"wall_s\": %e, \"cpu_s\": %e",
+	  name, iter, wall, metrics_cpu() - ph->cpu);
+  if(bytes > 0){
+    fprintf(fp, ", \"bytes\": %.0f, \"gb_per_s\": %e",
+	    bytes, (wall > 0) ? bytes / wall / 1e9 : 0);
+  }
+  if(busy != NULL && busy_num > 0){
+    double max = 0, sum = 0;
+    int t;
+    fprintf(fp, ", \"busy_s\": [");
+    for(t = 0; t < busy_num; t++){
+      fprintf(fp, "%s%e", (t == 0) ? "" : ", ", busy[t]);
+      sum += busy[t];
+      max = (busy[t] > max) ? busy[t] : max;
+    }
+    fprintf(fp, "], \"imbalance\": %f",
+	    (sum > 0) ? max * busy_num / sum : 1.0);
+  }
+  if(perf_enabled()){
+    perf_counts now, c;
+    int e;
+    perf_read(&metrics_global.perf, &now);
+    perf_counts_diff(&c, &ph->perf, &now);
+    perf_counts_add(&c, &metrics_global.perf_workers);
+    fprintf(fp, ", \"perf\": {");
+    for(e = 0; e < PERF_NUM; e++){
+      if(c.val[e] < 0){
+	fprintf(fp, "\"%s\": null, ", perf_names[e]);
+      }else{
+	fprintf(fp, "\"%s\": %.0f, ", perf_names[e], c.val[e]);
+      }
+    }
+    if(c.val[0] > 0 && c.val[1] >= 0){
+      fprintf(fp, "\"ipc\": %f}", c.val[1] / c.val[0]);
+    }else{
+      fprintf(fp, "\"ipc\": null}");
+    }
+  }
+  fprintf(fp, ", \"rss_peak_kb\": %ld}\n", metrics_rss_peak());
+}
+
+#endif
@@ -0,0 +1,369 @@
+#ifndef __NUMA_TOPO_H__
+#define __NUMA_TOPO_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "constant.h"
+#include "calloc_errchk.h"
+#include "cmd_args.h"
+#include "hic.h"
+
+/**
+ * This header file contains some functions to perform the following tasks
+ * - probe the NUMA topology from sysfs (no libnuma)
+ * - pin worker threads to cores
+ * - place a copy of the feature table and of the Hi-C coordinates on the
+ *   memory of every node (first touch by a thread pinned on that node)
+ */
+
+#define NUMA_SYSFS "/sys/devices/system/node"
+#define NUMA_MAX_NODES 64
+
+typedef struct _numa_topo{
+  int node_num;
+  int *cpu_num;   /* number of cpus on each node */
+  int **cpus;     /* cpu ids on each node */
+} numa_topo;
+
+/* data placed on one node */
+typedef struct _numa_replica{
+  unsigned long bin_num;
+  const void **feature;
+  /* block holding the rows (see features_block()) */
+  void *block;
+  hic data;
+} numa_replica;
+
+int numa_parse_cpulist(const char *, int **);
+int numa_topo_probe(const cmd_args *, numa_topo **);
+int numa_topo_free(numa_topo *);
+int numa_worker_cpu(const numa_topo *, const int, const int, int *);
+int numa_attr_prep(const numa_topo *, const int, pthread_attr_t **, int **);
+int numa_replicate(const cmd_args *, const numa_topo *,
+		   const void **, const size_t, const hic *,
+		   numa_replica **);
+int numa_replica_free(const cmd_args *, const numa_topo *, numa_replica *);
+
+/**
+ * parse a sysfs cpulist ("0-3,8-11") and return the number of cpus
+ */
+int numa_parse_cpulist(const char *list,
+		       int **cpus){
+  int num = 0, size = 16, first, last, c;
+  const char *ptr = list;
+  char *end;
+
+  *cpus = calloc_errchk(size, sizeof(int), "calloc cpus[]");
+  while(*ptr != '\0' && *ptr != '\n'){
+    first = last = (int)strtol(ptr, &end, 10);
+    if(end == ptr){
+      break;
+    }
+    ptr = end;
+    if(*ptr == '-'){
+      last = (int)strtol(ptr + 1, &end, 10);
+      ptr = end;
+    }
+    for(c = first; c <= last; c++){
+      if(num == size){
+	size *= 2;
+	if((*cpus = realloc(*cpus, size * sizeof(int))) == NULL){
+	  fprintf(stderr, "realloc: cpus\n");
+	  exit(EXIT_FAILURE);
+	}
+      }
+      (*cpus)[num++] = c;
+    }
+    if(*ptr == ','){
+      ptr++;
+    }
+  }
+  return num;
+}
+
+/**
+ * read /sys/devices/system/node/node<N>/cpulist
+ *  (falls back to a single node with every online cpu)
+ */
+int numa_topo_probe(const cmd_args *args,
+		    numa_topo **topo){
+  char file_name[F_NAME_LEN], buf[BUF_SIZE * 16];
+  int id, node;
+  FILE *fp;
+
+  *topo = calloc_errchk(1, sizeof(numa_topo), "calloc numa_topo");
+  (*topo)->cpu_num = calloc_errchk(NUMA_MAX_NODES, sizeof(int),
+				   "calloc numa_topo->cpu_num");
+  (*topo)->cpus = calloc_errchk(NUMA_MAX_NODES, sizeof(int *),
+				"calloc numa_topo->cpus");
+
+  for(id = 0; id < NUMA_MAX_NODES; id++){
+    sprintf(file_name, "%s/node%d/cpulist", NUMA_SYSFS, id);
+    if((fp = fopen(file_name, "r")) == NULL){
+      break;
+    }
+    node = (*topo)->node_num;
+    if(fgets(buf, sizeof(buf), fp) != NULL){
+      (*topo)->cpu_num[node] =
+	numa_parse_cpulist(buf, &((*topo)->cpus[node]));
+    }
+    fclose(fp);
+    if((*topo)->cpu_num[node] == 0){
+      /* memory-only node */
+      free((*topo)->cpus[node]);
+      (*topo)->cpus[node] = NULL;
+    }else{
+      (*topo)->node_num++;
+    }
+  }
+
+  if((*topo)->node_num == 0){
+    int c;
+    (*topo)->node_num = 1;
+    (*topo)->cpu_num[0] = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    (*topo)->cpus[0] = calloc_errchk((*topo)->cpu_num[0], sizeof(int),
+				     "calloc numa_topo->cpus[0]");
+    for(c = 0; c < (*topo)->cpu_num[0]; c++){
+      (*topo)->cpus[0][c] = c;
+    }
+  }
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "NUMA topology: %d node(s)", (*topo)->node_num);
+  for(node = 0; node < (*topo)->node_num; node++){
+    fprintf(stderr, " %s%d cpus", (node == 0) ? "" : "/ ",
+	    (*topo)->cpu_num[node]);
+  }
+  fprintf(stderr, "\n");
+
+  return 0;
+}
+
+int numa_topo_free(numa_topo *topo){
+  int node;
+  for(node = 0; node < topo->node_num; node++){
+    free(topo->cpus[node]);
+  }
+  free(topo->cpus);
+  free(topo->cpu_num);
+  free(topo);
+  return 0;
+}
+
+/**
+ * cpu of worker w out of worker_num: workers are spread in contiguous
+ * blocks over the nodes, so that neighbouring column blocks share a node
+ */
+int numa_worker_cpu(const numa_topo *topo,
+		    const int w,
+		    const int worker_num,
+		    int *node){
+  const int nd = (int)(((long)w * topo->node_num) / worker_num);
+  /* first worker placed on node nd */
+  const int first =
+    (int)(((long)nd * worker_num + topo->node_num - 1) / topo->node_num);
+  *node = nd;
+  return topo->cpus[nd][(w - first) % topo->cpu_num[nd]];
+}
+
+/**
+ * thread attributes pinning worker w to numa_worker_cpu(w)
+ *  node[w] receives the node of worker w
+ */
+int numa_attr_prep(const numa_topo *topo,
+		   const int worker_num,
+		   pthread_attr_t **attrs,
+		   int **node){
+  int w, cpu;
+  cpu_set_t set;
+
+  *attrs = calloc_errchk(worker_num, sizeof(pthread_attr_t),
+			 "calloc pthread_attr_t[]");
+  *node = calloc_errchk(worker_num, sizeof(int), "calloc node[]");
+  for(w = 0; w < worker_num; w++){
+    cpu = numa_worker_cpu(topo, w, worker_num, &((*node)[w]));
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_attr_init(&((*attrs)[w]));
+    pthread_attr_setaffinity_np(&((*attrs)[w]), sizeof(cpu_set_t), &set);
+  }
+  return 0;
+}
+
+/* arguments of numa_replicate_node() */
+typedef struct _numa_replicate_args{
+  const cmd_args *args;
+  const void **feature;
+  size_t real_size;
+  const hic *data;
+  unsigned long bin_num;
+  /* bins [bin_begin, bin_end) are copied by this node */
+  unsigned long bin_begin;
+  unsigned long bin_end;
+  /* replicate the Hi-C coordinates as well */
+  int copy_data;
+  numa_replica *target;
+  numa_replica *replica;
+} numa_replicate_args;
+
+/* runs on a thread pinned to the target node: the copies are first
+ * touched (and therefore placed) there */
+void *numa_replicate_node(void *args){
+  const numa_replicate_args *params = (numa_replicate_args *)args;
+  const size_t row_size =
+    ((size_t)1 << (2 * params->args->k)) * params->real_size;
+  void **target = (void **)params->target->feature;
+  unsigned long bin;
+
+  if(params->target->block == NULL){
+    /* the pages of the block are placed by the memcpy() below */
+    params->target->block = malloc(params->bin_num * row_size);
+    if(params->target->block == NULL){
+      perror("malloc numa replica");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for(bin = params->bin_begin; bin < params->bin_end; bin++){
+    if((params->feature)[bin] != NULL){
+      target[bin] = (char *)params->target->block + bin * row_size;
+      memcpy(target[bin], (params->feature)[bin], row_size);
+    }
+  }
+
+  if(params->copy_data != 0){
+    const unsigned long n = params->data->nrow;
+    hic *data = &(params->replica->data);
+    data->nrow = n;
+    data->i = malloc(n * sizeof(unsigned int));
+    data->j = malloc(n * sizeof(unsigned int));
+    if(data->i == NULL || data->j == NULL){
+      perror("malloc numa replica");
+      exit(EXIT_FAILURE);
+    }
+    memcpy(data->i, params->data->i, n * sizeof(unsigned int));
+    memcpy(data->j, params->data->j, n * sizeof(unsigned int));
+    data->mij = params->data->mij;
+  }
+  return NULL;
+}
+
+/**
+ * place the feature rows referenced by data on the NUMA nodes
+ *  NUMA_REPLICATE  : one copy of the rows and of data->{i,j} per node
+ *  NUMA_INTERLEAVE : one copy of the rows, blocks of bins first-touched
+ *                    by successive nodes
+ *  replica[node] is used by the workers of that node
+ */
+int numa_replicate(const cmd_args *args,
+		   const numa_topo *topo,
+		   const void **feature,
+		   const size_t real_size,
+		   const hic *data,
+		   numa_replica **replica){
+  const int node_num = topo->node_num;
+  const int copies = (args->numa == NUMA_REPLICATE) ? node_num : 1;
+  const size_t row_size = ((size_t)1 << (2 * args->k)) * real_size;
+  unsigned long bin_num;
+  numa_replicate_args *params;
+  pthread_attr_t *attrs;
+  pthread_t *threads;
+  cpu_set_t set;
+  int node;
+
+  /* only the rows referenced by the Hi-C data are placed */
+  bin_num = hic_bin_num(data);
+
+  *replica = calloc_errchk(node_num, sizeof(numa_replica),
+			   "calloc numa_replica[]");
+  params = calloc_errchk(node_num, sizeof(numa_replicate_args),
+			 "calloc numa_replicate_args[]");
+  attrs = calloc_errchk(node_num, sizeof(pthread_attr_t),
+			"calloc pthread_attr_t[]");
+  threads = calloc_errchk(node_num, sizeof(pthread_t), "calloc threads[]");
+
+  for(node = 0; node < copies; node++){
+    (*replica)[node].bin_num = bin_num;
+    (*replica)[node].feature = calloc_errchk(bin_num, sizeof(void *),
+					     "calloc numa_replica->feature");
+  }
+  if(args->numa == NUMA_INTERLEAVE){
+    /* one shared block, first touched bin block by bin block */
+    (*replica)[0].block = malloc(bin_num * row_size);
+    if((*replica)[0].block == NULL){
+      perror("malloc numa replica");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for(node = 0; node < node_num; node++){
+    params[node].args = args;
+    params[node].feature = feature;
+    params[node].real_size = real_size;
+    params[node].data = data;
+    params[node].bin_num = bin_num;
+    if(args->numa == NUMA_REPLICATE){
+      params[node].bin_begin = 0;
+      params[node].bin_end = bin_num;
+      params[node].copy_data = 1;
+      params[node].target = &((*replica)[node]);
+    }else{
+      params[node].bin_begin = (bin_num / node_num) * node;
+      params[node].bin_end =
+	(node == node_num - 1) ? bin_num : (bin_num / node_num) * (node + 1);
+      params[node].copy_data = 0;
+      params[node].target = &((*replica)[0]);
+      /* every node shares the interleaved table and the original data */
+      (*replica)[node].bin_num = bin_num;
+      (*replica)[node].feature = (*replica)[0].feature;
+      (*replica)[node].block = (*replica)[0].block;
+      (*replica)[node].data = *data;
+    }
+    params[node].replica = &((*replica)[node]);
+
+    CPU_ZERO(&set);
+    CPU_SET(topo->cpus[node][0], &set);
+    pthread_attr_init(&attrs[node]);
+    pthread_attr_setaffinity_np(&attrs[node], sizeof(cpu_set_t), &set);
+    pthread_create(&threads[node], &attrs[node],
+		   numa_replicate_node, (void *)&params[node]);
+  }
+  for(node = 0; node < node_num; node++){
+    pthread_join(threads[node], NULL);
+    pthread_attr_destroy(&attrs[node]);
+  }
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "feature table (%ld bins) %s over %d NUMA node(s)\n",
+	  bin_num,
+	  (args->numa == NUMA_REPLICATE) ? "replicated" : "interleaved",
+	  node_num);
+
+  free(params);
+  free(attrs);
+  free(threads);
+  return 0;
+}
+
+int numa_replica_free(const cmd_args *args,
+		      const numa_topo *topo,
+		      numa_replica *replica){
+  const int copies = (args->numa == NUMA_REPLICATE) ? topo->node_num : 1;
+  int node;
+  for(node = 0; node < copies; node++){
+    free(replica[node].block);
+    if(args->numa == NUMA_REPLICATE){
+      free(replica[node].data.i);
+      free(replica[node].data.j);
+    }
+    free(replica[node].feature);
+  }
+  free(replica);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef __PERFCTR_H__
+#define __PERFCTR_H__
+
+/**
+ * hardware performance counters (--perf, reported by metrics.h)
+ *  counters of the calling thread, user space only, opened with
+ *  perf_event_open(2). An event the CPU or the kernel does not provide
+ *  is skipped (its count is reported as null), and when none of them can
+ *  be opened (e.g. kernel.perf_event_paranoid, containers) the counters
+ *  are disabled with a warning and the run goes on.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "cmd_args.h"
+
+#define PERF_NUM 4
+
+typedef struct _perf_group{
+  int fd[PERF_NUM];
+} perf_group;
+
+/* counts of one thread or sums over threads (< 0 : not available) */
+typedef struct _perf_counts{
+  double val[PERF_NUM];
+} perf_counts;
+
+static const char *perf_names[PERF_NUM] = {
+  "cycles", "instructions", "llc_misses", "dtlb_misses"
+};
+
+static int perf_on = 0;
+
+int perf_init(const cmd_args *args);
+int perf_enabled(void);
+int perf_open(perf_group *g);
+void perf_close(perf_group *g);
+void perf_read(const perf_group *g,
+	       perf_counts *c);
+void perf_counts_clear(perf_counts *c);
+void perf_counts_add(perf_counts *sum,
+		     const perf_counts *c);
+void perf_counts_diff(perf_counts *c,
+		      const perf_counts *from,
+		      const perf_counts *to);
+void perf_thread_begin(perf_group *g,
+		       perf_counts *start);
+void perf_thread_end(perf_group *g,
+		     const perf_counts *start,
+		     perf_counts *c);
+
+static int perf_event_open_(const unsigned int type,
+			    const unsigned long long config){
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  /* scaled by enabled / running time when the PMU is multiplexed */
+  attr.read_format =
+    PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+int perf_open(perf_group *g){
+  const unsigned long long llc = PERF_COUNT_HW_CACHE_LL |
+    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  const unsigned long long dtlb = PERF_COUNT_HW_CACHE_DTLB |
+    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  int e, num = 0;
+  g->fd[0] = perf_event_open_(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  g->fd[1] = perf_event_open_(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  g->fd[2] = perf_event_open_(PERF_TYPE_HW_CACHE, llc);
+  g->fd[3] = perf_event_open_(PERF_TYPE_HW_CACHE, dtlb);
+  for(e = 0; e < PERF_NUM; e++){
+    num += (g->fd[e] >= 0);
+  }
+  return num;
+}
+
+void perf_close(perf_group *g){
+  int e;
+  for(e = 0; e < PERF_NUM; e++){
+    if(g->fd[e] >= 0){
+      close(g->fd[e]);
+      g->fd[e] = -1;
+    }
+  }
+}
+
+/* the counters run from perf_open() on : phases take differences */
+void perf_read(const perf_group *g,
+	       perf_counts *c){
+  int e;
+  for(e = 0; e < PERF_NUM; e++){
+    unsigned long long buf[3];
+    c->val[e] = -1;
+    if(g->fd[e] >= 0 && read(g->fd[e], buf, sizeof(buf)) == sizeof(buf)){
+      c->val[e] = (buf[2] > 0) ?
+	(double)buf[0] * ((double)buf[1] / buf[2]) : 0;
+    }
+  }
+}
+
+void perf_counts_clear(perf_counts *c){
+  int e;
+  for(e = 0; e < PERF_NUM; e++){
+    c->val[e] = 0;
+  }
+}
+
+void perf_counts_add(perf_counts *sum,
+		     const perf_counts *c){
+  int e;
+  for(e = 0; e < PERF_NUM; e++){
+    sum->val[e] = (sum->val[e] < 0 || c->val[e] < 0) ?
+      -1 : sum->val[e] + c->val[e];
+  }
+}
+
+void perf_counts_diff(perf_counts *c,
+		      const perf_counts *from,
+		      const perf_counts *to){
+  int e;
+  for(e = 0; e < PERF_NUM; e++){
+    c->val[e] = (from->val[e] < 0 || to->val[e] < 0) ?
+      -1 : to->val[e] - from->val[e];
+  }
+}
+
+/**
+ * count the calling (worker) thread from perf_thread_begin() to
+ * perf_thread_end(), which closes the counters : c := counts
+ */
+void perf_thread_begin(perf_group *g,
+		       perf_counts *start){
+  perf_open(g);
+  perf_read(g, start);
+}
+
+void perf_thread_end(perf_group *g,
+		     const perf_counts *start,
+		     perf_counts *c){
+  perf_counts now;
+  perf_read(g, &now);
+  perf_counts_diff(c, start, &now);
+  perf_close(g);
+}
+
+int perf_enabled(void){
+  return perf_on;
+}
+
+/* probe the counters once (on the calling thread) */
+int perf_init(const cmd_args *args){
+  perf_group g;
+  int e, num;
+  if(args->perf == 0){
+    return 0;
+  }
+  num = perf_open(&g);
+  if(num == 0){
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "perf_event_open: %s, hardware counters are disabled\n",
+	    strerror(errno));
+    return 0;
+  }
+  for(e = 0; e < PERF_NUM; e++){
+    if(g.fd[e] < 0){
+      fprintf(stderr, "%s [INFO] ", args->prog_name);
+      fprintf(stderr, "counter %s is not available\n", perf_names[e]);
+    }
+  }
+  perf_close(&g);
+  perf_on = 1;
+  return num;
+}
+
+#endif
@@ -35,14 +35,6 @@ int predict(const cmd_args *args,
 	    FILE *fp){
   const unsigned long n = data->nrow;
   const unsigned long p = ckps->num;
-  const unsigned int *h_i = data->i;
-  const unsigned int *h_j = data->j;
-  const unsigned int *kmer1 = ckps->kmer1;
-  const unsigned int *kmer2 = ckps->kmer2;
-  const unsigned int *revcmp1 = ckps->revcmp1;
-  const unsigned int *revcmp2 = ckps->revcmp2;
-  unsigned long i, j;
-  double pf;
 
   fprintf(fp, "%s [INFO] ", args->prog_name);
   fprintf(fp, "start prediction of interatcion intensities \n");
@@ -51,18 +43,10 @@ int predict(const cmd_args *args,
   *pred = calloc_errchk(n, sizeof(double),
 			"calloc pred[]");
 
-  /* pf : pairwise feature */
-  for(j = 0; j < p; j++){
-    if((model->beta[j]) != 0){
-      for(i = 0; i < n; i++){
-	pf =  ((feature[h_i[i]][kmer1[j]] *
-		feature[h_j[i]][kmer2[j]]) +
-	       (feature[h_i[i]][revcmp1[j]] *
-		feature[h_j[i]][revcmp2[j]]));
-	(*pred)[i] += (model->beta)[j] * pf;
-      }
-    }
-  }
+  /* pred[i] = \sum_j beta[j] X^{(j)}_i */
+  l2_kernels_select(DOUBLE, args->k)->predict(*pred, n, p, model->beta,
+					      (const void *)feature,
+					      data, ckps);
 
   return 0;
 }
@@ -0,0 +1,613 @@
+#ifndef __PREP_H__
+#define __PREP_H__
+
+/**
+ * qloop prep : the Hi-C input of twin and pred from a contact list of
+ * raw counts (.RAWobserved, rows "i\tj\tcount" with i, j in bp), as
+ * src/hic_prep.py
+ *  - the rows with min <= |i - j| <= max (bp) whose bins i / res and
+ *    j / res are free of N in --fasta (margin bp around the bin, the
+ *    first and the last bins excluded) and covered by the intervals of
+ *    the chromosome in --bed are kept
+ *  - with --norm and --exp, mij = count / (norm[i] norm[j] exp[|j - i|])
+ *    (indices : bp / res), its log_2 with --log, standardized to
+ *    N(0, 1) with --distnorm; rows with a non-finite mij are dropped
+ * The raw file is read once, in blocks of PREP_BLOCK rows that are
+ * filtered and converted array by array; the raw file and the fasta
+ * file can be gzip or BGZF compressed (see qio.h, inflated on all the
+ * online CPUs). The N of the chromosome are
+ * kept as a bit mask (one bit per base), so that a bin is checked 64
+ * bases at a time. The rows are written as they come, in text or in the
+ * binary format of hic.h (--binary); --distnorm holds the rows kept
+ * until their mean and standard deviation are known.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "constant.h"
+#include "calloc_errchk.h"
+#include "hic.h"
+#include "qio.h"
+
+/* rows of the raw file filtered and converted at a time */
+#define PREP_BLOCK 4096
+
+typedef struct _prep_args {
+  char *in_file;
+  char *out_file;
+  char *chr;
+  unsigned long res;
+  unsigned long margin;
+  unsigned long min;
+  unsigned long max;
+  char *fasta_file;
+  char *bed_file;
+  char *norm_file;
+  char *exp_file;
+  int log;
+  int distnorm;
+  /* binary output (see hic.h) */
+  int binary;
+  char *prog_name;
+} prep_args;
+
+/* per-bin tables of the filters and of the conversion (NULL : off) */
+typedef struct _prep_tables {
+  unsigned char *gap;
+  unsigned long gap_num;
+  unsigned char *bed;
+  unsigned long bed_num;
+  double *norm;
+  unsigned long norm_num;
+  double *exp;
+  unsigned long exp_num;
+} prep_tables;
+
+int prep_usage(FILE *, const char *);
+unsigned long prep_lenstr(const char *);
+int prep_args_parse(const int, char **, prep_args *);
+double *prep_vector(const prep_args *, const char *, unsigned long *);
+unsigned char *prep_gap(const prep_args *, unsigned long *);
+unsigned char *prep_bed(const prep_args *, unsigned long *);
+int prep_run(const prep_args *);
+int qloop_prep_main(int argc, char **argv);
+
+int prep_usage(FILE *fp,
+	       const char *prog_name){
+  fprintf(fp, "%s [INFO] ", prog_name);
+  fprintf(fp, "usage:\n");
+  fprintf(fp,
+	  "%s -i raw -r res [-o o] [-c chr] [-a margin] [-m min] [-M max] [-f fasta] [-b bed] [-n norm] [-e exp] [-l] [-d] [--binary] \n",
+	  prog_name);
+  return 0;
+}
+
+/* length with a k, M or G suffix (as lenstr2int() of hic_prep.py) */
+unsigned long prep_lenstr(const char *str){
+  char *end;
+  unsigned long len = strtoul(str, &end, 10);
+  switch(*end){
+    case 'k': case 'K': return len * 1000UL;
+    case 'm': case 'M': return len * 1000000UL;
+    case 'g': case 'G': return len * 1000000000UL;
+    default: return len;
+  }
+}
+
+int prep_args_parse(const int argc, char **argv,
+		    prep_args *pargs){
+  int opt, opt_idx = 0, errflag = 0;
+  struct option long_opts[] = {
+    {"help",     no_argument,       NULL, 'h'},
+    {"input",    required_argument, NULL, 'i'},
+    {"output",   required_argument, NULL, 'o'},
+    {"chr",      required_argument, NULL, 'c'},
+    {"res",      required_argument, NULL, 'r'},
+    {"margin",   required_argument, NULL, 'a'},
+    {"min",      required_argument, NULL, 'm'},
+    {"max",      required_argument, NULL, 'M'},
+    {"fasta",    required_argument, NULL, 'f'},
+    {"bed",      required_argument, NULL, 'b'},
+    {"norm",     required_argument, NULL, 'n'},
+    {"exp",      required_argument, NULL, 'e'},
+    {"log",      no_argument,       NULL, 'l'},
+    {"distnorm", no_argument,       NULL, 'd'},
+    {"binary",   no_argument,       NULL, 'B'},
+    {0, 0, 0, 0}
+  };
+
+  memset(pargs, 0, sizeof(prep_args));
+  pargs->max = (unsigned long)-1;
+  pargs->prog_name = argv[0];
+
+  while((opt = getopt_long(argc, argv, "hi:o:c:r:a:m:M:f:b:n:e:ldB",
+			   long_opts, &opt_idx)) != -1){
+    switch(opt){
+      case 'h':
+	prep_usage(stdout, argv[0]);
+	exit(EXIT_SUCCESS);
+      case 'i': pargs->in_file = optarg; break;
+      case 'o': pargs->out_file = optarg; break;
+      case 'c': pargs->chr = optarg; break;
+      case 'r': pargs->res = prep_lenstr(optarg); break;
+      case 'a': pargs->margin = prep_lenstr(optarg); break;
+      case 'm': pargs->min = prep_lenstr(optarg); break;
+      case 'M': pargs->max = prep_lenstr(optarg); break;
+      case 'f': pargs->fasta_file = optarg; break;
+      case 'b': pargs->bed_file = optarg; break;
+      case 'n': pargs->norm_file = optarg; break;
+      case 'e': pargs->exp_file = optarg; break;
+      case 'l': pargs->log = 1; break;
+      case 'd': pargs->distnorm = 1; break;
+      case 'B': pargs->binary = 1; break;
+      default:
+	prep_usage(stderr, argv[0]);
+	exit(EXIT_FAILURE);
+    }
+  }
+
+  if(pargs->in_file == NULL){
+    fprintf(stderr, "%s [ERROR] ", pargs->prog_name);
+    fprintf(stderr, "%s\n", "input file is not specified");
+    errflag++;
+  }
+  if(pargs->res == 0){
+    fprintf(stderr, "%s [ERROR] ", pargs->prog_name);
+    fprintf(stderr, "%s\n", "res is not specified");
+    errflag++;
+  }
+  if((pargs->norm_file == NULL) != (pargs->exp_file == NULL)){
+    fprintf(stderr, "%s [ERROR] ", pargs->prog_name);
+    fprintf(stderr, "%s\n", "norm and exp are specified together");
+    errflag++;
+  }
+  if((pargs->log != 0 || pargs->distnorm != 0) && pargs->norm_file == NULL){
+    fprintf(stderr, "%s [ERROR] ", pargs->prog_name);
+    fprintf(stderr, "%s\n", "log and distnorm convert with --norm and --exp");
+    errflag++;
+  }
+  if(pargs->distnorm != 0 && pargs->log == 0){
+    fprintf(stderr, "%s [ERROR] ", pargs->prog_name);
+    fprintf(stderr, "%s\n", "distnorm standardizes the log_2 values (--log)");
+    errflag++;
+  }
+  if(pargs->bed_file != NULL && pargs->chr == NULL){
+    fprintf(stderr, "%s [ERROR] ", pargs->prog_name);
+    fprintf(stderr, "%s\n", "bed requires the chromosome (--chr)");
+    errflag++;
+  }
+  if(pargs->binary != 0 && pargs->out_file == NULL){
+    fprintf(stderr, "%s [ERROR] ", pargs->prog_name);
+    fprintf(stderr, "%s\n", "binary output is written to a file (--output)");
+    errflag++;
+  }
+  if(errflag > 0){
+    prep_usage(stderr, pargs->prog_name);
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stderr, "%s [INFO] ", pargs->prog_name);
+  fprintf(stderr, "%s : %s\n", "input", pargs->in_file);
+  fprintf(stderr, "%s [INFO] ", pargs->prog_name);
+  fprintf(stderr, "%s : %s%s\n", "output",
+	  (pargs->out_file != NULL) ? pargs->out_file : "stdout",
+	  (pargs->binary != 0) ? " (binary)" : "");
+  fprintf(stderr, "%s [INFO] ", pargs->prog_name);
+  fprintf(stderr, "%s : %ld, margin : %ld, min : %ld, max : %ld\n", "res",
+	  pargs->res, pargs->margin, pargs->min, pargs->max);
+  if(pargs->chr != NULL){
+    fprintf(stderr, "%s [INFO] ", pargs->prog_name);
+    fprintf(stderr, "%s : %s\n", "chr", pargs->chr);
+  }
+  if(pargs->norm_file != NULL){
+    fprintf(stderr, "%s [INFO] ", pargs->prog_name);
+    fprintf(stderr, "%s : %s, %s : %s%s%s\n", "norm", pargs->norm_file,
+	    "exp", pargs->exp_file, (pargs->log != 0) ? ", log_2" : "",
+	    (pargs->distnorm != 0) ? ", N(0, 1)" : "");
+  }
+  return 0;
+}
+
+/**
+ * values of a file, one per line (NaN, inf as strtod())
+ */
+double *prep_vector(const prep_args *pargs,
+		    const char *file,
+		    unsigned long *num){
+  FILE *fp;
+  char buf[BUF_SIZE];
+  unsigned long size = 1024;
+  double *v = calloc_errchk(size, sizeof(double), "calloc prep vector");
+
+  if((fp = fopen(file, "r")) == NULL){
+    fprintf(stderr, "error: fopen %s\n%s\n", file, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  *num = 0;
+  while(fgets(buf, BUF_SIZE, fp) != NULL){
+    if(*num == size){
+      size *= 2;
+      if((v = realloc(v, size * sizeof(double))) == NULL){
+	fprintf(stderr, "realloc: prep vector\n");
+	exit(EXIT_FAILURE);
+      }
+    }
+    v[(*num)++] = strtod(buf, NULL);
+  }
+  fclose(fp);
+
+  fprintf(stderr, "%s [INFO] ", pargs->prog_name);
+  fprintf(stderr, "%s : %ld values\n", file, *num);
+  return v;
+}
+
+/* 1 when mask[] has a bit set in [begin, end) */
+static inline int prep_mask_any(const uint64_t *mask,
+				const unsigned long begin,
+				const unsigned long end){
+  unsigned long w = begin / 64;
+  const unsigned long w_end = (end + 63) / 64;
+  if(begin >= end){
+    return 0;
+  }
+  for(; w < w_end; w++){
+    uint64_t bits = mask[w];
+    if(w == begin / 64){
+      bits &= ~0UL << (begin % 64);
+    }
+    if(w == w_end - 1 && end % 64 != 0){
+      bits &= ~(~0UL << (end % 64));
+    }
+    if(bits != 0){
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * bins of the chromosome (--chr, the first sequence without it) free of
+ * N in [bin res - margin, (bin + 1) res + margin), 1 + len / res bins
+ */
+unsigned char *prep_gap(const prep_args *pargs,
+			unsigned long *num){
+  qio *q = qio_open(pargs->fasta_file, 0);
+  char buf[BUF_SIZE];
+  unsigned long size = 1024, len = 0, bin;
+  uint64_t *mask = calloc_errchk(size, sizeof(uint64_t), "calloc prep N mask");
+  unsigned char *gap;
+  int in_seq = 0, found = 0, bol = 1, head = 0;
+
+  /* one pass : the N of the sequence as bits */
+  while(qio_gets(buf, BUF_SIZE, q) != NULL){
+    char *c;
+    const int line = bol;
+    /* a line longer than buf[] comes in pieces */
+    bol = (buf[strlen(buf) - 1] == '\n');
+    if(line != 0 && buf[0] == '>'){
+      if(found != 0){
+	break;
+      }
+      head = (bol == 0);
+      buf[strcspn(buf, " \t\r\n")] = '\0';
+      in_seq = (pargs->chr == NULL || strcmp(buf + 1, pargs->chr) == 0);
+      found = in_seq;
+      continue;
+    }
+    if(head != 0){
+      /* the rest of a long header */
+      head = (bol == 0);
+      continue;
+    }
+    if(in_seq == 0){
+      continue;
+    }
+    for(c = buf; *c != '\0' && *c != '\n' && *c != '\r'; c++, len++){
+      if(len / 64 == size){
+	size *= 2;
+	if((mask = realloc(mask, size * sizeof(uint64_t))) == NULL){
+	  fprintf(stderr, "realloc: prep N mask\n");
+	  exit(EXIT_FAILURE);
+	}
+	memset(mask + size / 2, 0, size / 2 * sizeof(uint64_t));
+      }
+      if(*c == 'N' || *c == 'n'){
+	mask[len / 64] |= 1UL << (len % 64);
+      }
+    }
+  }
+  qio_close(q);
+  if(found == 0){
+    fprintf(stderr, "%s [ERROR] ", pargs->prog_name);
+    fprintf(stderr, "no sequence %s in %s\n",
+	    (pargs->chr != NULL) ? pargs->chr : "", pargs->fasta_file);
+    exit(EXIT_FAILURE);
+  }
+
+  *num = 1 + len / pargs->res;
+  gap = calloc_errchk(*num, sizeof(unsigned char), "calloc prep gap");
+  {
+    unsigned long free_num = 0;
+    for(bin = 1; bin + 1 < *num; bin++){
+      const unsigned long begin = (bin * pargs->res > pargs->margin) ?
+	bin * pargs->res - pargs->margin : 0;
+      const unsigned long end = ((bin + 1) * pargs->res + pargs->margin < len) ?
+	(bin + 1) * pargs->res + pargs->margin : len;
+      gap[bin] = (prep_mask_any(mask, begin, end) == 0);
+      free_num += gap[bin];
+    }
+    fprintf(stderr, "%s [INFO] ", pargs->prog_name);
+    fprintf(stderr, "%s : %ld bp, %ld of %ld bins are free of N\n",
+	    pargs->fasta_file, len, free_num, *num);
+  }
+  free(mask);
+  return gap;
+}
+
+/**
+ * bins covered by the intervals [start, end] of the chromosome in the
+ * BED file (bins start / res to end / res)
+ */
+unsigned char *prep_bed(const prep_args *pargs,
+			unsigned long *num){
+  FILE *fp;
+  char buf[BUF_SIZE], chr[BUF_SIZE];
+  unsigned long size = 1024, start, end, bin, covered = 0;
+  unsigned char *bed = calloc_errchk(size, sizeof(unsigned char),
+				     "calloc prep bed");
+
+  if((fp = fopen(pargs->bed_file, "r")) == NULL){
+    fprintf(stderr, "error: fopen %s\n%s\n",
+	    pargs->bed_file, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  *num = 0;
+  while(fgets(buf, BUF_SIZE, fp) != NULL){
+    if(sscanf(buf, "%s\t%lu\t%lu", chr, &start, &end) != 3 ||
+       strcmp(chr, pargs->chr) != 0){
+      continue;
+    }
+    if(end / pargs->res >= size){
+      const unsigned long old = size;
+      while(end / pargs->res >= size){
+	size *= 2;
+      }
+      if((bed = realloc(bed, size)) == NULL){
+	fprintf(stderr, "realloc: prep bed\n");
+	exit(EXIT_FAILURE);
+      }
+      memset(bed + old, 0, size - old);
+    }
+    for(bin = start / pargs->res; bin <= end / pargs->res; bin++){
+      covered += (bed[bin] == 0);
+      bed[bin] = 1;
+    }
+    if(end / pargs->res + 1 > *num){
+      *num = end / pargs->res + 1;
+    }
+  }
+  fclose(fp);
+
+  fprintf(stderr, "%s [INFO] ", pargs->prog_name);
+  fprintf(stderr, "%s : %ld bins of %s are covered\n",
+	  pargs->bed_file, covered, pargs->chr);
+  return bed;
+}
+
+static inline void prep_write(FILE *fp,
+			      const int binary,
+			      const unsigned long i,
+			      const unsigned long j,
+			      const double mij){
+  if(binary != 0){
+    hic_bin_row r;
+    r.i = i;
+    r.j = j;
+    r.mij = mij;
+    fwrite(&r, sizeof(hic_bin_row), 1, fp);
+  }else{
+    /* %.17g : read back to the same double by hic_read() */
+    fprintf(fp, "%ld\t%ld\t%.17g\n", i, j, mij);
+  }
+}
+
+int prep_run(const prep_args *pargs){
+  prep_tables tab;
+  qio *q_in;
+  FILE *fp_out;
+  char buf[BUF_SIZE];
+  unsigned long *pos_i, *pos_j, *held_i = NULL, *held_j = NULL;
+  double *v, *held_v = NULL;
+  unsigned long rows_in = 0, rows_out = 0, held_size = 0, n, m, r;
+  int eof = 0;
+
+  memset(&tab, 0, sizeof(prep_tables));
+  if(pargs->fasta_file != NULL){
+    tab.gap = prep_gap(pargs, &tab.gap_num);
+  }
+  if(pargs->bed_file != NULL){
+    tab.bed = prep_bed(pargs, &tab.bed_num);
+  }
+  if(pargs->norm_file != NULL){
+    tab.norm = prep_vector(pargs, pargs->norm_file, &tab.norm_num);
+    tab.exp = prep_vector(pargs, pargs->exp_file, &tab.exp_num);
+  }
+
+  pos_i = calloc_errchk(PREP_BLOCK, sizeof(unsigned long), "calloc prep pos_i");
+  pos_j = calloc_errchk(PREP_BLOCK, sizeof(unsigned long), "calloc prep pos_j");
+  v = calloc_errchk(PREP_BLOCK, sizeof(double), "calloc prep v");
+
+  q_in = qio_open(pargs->in_file, 0);
+  if(pargs->out_file == NULL){
+    fp_out = stdout;
+  }else if((fp_out = fopen(pargs->out_file, "w")) == NULL){
+    fprintf(stderr, "error: fopen %s\n%s\n",
+	    pargs->out_file, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  if(pargs->binary != 0){
+    /* the number of rows is set once they are written */
+    hic_bin_header header;
+    memset(&header, 0, sizeof(hic_bin_header));
+    memcpy(header.magic, HIC_BIN_MAGIC, sizeof(header.magic));
+    fwrite(&header, sizeof(hic_bin_header), 1, fp_out);
+  }
+
+  fprintf(stderr, "%s [INFO] ", pargs->prog_name);
+  fprintf(stderr, "start reading raw Hi-C file from %s\n", pargs->in_file);
+
+  while(eof == 0){
+    /* parse a block of rows */
+    for(n = 0; n < PREP_BLOCK; ){
+      char *c, *e;
+      if(qio_gets(buf, BUF_SIZE, q_in) == NULL){
+	eof = 1;
+	break;
+      }
+      pos_i[n] = strtoul(buf, &c, 10);
+      pos_j[n] = strtoul(c, &e, 10);
+      if(c == buf || e == c){
+	/* header or blank line */
+	continue;
+      }
+      v[n] = strtod(e, NULL);
+      n++;
+    }
+    rows_in += n;
+
+    /* filter the rows, in place */
+    for(m = 0, r = 0; r < n; r++){
+      const unsigned long bi = pos_i[r] / pargs->res, bj = pos_j[r] / pargs->res;
+      const unsigned long d = (pos_i[r] < pos_j[r]) ?
+	pos_j[r] - pos_i[r] : pos_i[r] - pos_j[r];
+      if(d < pargs->min || d > pargs->max){
+	continue;
+      }
+      if(tab.gap != NULL &&
+	 (bi >= tab.gap_num || bj >= tab.gap_num ||
+	  tab.gap[bi] == 0 || tab.gap[bj] == 0)){
+	continue;
+      }
+      if(tab.bed != NULL &&
+	 (bi >= tab.bed_num || bj >= tab.bed_num ||
+	  tab.bed[bi] == 0 || tab.bed[bj] == 0)){
+	continue;
+      }
+      pos_i[m] = pos_i[r];
+      pos_j[m] = pos_j[r];
+      v[m] = v[r];
+      m++;
+    }
+
+    /* convert them, bins beyond the vectors give NaN */
+    if(tab.norm != NULL){
+      for(r = 0; r < m; r++){
+	const unsigned long bi = pos_i[r] / pargs->res, bj = pos_j[r] / pargs->res;
+	const unsigned long bd = ((pos_i[r] < pos_j[r]) ?
+				  pos_j[r] - pos_i[r] : pos_i[r] - pos_j[r]) /
+	  pargs->res;
+	v[r] = (bi < tab.norm_num && bj < tab.norm_num && bd < tab.exp_num) ?
+	  v[r] / (tab.norm[bi] * tab.norm[bj] * tab.exp[bd]) : NAN;
+      }
+      if(pargs->log != 0){
+	for(r = 0; r < m; r++){
+	  v[r] = log(v[r]) / log(2);
+	}
+      }
+    }
+
+    /* write the finite ones, or hold them for --distnorm */
+    for(r = 0; r < m; r++){
+      if(!isfinite(v[r])){
+	continue;
+      }
+      if(pargs->distnorm == 0){
+	prep_write(fp_out, pargs->binary, pos_i[r], pos_j[r], v[r]);
+      }else{
+	if(rows_out == held_size){
+	  held_size = (held_size == 0) ? PREP_BLOCK : 2 * held_size;
+	  if((held_i = realloc(held_i, held_size * sizeof(unsigned long))) == NULL ||
+	     (held_j = realloc(held_j, held_size * sizeof(unsigned long))) == NULL ||
+	     (held_v = realloc(held_v, held_size * sizeof(double))) == NULL){
+	    fprintf(stderr, "realloc: prep held rows\n");
+	    exit(EXIT_FAILURE);
+	  }
+	}
+	held_i[rows_out] = pos_i[r];
+	held_j[rows_out] = pos_j[r];
+	held_v[rows_out] = v[r];
+      }
+      rows_out++;
+    }
+  }
+  qio_close(q_in);
+
+  if(pargs->distnorm != 0 && rows_out > 0){
+    /* (v - mean) / sd, sd of the population as numpy.std() */
+    double mean = 0, var = 0, sd;
+    for(r = 0; r < rows_out; r++){
+      mean += held_v[r];
+    }
+    mean /= rows_out;
+    for(r = 0; r < rows_out; r++){
+      var += (held_v[r] - mean) * (held_v[r] - mean);
+    }
+    sd = sqrt(var / rows_out);
+    fprintf(stderr, "%s [INFO] ", pargs->prog_name);
+    fprintf(stderr, "log_2 values : mean = %f, sd = %f\n", mean, sd);
+    for(r = 0; r < rows_out; r++){
+      prep_write(fp_out, pargs->binary, held_i[r], held_j[r],
+		 (held_v[r] - mean) / sd);
+    }
+  }
+
+  if(pargs->binary != 0){
+    hic_bin_header header;
+    memset(&header, 0, sizeof(hic_bin_header));
+    memcpy(header.magic, HIC_BIN_MAGIC, sizeof(header.magic));
+    header.nrow = rows_out;
+    if(fseek(fp_out, 0, SEEK_SET) != 0 ||
+       fwrite(&header, sizeof(hic_bin_header), 1, fp_out) != 1){
+      fprintf(stderr, "error: fwrite %s\n%s\n",
+	      pargs->out_file, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+  }
+  if(fp_out != stdout){
+    fclose(fp_out);
+  }else{
+    fflush(fp_out);
+  }
+
+  fprintf(stderr, "%s [INFO] ", pargs->prog_name);
+  fprintf(stderr, "# of Hi-C data points = %ld (of %ld raw rows)\n",
+	  rows_out, rows_in);
+
+  free(pos_i);
+  free(pos_j);
+  free(v);
+  free(held_i);
+  free(held_j);
+  free(held_v);
+  free(tab.gap);
+  free(tab.bed);
+  free(tab.norm);
+  free(tab.exp);
+  return 0;
+}
+
+int qloop_prep_main(int argc, char **argv){
+  prep_args pargs;
+
+  prep_args_parse(argc, argv, &pargs);
+  prep_run(&pargs);
+  return 0;
+}
+
+#endif
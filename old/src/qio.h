@@ -0,0 +1,404 @@
+#ifndef __QIO_H__
+#define __QIO_H__
+
+/**
+ * input files as byte streams, in any of the formats
+ *  - plain
+ *  - gzip (zlib, any number of members)
+ *  - BGZF (bgzip : gzip members of at most 64 KiB with their size in
+ *    the BC extra field), inflated block by block on thread_num threads
+ * The next chunk is read and decompressed on a second thread while the
+ * caller parses the current one (as the read-ahead of l2stream.h), so
+ * that decompression overlaps parsing. A BGZF chunk is a batch of
+ * QIO_BGZF_BATCH blocks per thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "calloc_errchk.h"
+
+/* bytes of a chunk of plain and gzip files */
+#define QIO_CHUNK (1 << 20)
+/* BGZF blocks per thread in a chunk, largest (inflated) block */
+#define QIO_BGZF_BATCH 16
+#define QIO_BGZF_BLOCK 65536
+/* largest number of inflating threads (thread_num <= 0 : online CPUs) */
+#define QIO_THREADS_MAX 16
+
+typedef enum { QIO_PLAIN , QIO_GZIP , QIO_BGZF } qio_format;
+
+typedef struct _qio qio;
+
+/* read-ahead of buffer b, inflation of the blocks t (mod thread_num) */
+typedef struct _qio_io{
+  qio *q;
+  int b;
+  int t;
+} qio_io;
+
+struct _qio{
+  const char *file_name;
+  int fd;
+  gzFile gz;
+  qio_format format;
+  int thread_num;
+  /* two chunk buffers : buf[cur] is parsed, the other one read ahead */
+  char *buf[2];
+  size_t len[2];
+  size_t size;
+  int cur;
+  size_t pos;
+  int pending;
+  pthread_t th;
+  qio_io io[2];
+  /* BGZF : the compressed blocks of a chunk and their offsets */
+  unsigned char *raw;
+  unsigned long blk_num;
+  size_t *blk_off;
+  size_t *blk_len;
+  size_t *out_off;
+  /* compressed bytes read */
+  unsigned long bytes;
+};
+
+qio *qio_open(const char *, const int);
+size_t qio_read(void *, const size_t, qio *);
+char *qio_gets(char *, const int, qio *);
+unsigned long qio_wc(const char *, const int);
+long qio_close(qio *);
+
+/* little-endian fields of the gzip header */
+static inline unsigned int qio_le16(const unsigned char *p){
+  return p[0] | (p[1] << 8);
+}
+
+static inline unsigned long qio_le32(const unsigned char *p){
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+/* 1 when the 18 bytes of hdr open a BGZF block (XLEN = 6, BC subfield) */
+static inline int qio_bgzf_header(const unsigned char *hdr){
+  return (hdr[0] == 0x1f && hdr[1] == 0x8b && hdr[2] == 8 &&
+	  (hdr[3] & 4) != 0 && qio_le16(hdr + 10) == 6 &&
+	  hdr[12] == 'B' && hdr[13] == 'C' && qio_le16(hdr + 14) == 2);
+}
+
+/* up to bytes from fd, returns the bytes read (< bytes : end of file) */
+size_t qio_read_fd(const qio *q,
+		   void *buf,
+		   const size_t bytes){
+  size_t done = 0;
+  ssize_t ret;
+  while(done < bytes){
+    ret = read(q->fd, (char *)buf + done, bytes - done);
+    if(ret < 0 && errno == EINTR){
+      continue;
+    }else if(ret < 0){
+      fprintf(stderr, "error: read %s\n%s\n", q->file_name, strerror(errno));
+      exit(EXIT_FAILURE);
+    }else if(ret == 0){
+      break;
+    }
+    done += ret;
+  }
+  return done;
+}
+
+void *qio_bgzf_inflate(void *args){
+  const qio_io *io = (qio_io *)args;
+  const qio *q = io->q;
+  unsigned long blk;
+  for(blk = io->t; blk < q->blk_num; blk += q->thread_num){
+    const unsigned char *in = q->raw + q->blk_off[blk];
+    const size_t isize = qio_le32(in + q->blk_len[blk] - 4);
+    unsigned char *out = (unsigned char *)q->buf[io->b] + q->out_off[blk];
+    z_stream zs;
+    int ret;
+
+    if(isize == 0){
+      /* empty block (the end-of-file marker of bgzip) */
+      continue;
+    }
+    memset(&zs, 0, sizeof(z_stream));
+    if(inflateInit2(&zs, -15) != Z_OK){
+      fprintf(stderr, "error: inflateInit2 %s\n", q->file_name);
+      exit(EXIT_FAILURE);
+    }
+    zs.next_in = (unsigned char *)in + 18;
+    zs.avail_in = q->blk_len[blk] - 18 - 8;
+    zs.next_out = out;
+    zs.avail_out = isize;
+    ret = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    if(ret != Z_STREAM_END || zs.total_out != isize ||
+       crc32(crc32(0L, Z_NULL, 0), out, isize) !=
+       qio_le32(in + q->blk_len[blk] - 8)){
+      fprintf(stderr, "error: inflate %s\n%s\n", q->file_name,
+	      "corrupted BGZF block");
+      exit(EXIT_FAILURE);
+    }
+  }
+  return NULL;
+}
+
+/* fill buf[b] with the next chunk (len[b] = 0 : end of the input) */
+void *qio_fill(void *args){
+  const qio_io *io = (qio_io *)args;
+  qio *q = io->q;
+  char *buf = q->buf[io->b];
+  size_t len = 0;
+
+  if(q->format == QIO_PLAIN){
+    len = qio_read_fd(q, buf, q->size);
+    q->bytes += len;
+  }else if(q->format == QIO_GZIP){
+    int ret = 0;
+    while(len < q->size &&
+	  (ret = gzread(q->gz, buf + len, q->size - len)) > 0){
+      len += ret;
+    }
+    if(ret < 0){
+      int err;
+      fprintf(stderr, "error: gzread %s\n%s\n", q->file_name,
+	      gzerror(q->gz, &err));
+      exit(EXIT_FAILURE);
+    }
+  }else{
+    /* a batch of blocks, then their inflation in parallel */
+    const unsigned long blk_max = (unsigned long)q->thread_num * QIO_BGZF_BATCH;
+    pthread_t threads[QIO_THREADS_MAX];
+    qio_io inf[QIO_THREADS_MAX];
+    size_t raw_len = 0, got;
+    int t;
+
+    /* a batch of empty blocks only does not end the input */
+    do{
+      q->blk_num = 0;
+      raw_len = 0;
+      while(q->blk_num < blk_max){
+	unsigned char *hdr = q->raw + raw_len;
+	size_t bsize;
+	if((got = qio_read_fd(q, hdr, 18)) == 0){
+	  break;
+	}
+	if(got < 18 || qio_bgzf_header(hdr) == 0){
+	  fprintf(stderr, "error: read %s\n%s\n", q->file_name,
+		  "truncated or mixed BGZF file");
+	  exit(EXIT_FAILURE);
+	}
+	bsize = qio_le16(hdr + 16) + 1;
+	if(bsize < 18 + 8 ||
+	   qio_read_fd(q, hdr + 18, bsize - 18) != bsize - 18 ||
+	   qio_le32(hdr + bsize - 4) > QIO_BGZF_BLOCK){
+	  fprintf(stderr, "error: read %s\n%s\n", q->file_name,
+		  "truncated BGZF block");
+	  exit(EXIT_FAILURE);
+	}
+	q->blk_off[q->blk_num] = raw_len;
+	q->blk_len[q->blk_num] = bsize;
+	q->out_off[q->blk_num] = len;
+	len += qio_le32(hdr + bsize - 4);
+	raw_len += bsize;
+	q->blk_num++;
+      }
+      q->bytes += raw_len;
+    }while(len == 0 && q->blk_num > 0);
+
+    for(t = 0; t < q->thread_num; t++){
+      inf[t].q = q;
+      inf[t].b = io->b;
+      inf[t].t = t;
+      pthread_create(&threads[t], NULL, qio_bgzf_inflate, (void *)&inf[t]);
+    }
+    for(t = 0; t < q->thread_num; t++){
+      pthread_join(threads[t], NULL);
+    }
+  }
+
+  q->len[io->b] = len;
+  return NULL;
+}
+
+/**
+ * open file (plain, gzip or BGZF) and start reading it ahead
+ *  thread_num : threads inflating BGZF blocks (<= 0 : online CPUs)
+ */
+qio *qio_open(const char *file,
+	      const int thread_num){
+  qio *q = calloc_errchk(1, sizeof(qio), "calloc qio");
+  unsigned char hdr[18];
+  ssize_t got;
+
+  q->file_name = file;
+  if((q->fd = open(file, O_RDONLY)) < 0){
+    fprintf(stderr, "error: open %s\n%s\n", file, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  got = pread(q->fd, hdr, sizeof(hdr), 0);
+  if(got == sizeof(hdr) && qio_bgzf_header(hdr) != 0){
+    q->format = QIO_BGZF;
+  }else if(got >= 2 && hdr[0] == 0x1f && hdr[1] == 0x8b){
+    q->format = QIO_GZIP;
+  }else{
+    q->format = QIO_PLAIN;
+  }
+
+  q->thread_num = (thread_num > 0) ? thread_num :
+    (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if(q->thread_num > QIO_THREADS_MAX){
+    q->thread_num = QIO_THREADS_MAX;
+  }else if(q->thread_num < 1){
+    q->thread_num = 1;
+  }
+
+  if(q->format == QIO_BGZF){
+    const unsigned long blk_max = (unsigned long)q->thread_num * QIO_BGZF_BATCH;
+    q->size = blk_max * QIO_BGZF_BLOCK;
+    q->raw = calloc_errchk(q->size, 1, "calloc qio raw");
+    q->blk_off = calloc_errchk(blk_max, sizeof(size_t), "calloc qio blk_off");
+    q->blk_len = calloc_errchk(blk_max, sizeof(size_t), "calloc qio blk_len");
+    q->out_off = calloc_errchk(blk_max, sizeof(size_t), "calloc qio out_off");
+  }else{
+    q->size = QIO_CHUNK;
+  }
+  if(q->format == QIO_GZIP){
+    int fd = dup(q->fd);
+    if(fd < 0 || (q->gz = gzdopen(fd, "rb")) == NULL){
+      fprintf(stderr, "error: gzdopen %s\n%s\n", file, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    gzbuffer(q->gz, QIO_CHUNK);
+  }
+  q->buf[0] = calloc_errchk(q->size, 1, "calloc qio buf[0]");
+  q->buf[1] = calloc_errchk(q->size, 1, "calloc qio buf[1]");
+
+  /* buf[1] is the (empty) current chunk, buf[0] is read ahead */
+  q->cur = 1;
+  q->io[0].q = q->io[1].q = q;
+  q->io[0].b = 0;
+  q->io[1].b = 1;
+  pthread_create(&q->th, NULL, qio_fill, (void *)&q->io[0]);
+  q->pending = 1;
+  return q;
+}
+
+/* switch to the chunk read ahead and read the next one, 0 : end */
+static int qio_next(qio *q){
+  if(q->pending == 0){
+    return 0;
+  }
+  pthread_join(q->th, NULL);
+  q->pending = 0;
+  q->cur ^= 1;
+  q->pos = 0;
+  if(q->len[q->cur] == 0){
+    return 0;
+  }
+  pthread_create(&q->th, NULL, qio_fill, (void *)&q->io[q->cur ^ 1]);
+  q->pending = 1;
+  return 1;
+}
+
+/* up to bytes into ptr, returns the bytes read (as fread()) */
+size_t qio_read(void *ptr,
+		const size_t bytes,
+		qio *q){
+  size_t done = 0;
+  while(done < bytes){
+    size_t n;
+    if(q->pos == q->len[q->cur] && qio_next(q) == 0){
+      break;
+    }
+    n = q->len[q->cur] - q->pos;
+    if(n > bytes - done){
+      n = bytes - done;
+    }
+    memcpy((char *)ptr + done, q->buf[q->cur] + q->pos, n);
+    q->pos += n;
+    done += n;
+  }
+  return done;
+}
+
+/* a line of at most size - 1 bytes into s (as fgets()), NULL : end */
+char *qio_gets(char *s,
+	       const int size,
+	       qio *q){
+  size_t done = 0;
+  while(done + 1 < (size_t)size){
+    const char *p, *nl;
+    size_t n;
+    if(q->pos == q->len[q->cur] && qio_next(q) == 0){
+      break;
+    }
+    p = q->buf[q->cur] + q->pos;
+    n = q->len[q->cur] - q->pos;
+    if(n > size - 1 - done){
+      n = size - 1 - done;
+    }
+    if((nl = memchr(p, '\n', n)) != NULL){
+      n = nl - p + 1;
+    }
+    memcpy(s + done, p, n);
+    q->pos += n;
+    done += n;
+    if(nl != NULL){
+      break;
+    }
+  }
+  if(done == 0){
+    return NULL;
+  }
+  s[done] = '\0';
+  return s;
+}
+
+/* number of lines of file, in any of the formats (as mywc()) */
+unsigned long qio_wc(const char *file,
+		     const int thread_num){
+  qio *q = qio_open(file, thread_num);
+  unsigned long lines = 0;
+  char last = '\n';
+  while(qio_next(q) != 0){
+    const char *p = q->buf[q->cur], *end = p + q->len[q->cur];
+    while((p = memchr(p, '\n', end - p)) != NULL){
+      lines++;
+      p++;
+    }
+    last = end[-1];
+  }
+  qio_close(q);
+  return lines + (last != '\n');
+}
+
+/* close q, returns the (compressed) bytes read */
+long qio_close(qio *q){
+  long bytes;
+  if(q->pending != 0){
+    pthread_join(q->th, NULL);
+  }
+  if(q->format == QIO_GZIP){
+    q->bytes = gzoffset(q->gz);
+    gzclose(q->gz);
+  }
+  bytes = q->bytes;
+  close(q->fd);
+  free(q->buf[0]);
+  free(q->buf[1]);
+  free(q->raw);
+  free(q->blk_off);
+  free(q->blk_len);
+  free(q->out_off);
+  free(q);
+  return bytes;
+}
+
+#endif
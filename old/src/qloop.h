@@ -0,0 +1,415 @@
+#ifndef __QLOOP_H__
+#define __QLOOP_H__
+
+/**
+ * the programs (twin, pred, kmer_filter) as functions over one loaded
+ * data set, so that several of them can share a single load
+ *  qloop_load()    : features, Hi-C rows and k-mer (pair) files
+ *  qloop_train()   : twin (L2 Boosting, dense, sparse, batched, on
+ *                    worker processes or streamed from disk)
+ *  qloop_predict() : pred (with the model of the caller or --pri)
+ *  qloop_filter()  : kmer_filter (AdaBoost over k-mers)
+ * and their command line entry points qloop_*_main(), with the Hi-C
+ * preprocessing qloop_prep_main() of prep.h.
+ */
+
+#include <stdio.h>
+
+#include "constant.h"
+#include "mywc.h"
+#include "cmd_args.h"
+#include "fasta.h"
+#include "hic.h"
+#include "kmer.h"
+#include "l2boost.h"
+#include "l2batch.h"
+#include "l2shm.h"
+#include "l2stream.h"
+#include "memplan.h"
+#include "pred.h"
+#include "prep.h"
+#include "sparse.h"
+
+/* what a program needs from the data set */
+typedef enum { QLOOP_TRAIN , QLOOP_PREDICT , QLOOP_FILTER , QLOOP_PIPELINE } qloop_mode;
+
+typedef struct _qloop_data{
+  unsigned long bin_num;
+  /* dense features (double / single precision) or sparse features */
+  double **features;
+  float **features_f;
+  sp_features *features_sp;
+  hic *data;
+  canonical_kp *ckps;
+  kmer *kmers;
+} qloop_data;
+
+int qloop_load(const cmd_args *args,
+	       const qloop_mode mode,
+	       qloop_data **ds);
+int qloop_train(const cmd_args *args,
+		const qloop_data *ds,
+		boost **model);
+int qloop_train_batch(const cmd_args *args,
+		      const qloop_data *ds,
+		      boost **model);
+int qloop_predict(const cmd_args *args,
+		  const qloop_data *ds,
+		  const boost *model);
+int qloop_filter(const cmd_args *args,
+		 const qloop_data *ds);
+int qloop_twin_main(int argc, char **argv);
+int qloop_pred_main(int argc, char **argv);
+int qloop_filter_main(int argc, char **argv);
+int qloop_pipeline_main(int argc, char **argv);
+
+int qloop_load(const cmd_args *args,
+	       const qloop_mode mode,
+	       qloop_data **ds){
+  *ds = calloc_errchk(1, sizeof(qloop_data), "calloc qloop_data");
+
+  if(args->sparse != 0 && mode != QLOOP_FILTER){
+    /* large k : sparse features, no canonical k-mer pair file */
+    set_features_sparse(args, &((*ds)->features_sp));
+    hic_read(args, &((*ds)->data));
+    return 0;
+  }
+
+  set_features_bins(args, &((*ds)->features), &((*ds)->bin_num));
+  if(mode != QLOOP_PREDICT && mode != QLOOP_FILTER &&
+     args->precision == SINGLE){
+    /* keep the double precision table for the shadow run and for the
+     * prediction of the pipeline */
+    const int keep = (args->shadow > 0 || mode == QLOOP_PIPELINE);
+    features_f32(args, (*ds)->features, (*ds)->bin_num,
+		 &((*ds)->features_f), keep);
+    if(keep == 0){
+      free((*ds)->features);
+      (*ds)->features = NULL;
+    }
+  }
+  if(mode == QLOOP_TRAIN && args->stream > 0){
+    /* the rows are streamed from disk by l2_train_stream() */
+    canonical_kp_load(args, &((*ds)->ckps));
+    return 0;
+  }
+  hic_read(args, &((*ds)->data));
+  if(args->hic_chr != NULL){
+    /* the rows of a Juicer .hic file still cover the bins with N */
+    unsigned char *keep = calloc_errchk((*ds)->bin_num, sizeof(unsigned char),
+					"calloc keep");
+    unsigned long bin;
+    for(bin = 0; bin < (*ds)->bin_num; bin++){
+      keep[bin] = ((*ds)->features != NULL) ?
+	((*ds)->features[bin] != NULL) : ((*ds)->features_f[bin] != NULL);
+    }
+    hic_keep_bins(args, (*ds)->data, keep, (*ds)->bin_num);
+    free(keep);
+  }
+  if(mode == QLOOP_FILTER){
+    kmer_read(args, &((*ds)->kmers));
+  }else{
+    canonical_kp_load(args, &((*ds)->ckps));
+  }
+  return 0;
+}
+
+/* train on ds, write the steps to args->out_file, model : the result */
+int qloop_train(const cmd_args *args,
+		const qloop_data *ds,
+		boost **model){
+  FILE *fp_out;
+  hic *train = NULL, *val = NULL;
+  if(args->batch_acc != NULL || args->batch_hic != NULL || args->cv > 0){
+    return qloop_train_batch(args, ds, model);
+  }
+
+  if((fp_out = fopen(args->out_file, "w")) == NULL){
+    fprintf(stderr, "error: fopen %s\n%s\n",
+	    args->out_file, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  boost_init(args,
+	     (const canonical_kp *)ds->ckps,
+	     NULL,
+	     (const unsigned int)args->iter1,
+	     (const char *)args->pri_file,
+	     model,
+	     fp_out);
+
+  if(args->sparse != 0){
+    sparse_train(args,
+		 (const sp_features *)ds->features_sp,
+		 (const hic *)ds->data,
+		 (const double)args->acc,
+		 model,
+		 fp_out);
+  }else if(args->stream > 0){
+    l2_train_stream(args,
+		    (const double **)ds->features,
+		    (const float **)ds->features_f,
+		    (const canonical_kp *)ds->ckps,
+		    (const double)args->acc,
+		    model,
+		    fp_out);
+  }else if(args->procs > 0){
+    l2_train_shm(args,
+		 (const double **)ds->features,
+		 (const float **)ds->features_f,
+		 (const hic *)ds->data,
+		 (const canonical_kp *)ds->ckps,
+		 (const double)args->acc,
+		 model,
+		 fp_out);
+  }else{
+    if(args->val_frac > 0){
+      /* hold out the validation rows */
+      hic_split(args, (const hic *)ds->data, &train, &val);
+    }
+    l2_train(args,
+	     (const double **)ds->features,
+	     (const float **)ds->features_f,
+	     (train != NULL) ? (const hic *)train : (const hic *)ds->data,
+	     (const hic *)val,
+	     (const canonical_kp *)ds->ckps,
+	     (const double)args->acc,
+	     model,
+	     fp_out);
+    if(train != NULL){
+      hic_free(train);
+      hic_free(val);
+    }
+  }
+
+  fclose(fp_out);
+  return 0;
+}
+
+/**
+ * train the models of --batch_acc / --batch_hic / --cv together (see
+ * l2batch.h), model : model 0 (--hic, --acc, first fold with --cv)
+ */
+int qloop_train_batch(const cmd_args *args,
+		      const qloop_data *ds,
+		      boost **model){
+  l2_batch *batch;
+  boost **models;
+  FILE **fps;
+  unsigned long b;
+
+  l2_batch_prep(args, (const hic *)ds->data, &batch);
+  models = calloc_errchk(batch->r, sizeof(boost *), "calloc models[]");
+  fps = calloc_errchk(batch->r, sizeof(FILE *), "calloc fps[]");
+  for(b = 0; b < batch->r; b++){
+    if((fps[b] = fopen(batch->out_file[b], "w")) == NULL){
+      fprintf(stderr, "error: fopen %s\n%s\n",
+	      batch->out_file[b], strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    boost_init(args,
+	       (const canonical_kp *)ds->ckps,
+	       NULL,
+	       (const unsigned int)args->iter1,
+	       NULL,
+	       &models[b],
+	       fps[b]);
+  }
+
+  l2_train_batch(args,
+		 (const double **)ds->features,
+		 (const float **)ds->features_f,
+		 (const hic *)ds->data,
+		 (const canonical_kp *)ds->ckps,
+		 (const l2_batch *)batch,
+		 models,
+		 fps);
+
+  for(b = 0; b < batch->r; b++){
+    fclose(fps[b]);
+  }
+  l2_batch_dump(args, batch);
+  if(args->cv > 0){
+    l2_batch_cv_dump(args, batch, (const hic *)ds->data, models);
+  }
+  l2_batch_free(batch);
+  *model = models[0];
+  free(models);
+  free(fps);
+  return 0;
+}
+
+/**
+ * predict the Hi-C rows of ds and write args->out_file.cmp
+ *  model : NULL to load the model from args->pri_file
+ */
+int qloop_predict(const cmd_args *args,
+		  const qloop_data *ds,
+		  const boost *model){
+  boost *loaded = NULL;
+  double *pred;
+  metrics_phase ph;
+
+  if(model == NULL){
+    boost_init(args,
+	       (const canonical_kp *)ds->ckps,
+	       NULL,
+	       (const unsigned int)mywc(args->pri_file),
+	       (const char *)args->pri_file,
+	       &loaded,
+	       stderr);
+    model = loaded;
+  }
+
+  metrics_begin(&ph);
+  if(args->sparse != 0){
+    pred = calloc_errchk(ds->data->nrow, sizeof(double), "calloc pred[]");
+    sp_predict(args,
+	       (const sp_features *)ds->features_sp,
+	       (const hic *)ds->data,
+	       (const sp_beta *)model->beta_sp,
+	       pred);
+  }else{
+    predict(args,
+	    (const double **)ds->features,
+	    (const hic *)ds->data,
+	    (const canonical_kp *)ds->ckps,
+	    model,
+	    &pred,
+	    stderr);
+  }
+  metrics_end(&ph, "predict", -1, 0, NULL, 0);
+
+  pred_cmp_file(args,
+		(const hic *)ds->data,
+		(const double *)pred,
+		stderr);
+  free(pred);
+  return 0;
+}
+
+int qloop_filter(const cmd_args *args,
+		 const qloop_data *ds){
+  boost *model;
+  FILE *fp_out;
+  if((fp_out = fopen(args->out_file, "w")) == NULL){
+    fprintf(stderr, "error: fopen %s\n%s\n",
+	    args->out_file, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  boost_init(args,
+	     NULL,
+	     (const kmer *)ds->kmers,
+	     (const unsigned int)args->iter1,
+	     (const char *)args->pri_file,
+	     &model,
+	     fp_out);
+
+  ada_train(args,
+	    (const double **)ds->features,
+	    (const hic *)ds->data,
+	    (const kmer *)ds->kmers,
+	    (const double)args->acc,
+	    &model,
+	    fp_out);
+
+  fclose(fp_out);
+  return 0;
+}
+
+int qloop_twin_main(int argc, char **argv){
+  cmd_args *args;
+  qloop_data *ds;
+  boost *model;
+
+  cmd_args_parse(argc, argv, &args);
+  cmd_args_chk(args);
+  mem_plan_fit(args, 1, 0);
+  metrics_open(args);
+  trace_open(args);
+
+  qloop_load(args, QLOOP_TRAIN, &ds);
+  qloop_train(args, ds, &model);
+
+  metrics_close();
+  trace_close();
+  return 0;
+}
+
+int qloop_pred_main(int argc, char **argv){
+  cmd_args *args;
+  qloop_data *ds;
+
+  cmd_args_parse(argc, argv, &args);
+  cmd_args_chk_pred(args);
+  mem_plan_fit(args, 0, 1);
+  metrics_open(args);
+  trace_open(args);
+
+  qloop_load(args, QLOOP_PREDICT, &ds);
+  qloop_predict(args, ds, NULL);
+
+  metrics_close();
+  trace_close();
+  return 0;
+}
+
+int qloop_filter_main(int argc, char **argv){
+  cmd_args *args;
+  qloop_data *ds;
+
+  cmd_args_parse(argc, argv, &args);
+  cmd_args_chk(args);
+  if(args->kmer == NULL){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "k-mer file is not specified");
+    exit(EXIT_FAILURE);
+  }
+  metrics_open(args);
+  trace_open(args);
+
+  qloop_load(args, QLOOP_FILTER, &ds);
+  qloop_filter(args, ds);
+
+  metrics_close();
+  trace_close();
+  return 0;
+}
+
+/**
+ * twin, then pred of the training rows with the trained model
+ * (out_file.self.cmp), on one load of the data
+ */
+int qloop_pipeline_main(int argc, char **argv){
+  cmd_args *args, args_pred;
+  qloop_data *ds;
+  boost *model;
+  char self_file[F_NAME_LEN];
+
+  cmd_args_parse(argc, argv, &args);
+  cmd_args_chk(args);
+  if(args->cv > 0 || args->stream > 0){
+    fprintf(stderr, "%s [ERROR] ", args->prog_name);
+    fprintf(stderr, "%s\n", "pipeline does not support --cv and --stream");
+    exit(EXIT_FAILURE);
+  }
+  mem_plan_fit(args, 1, 1);
+  metrics_open(args);
+  trace_open(args);
+
+  qloop_load(args, QLOOP_PIPELINE, &ds);
+  qloop_train(args, ds, &model);
+
+  snprintf(self_file, F_NAME_LEN, "%s.self", args->out_file);
+  args_pred = *args;
+  args_pred.out_file = self_file;
+  args_pred.pri_file = args->out_file;
+  qloop_predict(&args_pred, ds, model);
+
+  metrics_close();
+  trace_close();
+  return 0;
+}
+
+#endif
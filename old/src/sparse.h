@@ -0,0 +1,758 @@
+#ifndef __SPARSE_H__
+#define __SPARSE_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "constant.h"
+#include "calloc_errchk.h"
+#include "cmd_args.h"
+#include "fasta.h"
+#include "hic.h"
+#include "kmer.h"
+#include "l2boost.h"
+
+/**
+ * This header file contains some functions to perform the following tasks
+ * (large k, see --sparse)
+ * - compute sparse k-mer frequency vectors of bins
+ * - L2 Boosting over the canonical k-mer pairs, enumerated implicitly:
+ *   neither the pairs nor p-sized arrays (UdX, Xnormsq, beta) are stored
+ * - prediction with a sparse model
+ *
+ * The axis of the k-mer pair (a, b) is the id (a << 2k) | b. Its column is
+ *   X_r = f_r[a] g_r[b] + f_r[rc(b)] g_r[rc(a)]
+ * (f_r, g_r : features of the bins h_i[r] and h_j[r]), as in the canonical
+ * k-mer pair file (revcmp1 = rc(kmer2), revcmp2 = rc(kmer1)). The pair
+ * (rc(b), rc(a)) has the same column; (a, b) is canonical when its id is
+ * not larger.
+ */
+
+/* sparse feature vectors (CSR over the bins) */
+typedef struct _sp_features{
+  int k;
+  unsigned long bin_num;
+  /* entries of bin b : [ptr[b], ptr[b + 1]) */
+  unsigned long *ptr;
+  /* k-mers (sorted within a bin) and their values */
+  unsigned int *idx;
+  double *val;
+} sp_features;
+
+/* inverted indices of the features and of the Hi-C rows */
+typedef struct _sp_index{
+  /* bins containing k-mer x : kmer_bin[kmer_ptr[x], kmer_ptr[x + 1]) */
+  unsigned long *kmer_ptr;
+  unsigned int *kmer_bin;
+  double *kmer_val;
+  /* rows r with h_i[r] == b : i_row[i_ptr[b], i_ptr[b + 1]) */
+  unsigned long *i_ptr;
+  unsigned long *i_row;
+  /* rows r with h_j[r] == b : j_row[j_ptr[b], j_ptr[b + 1]) */
+  unsigned long *j_ptr;
+  unsigned long *j_row;
+  /* entries of the features keyed by y = rc(x), sorted by y within a
+   * bin (same ptr[] as sp_features) : rc_val = f_bin[rc(y)] */
+  unsigned int *rc_idx;
+  double *rc_val;
+} sp_index;
+
+/* accumulators of sp_search() for one k-mer (kept together so that an
+ * update touches a single cache line) */
+typedef struct _sp_acc{
+  double M;     /* \sum_r U_r f_r[a] g_r[b]                  (b) */
+  double A1;    /* \sum_r f_r[a]^2 g_r[b]^2                  (b) */
+  double C;     /* \sum_r f_r[a] g_r[rc(a)] f_r[rc(b)] g_r[b] (b) */
+  double N;     /* \sum_r U_r g_r[rc(a)] f_r[x]               (x) */
+  double A2;    /* \sum_r g_r[rc(a)]^2 f_r[x]^2               (x) */
+} sp_acc;
+
+/* arguments of sp_search() */
+typedef struct _sp_search_args{
+  /* thread specific info : k-mers a = thread_id, thread_id + thread_num, ... */
+  int thread_id;
+  int thread_num;
+  /* shared data */
+  const sp_features *feat;
+  const sp_index *index;
+  const hic *data;
+  const unsigned int *rc;
+  const double *U;
+  /* accumulators (4^k entries) */
+  sp_acc *acc;
+  /* dense copy of one feature vector (4^k entries) */
+  double *fd;
+  unsigned int *touched;
+  unsigned char *mark;
+  /* best axis of the thread */
+  unsigned long best_id;
+  double best_score;
+  double best_UdX;
+  double best_Xnormsq;
+  /* hardware counters of the thread (--perf) */
+  perf_counts perf;
+} sp_search_args;
+
+int uint_cmp(const void *, const void *);
+int ulong_cmp(const void *, const void *);
+int set_features_sparse(const cmd_args *, sp_features **);
+int sp_index_build(const cmd_args *, const sp_features *, const hic *,
+		   sp_index **);
+unsigned long sp_lower_bound(const unsigned int *, unsigned long,
+			     unsigned long, const unsigned int);
+double sp_feature(const sp_features *, const unsigned int,
+		  const unsigned int);
+double sp_column(const sp_features *, const unsigned int *,
+		 const hic *, const unsigned long, const unsigned long);
+void *sp_search(void *);
+int sp_predict(const cmd_args *, const sp_features *, const hic *,
+	       const sp_beta *, double *);
+int sparse_train(const cmd_args *, const sp_features *, const hic *,
+		 const double, boost **, FILE *);
+
+int uint_cmp(const void *a, const void *b){
+  const unsigned int x = *(const unsigned int *)a;
+  const unsigned int y = *(const unsigned int *)b;
+  return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+int ulong_cmp(const void *a, const void *b){
+  const unsigned long x = *(const unsigned long *)a;
+  const unsigned long y = *(const unsigned long *)b;
+  return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/**
+ * sparse counterpart of set_features() : same bins, same normalization
+ */
+int set_features_sparse(const cmd_args *args,
+			sp_features **feat){
+  char *seq_head, *seq;
+  unsigned long seq_len, bin_num;
+  metrics_phase ph;
+
+  {
+    /* read fasta file */
+    fasta_read(args->fasta_file, args->thread_num,
+	       &seq_head, &seq, &seq_len);
+
+    bin_num = (seq_len / args->res);
+
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "sequence: %s (len = %ld) => %ld bins)\n",
+	    seq_head, seq_len, bin_num);
+  }
+
+  metrics_begin(&ph);
+
+  {
+    const int k = args->k;
+    const int res = args->res;
+    const int margin = args->margin;
+    const unsigned long bin_min = (long)((margin + res - 1) / res);
+    const unsigned long bin_max = (long)((seq_len - margin - k + 1) / res);
+    const unsigned int bit_mask = (1 << (2 * k)) - 1;
+    unsigned long bin, valid_bin_num = 0, size = BUF_SIZE, nnz = 0;
+    /* dense counts of the current bin and their nonzero k-mers */
+    double *count = calloc_errchk(bit_mask + 1, sizeof(double),
+				  "calloc count[]");
+    unsigned int *touched = calloc_errchk(bit_mask + 1, sizeof(unsigned int),
+					  "calloc touched[]");
+
+    *feat = calloc_errchk(1, sizeof(sp_features), "calloc sp_features");
+    (*feat)->k = k;
+    (*feat)->bin_num = bin_num;
+    (*feat)->ptr = calloc_errchk(bin_num + 1, sizeof(unsigned long),
+				 "calloc sp_features->ptr");
+    (*feat)->idx = calloc_errchk(size, sizeof(unsigned int),
+				 "calloc sp_features->idx");
+    (*feat)->val = calloc_errchk(size, sizeof(double),
+				 "calloc sp_features->val");
+
+    for(bin = 0; bin < bin_num; bin++){
+      unsigned int contain_n = 0, num = 0, t;
+      unsigned long i;
+      (*feat)->ptr[bin] = nnz;
+      if(bin < bin_min || bin >= bin_max){
+	continue;
+      }
+      for(i = bin * res - margin;
+	  i < (bin + 1) * res + k - 1 + margin; i++){
+	if(seq[i] == 'N' || seq[i] == 'n'){
+	  contain_n = 1;
+	  break;
+	}
+      }
+      if(contain_n != 0){
+	continue;
+      }
+
+      {
+	unsigned int kmer = 0;
+	/* convert first (k-1)-mer to bit-encoded sequence */
+	for(i = bin * res - margin;
+	    i < bin * res - margin + k - 1; i++){
+	  kmer <<= 2;
+	  kmer += (c2i(seq[i]) & 3);
+	}
+	/* count k-mer frequency */
+	for(;
+	    i < (bin + 1) * res + k - 1 + margin; i++){
+	  kmer = ((kmer << 2) + (c2i(seq[i]) & 3)) & bit_mask;
+	  if(count[kmer] == 0){
+	    touched[num++] = kmer;
+	  }
+	  count[kmer] += 1.0;
+	}
+      }
+      qsort(touched, num, sizeof(unsigned int), uint_cmp);
+
+      if(nnz + num > size){
+	while(nnz + num > size){
+	  size *= 2;
+	}
+	if(((*feat)->idx = realloc((*feat)->idx,
+				   size * sizeof(unsigned int))) == NULL ||
+	   ((*feat)->val = realloc((*feat)->val,
+				   size * sizeof(double))) == NULL){
+	  fprintf(stderr, "realloc: sp_features\n");
+	  exit(EXIT_FAILURE);
+	}
+      }
+
+      {
+	/* normalize feature vector (see set_features_bins()) */
+	double norm = 1;
+	if(args->f_norm == L1){
+	  norm = bit_mask + 1;
+	}else if(args->f_norm == L2){
+	  norm = 0;
+	  for(t = 0; t < num; t++){
+	    norm += count[touched[t]] * count[touched[t]];
+	  }
+	}
+	for(t = 0; t < num; t++){
+	  (*feat)->idx[nnz] = touched[t];
+	  (*feat)->val[nnz] = count[touched[t]] / norm;
+	  count[touched[t]] = 0;
+	  nnz++;
+	}
+      }
+      valid_bin_num++;
+    }
+    (*feat)->ptr[bin_num] = nnz;
+
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "# of valid bins : %ld\n", valid_bin_num);
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "# of nonzero features : %ld (%.1f per bin, %.2f%% of 4^k)\n",
+	    nnz, (valid_bin_num > 0) ? (double)nnz / valid_bin_num : 0,
+	    (valid_bin_num > 0) ?
+	    100.0 * nnz / valid_bin_num / (bit_mask + 1) : 0);
+
+    free(count);
+    free(touched);
+    metrics_end(&ph, "features", -1,
+		seq_len + nnz * (sizeof(unsigned int) + sizeof(double)),
+		NULL, 0);
+  }
+
+  free(seq_head);
+  free(seq);
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "computation of sparse feature vectors finished\n");
+
+  return 0;
+}
+
+typedef struct _sp_rc_entry{
+  unsigned int y;
+  double val;
+} sp_rc_entry;
+
+int sp_rc_entry_cmp(const void *a, const void *b){
+  const unsigned int x = ((const sp_rc_entry *)a)->y;
+  const unsigned int y = ((const sp_rc_entry *)b)->y;
+  return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+int sp_index_build(const cmd_args *args,
+		   const sp_features *feat,
+		   const hic *data,
+		   sp_index **index){
+  const unsigned long kmer_num = 1UL << (2 * feat->k);
+  const unsigned long bin_num = feat->bin_num;
+  const unsigned long nnz = feat->ptr[bin_num];
+  unsigned long *pos, bin, e, r, x;
+
+  *index = calloc_errchk(1, sizeof(sp_index), "calloc sp_index");
+
+  /* bins of each k-mer (counting sort, bins stay in ascending order) */
+  {
+    (*index)->kmer_ptr = calloc_errchk(kmer_num + 1, sizeof(unsigned long),
+				       "calloc sp_index->kmer_ptr");
+    (*index)->kmer_bin = calloc_errchk(nnz, sizeof(unsigned int),
+				       "calloc sp_index->kmer_bin");
+    (*index)->kmer_val = calloc_errchk(nnz, sizeof(double),
+				       "calloc sp_index->kmer_val");
+    pos = calloc_errchk(kmer_num + 1, sizeof(unsigned long), "calloc pos[]");
+    for(e = 0; e < nnz; e++){
+      (*index)->kmer_ptr[feat->idx[e] + 1]++;
+    }
+    for(x = 0; x < kmer_num; x++){
+      (*index)->kmer_ptr[x + 1] += (*index)->kmer_ptr[x];
+      pos[x] = (*index)->kmer_ptr[x];
+    }
+    for(bin = 0; bin < bin_num; bin++){
+      for(e = feat->ptr[bin]; e < feat->ptr[bin + 1]; e++){
+	x = feat->idx[e];
+	(*index)->kmer_bin[pos[x]] = bin;
+	(*index)->kmer_val[pos[x]] = feat->val[e];
+	pos[x]++;
+      }
+    }
+    free(pos);
+  }
+
+  /* rows of each bin */
+  {
+    for(r = 0; r < data->nrow; r++){
+      if(data->i[r] >= bin_num || data->j[r] >= bin_num){
+	fprintf(stderr, "%s [ERROR] ", args->prog_name);
+	fprintf(stderr, "Hi-C row %ld refers to a bin out of the sequence\n",
+		r + 1);
+	exit(EXIT_FAILURE);
+      }
+    }
+    (*index)->i_ptr = calloc_errchk(bin_num + 1, sizeof(unsigned long),
+				    "calloc sp_index->i_ptr");
+    (*index)->j_ptr = calloc_errchk(bin_num + 1, sizeof(unsigned long),
+				    "calloc sp_index->j_ptr");
+    (*index)->i_row = calloc_errchk(data->nrow, sizeof(unsigned long),
+				    "calloc sp_index->i_row");
+    (*index)->j_row = calloc_errchk(data->nrow, sizeof(unsigned long),
+				    "calloc sp_index->j_row");
+    for(r = 0; r < data->nrow; r++){
+      (*index)->i_ptr[data->i[r] + 1]++;
+      (*index)->j_ptr[data->j[r] + 1]++;
+    }
+    for(bin = 0; bin < bin_num; bin++){
+      (*index)->i_ptr[bin + 1] += (*index)->i_ptr[bin];
+      (*index)->j_ptr[bin + 1] += (*index)->j_ptr[bin];
+    }
+    pos = calloc_errchk(2 * bin_num, sizeof(unsigned long), "calloc pos[]");
+    memcpy(pos, (*index)->i_ptr, bin_num * sizeof(unsigned long));
+    memcpy(pos + bin_num, (*index)->j_ptr, bin_num * sizeof(unsigned long));
+    for(r = 0; r < data->nrow; r++){
+      (*index)->i_row[pos[data->i[r]]++] = r;
+      (*index)->j_row[pos[bin_num + data->j[r]]++] = r;
+    }
+    free(pos);
+  }
+
+  /* entries keyed by the reverse complement */
+  {
+    unsigned int *rc = kmer_revcmp_table(feat->k);
+    sp_rc_entry *tmp = calloc_errchk(BUF_SIZE, sizeof(sp_rc_entry),
+				     "calloc sp_rc_entry[]");
+    unsigned long tmp_size = BUF_SIZE;
+    (*index)->rc_idx = calloc_errchk(nnz, sizeof(unsigned int),
+				     "calloc sp_index->rc_idx");
+    (*index)->rc_val = calloc_errchk(nnz, sizeof(double),
+				     "calloc sp_index->rc_val");
+    for(bin = 0; bin < bin_num; bin++){
+      const unsigned long num = feat->ptr[bin + 1] - feat->ptr[bin];
+      if(num > tmp_size){
+	tmp_size = num;
+	free(tmp);
+	tmp = calloc_errchk(tmp_size, sizeof(sp_rc_entry),
+			    "calloc sp_rc_entry[]");
+      }
+      for(e = 0; e < num; e++){
+	tmp[e].y = rc[feat->idx[feat->ptr[bin] + e]];
+	tmp[e].val = feat->val[feat->ptr[bin] + e];
+      }
+      qsort(tmp, num, sizeof(sp_rc_entry), sp_rc_entry_cmp);
+      for(e = 0; e < num; e++){
+	(*index)->rc_idx[feat->ptr[bin] + e] = tmp[e].y;
+	(*index)->rc_val[feat->ptr[bin] + e] = tmp[e].val;
+      }
+    }
+    free(tmp);
+    free(rc);
+  }
+
+  return 0;
+}
+
+/* first position in v[lo, hi) (sorted) not smaller than key */
+unsigned long sp_lower_bound(const unsigned int *v,
+			     unsigned long lo,
+			     unsigned long hi,
+			     const unsigned int key){
+  unsigned long mid;
+  while(lo < hi){
+    mid = (lo + hi) / 2;
+    if(v[mid] < key){
+      lo = mid + 1;
+    }else{
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/* f_bin[x] (binary search in the sorted entries of bin) */
+double sp_feature(const sp_features *feat,
+		  const unsigned int bin,
+		  const unsigned int x){
+  const unsigned long lo =
+    sp_lower_bound(feat->idx, feat->ptr[bin], feat->ptr[bin + 1], x);
+  return (lo < feat->ptr[bin + 1] && feat->idx[lo] == x) ? feat->val[lo] : 0;
+}
+
+/* X_r of the axis id */
+double sp_column(const sp_features *feat,
+		 const unsigned int *rc,
+		 const hic *data,
+		 const unsigned long id,
+		 const unsigned long r){
+  const unsigned int a = id >> (2 * feat->k);
+  const unsigned int b = id & ((1UL << (2 * feat->k)) - 1);
+  return ((sp_feature(feat, data->i[r], a) *
+	   sp_feature(feat, data->j[r], b)) +
+	  (sp_feature(feat, data->i[r], rc[b]) *
+	   sp_feature(feat, data->j[r], rc[a])));
+}
+
+/**
+ * best canonical pair (a, b) over a = thread_id (mod thread_num)
+ *  UdX     = M[b] + N[rc(b)]
+ *  Xnormsq = A1[b] + A2[rc(b)] + 2 C[b]
+ * are accumulated over the rows where f_r[a] or g_r[rc(a)] is nonzero,
+ * so that only pairs with a nonzero column are visited. Only the
+ * entries with rc(b) >= a are accumulated : the other pairs are not
+ * canonical, and both passes start from a binary search.
+ */
+void *sp_search(void *args){
+  sp_search_args *params = (sp_search_args *)args;
+  const sp_features *feat = params->feat;
+  const sp_index *index = params->index;
+  const unsigned int *h_i = params->data->i;
+  const unsigned int *h_j = params->data->j;
+  const unsigned int *rc = params->rc;
+  const double *U = params->U;
+  const int k2 = 2 * feat->k;
+  const unsigned long kmer_num = 1UL << k2;
+  sp_acc *acc = params->acc;
+  double *fd = params->fd;
+  unsigned int *touched = params->touched;
+  unsigned char *mark = params->mark;
+  unsigned long a, e, t, q, num, id, id_rc;
+  unsigned int bin, b, x;
+  perf_group perf;
+  perf_counts perf_start;
+  double t0;
+
+  if(perf_enabled()){
+    perf_thread_begin(&perf, &perf_start);
+  }
+  trace_set_tid(params->thread_id + 1);
+  t0 = trace_now();
+
+  params->best_id = 0;
+  params->best_score = -1;
+  params->best_UdX = params->best_Xnormsq = 0;
+
+  for(a = params->thread_id; a < kmer_num; a += params->thread_num){
+    const unsigned int rc_a = rc[a];
+    num = 0;
+
+    /* rows with f_r[a] != 0 : M, A1 and C */
+    for(e = index->kmer_ptr[a]; e < index->kmer_ptr[a + 1]; e++){
+      const double fa = index->kmer_val[e];
+      const double fa2 = fa * fa;
+      int scattered = 0;
+      bin = index->kmer_bin[e];
+      for(t = index->i_ptr[bin]; t < index->i_ptr[bin + 1]; t++){
+	const unsigned int hj = h_j[index->i_row[t]];
+	const double u = U[index->i_row[t]] * fa;
+	const double w = fa * sp_feature(feat, hj, rc_a);
+	const unsigned long q0 =
+	  sp_lower_bound(index->rc_idx, feat->ptr[hj], feat->ptr[hj + 1], a);
+	for(q = q0; q < feat->ptr[hj + 1]; q++){
+	  b = rc[index->rc_idx[q]];
+	  acc[b].M += u * index->rc_val[q];
+	  acc[b].A1 += fa2 * index->rc_val[q] * index->rc_val[q];
+	  if(mark[b] == 0){
+	    mark[b] = 1;
+	    touched[num++] = b;
+	  }
+	}
+	if(w != 0){
+	  if(scattered == 0){
+	    /* f_r (= f_bin) as a dense vector for the lookups of f_r[rc(b)] */
+	    for(q = feat->ptr[bin]; q < feat->ptr[bin + 1]; q++){
+	      fd[feat->idx[q]] = feat->val[q];
+	    }
+	    scattered = 1;
+	  }
+	  for(q = q0; q < feat->ptr[hj + 1]; q++){
+	    acc[rc[index->rc_idx[q]]].C +=
+	      w * fd[index->rc_idx[q]] * index->rc_val[q];
+	  }
+	}
+      }
+      if(scattered != 0){
+	for(q = feat->ptr[bin]; q < feat->ptr[bin + 1]; q++){
+	  fd[feat->idx[q]] = 0;
+	}
+      }
+    }
+
+    /* rows with g_r[rc(a)] != 0 : N and A2 */
+    for(e = index->kmer_ptr[rc_a]; e < index->kmer_ptr[rc_a + 1]; e++){
+      const double g = index->kmer_val[e];
+      const double g2 = g * g;
+      bin = index->kmer_bin[e];
+      for(t = index->j_ptr[bin]; t < index->j_ptr[bin + 1]; t++){
+	const unsigned int hi = h_i[index->j_row[t]];
+	const double u = U[index->j_row[t]] * g;
+	for(q = sp_lower_bound(feat->idx, feat->ptr[hi], feat->ptr[hi + 1], a);
+	    q < feat->ptr[hi + 1]; q++){
+	  x = feat->idx[q];
+	  acc[x].N += u * feat->val[q];
+	  acc[x].A2 += g2 * feat->val[q] * feat->val[q];
+	  if(mark[rc[x]] == 0){
+	    mark[rc[x]] = 1;
+	    touched[num++] = rc[x];
+	  }
+	}
+      }
+    }
+
+    /* scores of the canonical pairs (a, b), reset the accumulators */
+    for(t = 0; t < num; t++){
+      b = touched[t];
+      id = (a << k2) | b;
+      id_rc = ((unsigned long)rc[b] << k2) | rc_a;
+      if(id <= id_rc){
+	const double UdX = acc[b].M + acc[rc[b]].N;
+	const double Xnormsq = acc[b].A1 + acc[rc[b]].A2 + 2 * acc[b].C;
+	const double score = boost_score(UdX, Xnormsq);
+	if(score > params->best_score ||
+	   (score == params->best_score && id < params->best_id)){
+	  params->best_id = id;
+	  params->best_score = score;
+	  params->best_UdX = UdX;
+	  params->best_Xnormsq = Xnormsq;
+	}
+      }
+      acc[b].M = acc[b].A1 = acc[b].C = 0;
+      acc[rc[b]].N = acc[rc[b]].A2 = 0;
+      mark[b] = 0;
+    }
+  }
+  trace_span("sp_search", -1, t0, trace_now());
+  if(perf_enabled()){
+    perf_thread_end(&perf, &perf_start, &params->perf);
+  }
+  return NULL;
+}
+
+/* pred[] += \sum_id beta[id] X^{(id)} (axes in ascending order of id) */
+int sp_predict(const cmd_args *args,
+	       const sp_features *feat,
+	       const hic *data,
+	       const sp_beta *beta,
+	       double *pred){
+  unsigned int *rc = kmer_revcmp_table(feat->k);
+  unsigned long *ids = calloc_errchk(beta->num + 1, sizeof(unsigned long),
+				     "calloc ids[]");
+  unsigned long slot, num = 0, t, r;
+
+  for(slot = 0; slot < beta->size; slot++){
+    if(beta->key[slot] != SP_BETA_EMPTY){
+      ids[num++] = beta->key[slot];
+    }
+  }
+  qsort(ids, num, sizeof(unsigned long), ulong_cmp);
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "sparse model with %ld axes\n", num);
+
+  for(t = 0; t < num; t++){
+    const double b = sp_beta_get(beta, ids[t]);
+    if(b != 0){
+      for(r = 0; r < data->nrow; r++){
+	pred[r] += b * sp_column(feat, rc, data, ids[t], r);
+      }
+    }
+  }
+
+  free(ids);
+  free(rc);
+  return 0;
+}
+
+/**
+ * L2 Boosting over the implicitly enumerated canonical k-mer pairs
+ *  (the model is stored in (*model)->beta_sp)
+ */
+int sparse_train(const cmd_args *args,
+		 const sp_features *feat,
+		 const hic *data,
+		 const double v,
+		 boost **model,
+		 FILE *fp){
+  const unsigned long n = data->nrow;
+  const unsigned long kmer_num = 1UL << (2 * args->k);
+  const int thread_num = args->thread_num;
+  unsigned int *rc = kmer_revcmp_table(args->k);
+  sp_index *index;
+  sp_search_args *params;
+  pthread_t *threads;
+  double *U;
+  unsigned int m;
+  unsigned long r;
+  int t;
+  double time_start, time_prev, time;
+  metrics_phase ph;
+
+  metrics_begin(&ph);
+  sp_index_build(args, feat, data, &index);
+  metrics_end(&ph, "sp_index", -1, 0, NULL, 0);
+
+  /* initialize residuals U[] := Y[] and
+   * compute \sum_i U[i]^2                */
+  U = calloc_errchk(n, sizeof(double), "calloc U[]");
+  ((*model)->res_sq)[0] = l2_set_U(U, n, data->mij);
+
+  /* If we load some model from a file, update residuals */
+  if(((*model)->nextiter) > 1){
+    double *pred = calloc_errchk(n, sizeof(double), "calloc pred[]");
+    fprintf(stderr, "%s [INFO] ", args->prog_name);
+    fprintf(stderr, "start computation of residuals\n");
+    sp_predict(args, feat, data, (*model)->beta_sp, pred);
+    for(r = 0; r < n; r++){
+      U[r] -= pred[r];
+    }
+    free(pred);
+  }
+
+  /* per-thread accumulators */
+  params = calloc_errchk(thread_num, sizeof(sp_search_args),
+			 "calloc sp_search_args[]");
+  threads = calloc_errchk(thread_num, sizeof(pthread_t), "calloc threads[]");
+  for(t = 0; t < thread_num; t++){
+    params[t].thread_id = t;
+    params[t].thread_num = thread_num;
+    params[t].feat = feat;
+    params[t].index = index;
+    params[t].data = data;
+    params[t].rc = rc;
+    params[t].U = U;
+    params[t].acc = calloc_errchk(kmer_num, sizeof(sp_acc), "calloc acc[]");
+    params[t].fd = calloc_errchk(kmer_num, sizeof(double), "calloc fd[]");
+    params[t].touched = calloc_errchk(kmer_num, sizeof(unsigned int),
+				      "calloc touched[]");
+    params[t].mark = calloc_errchk(kmer_num, sizeof(unsigned char),
+				   "calloc mark[]");
+  }
+
+  fprintf(stderr, "%s [INFO] ", args->prog_name);
+  fprintf(stderr, "start sparse L2 Boosting over the canonical %d-mer pairs with %d threads\n",
+	  args->k, thread_num);
+
+  time_prev = trace_now();
+  time_start = time_prev;
+
+  for(m = (*model)->nextiter; m <= (*model)->iternum; m++){
+    unsigned long s = 0;
+    double UdX = 0, Xnormsq = 0, score = -1, gamma, sum = 0;
+    metrics_phase ph_iter;
+
+    metrics_begin(&ph_iter);
+
+    /* UdX and selection are fused in sp_search() */
+    metrics_begin(&ph);
+    for(t = 0; t < thread_num; t++){
+      pthread_create(&threads[t], NULL, sp_search, (void*)&params[t]);
+    }
+    for(t = 0; t < thread_num; t++){
+      pthread_join(threads[t], NULL);
+      metrics_perf_add(&params[t].perf);
+    }
+
+    /* select axis */
+    for(t = 0; t < thread_num; t++){
+      if(params[t].best_score > score ||
+	 (params[t].best_score == score && params[t].best_id < s)){
+	s = params[t].best_id;
+	score = params[t].best_score;
+	UdX = params[t].best_UdX;
+	Xnormsq = params[t].best_Xnormsq;
+      }
+    }
+
+    metrics_end(&ph, "search", m, 0, NULL, 0);
+
+    gamma = (Xnormsq > 0) ? UdX / Xnormsq : 0;
+    sp_beta_add((*model)->beta_sp, s, v * gamma);
+
+    /* Update U[] and sum of residual square */
+    metrics_begin(&ph);
+    for(r = 0; r < n; r++){
+      U[r] -= v * gamma * sp_column(feat, rc, data, s, r);
+      sum += U[r] * U[r] / n;
+    }
+    ((*model)->res_sq)[m] = sum;
+    metrics_end(&ph, "update", m, 0, NULL, 0);
+
+    time = trace_now();
+    boost_step_dump(*model,
+		    (const unsigned int)m,
+		    (const unsigned long)s,
+		    v * (const double)gamma,
+		    (const double)(time - time_prev),
+		    (const double)(time - time_start),
+		    fp);
+    fprintf(stderr, "%s [INFO] \t ", args->prog_name);
+    boost_step_dump(*model,
+		    (const unsigned int)m,
+		    (const unsigned long)s,
+		    v * (const double)gamma,
+		    (const double)(time - time_prev),
+		    (const double)(time - time_start),
+		    stderr);
+    time_prev = time;
+    metrics_end(&ph_iter, "iteration", m, 0, NULL, 0);
+  }
+
+  for(t = 0; t < thread_num; t++){
+    free(params[t].acc);
+    free(params[t].fd);
+    free(params[t].touched);
+    free(params[t].mark);
+  }
+  free(params);
+  free(threads);
+  free(U);
+  free(rc);
+  free(index->kmer_ptr);
+  free(index->kmer_bin);
+  free(index->kmer_val);
+  free(index->i_ptr);
+  free(index->i_row);
+  free(index->j_ptr);
+  free(index->j_row);
+  free(index->rc_idx);
+  free(index->rc_val);
+  free(index);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,290 @@
+#ifndef __SYNTH_H__
+#define __SYNTH_H__
+
+/**
+ * synthetic inputs
+ *  a random sequence with N gaps, the k-mer and canonical k-mer pair
+ *  files of any size, and a band-limited Hi-C contact list whose values
+ *  are a sparse linear model of the pairwise features (the planted
+ *  k-mer pairs) plus Gaussian noise. Every generator draws from a 64-bit
+ *  LCG, so that a seed reproduces the same files on any platform.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "constant.h"
+#include "calloc_errchk.h"
+#include "cmd_args.h"
+#include "kmer.h"
+
+unsigned long synth_rand(unsigned long *state);
+double synth_unif(unsigned long *state);
+double synth_normal(unsigned long *state);
+void synth_kmer_str(const unsigned int kmer,
+		    const int k,
+		    char *str);
+int synth_fasta(const char *file,
+		const char *name,
+		const unsigned long len,
+		const unsigned long gap_num,
+		const unsigned long gap_len,
+		unsigned long *state);
+int synth_kmer(const char *file,
+	       const int k);
+unsigned long synth_ckp(const char *file,
+			const int k,
+			const unsigned long max_num,
+			unsigned long *state);
+unsigned long synth_hic(const cmd_args *args,
+			const double **features,
+			const unsigned long bin_num,
+			const canonical_kp *ckps,
+			const unsigned long dmin,
+			const unsigned long dmax,
+			const double density,
+			const unsigned long planted,
+			const double snr,
+			const char *truth_file,
+			unsigned long *state);
+
+static FILE *synth_fopen(const char *file){
+  FILE *fp;
+  if((fp = fopen(file, "w")) == NULL){
+    fprintf(stderr, "error: fopen %s\n%s\n", file, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  return fp;
+}
+
+/* 64-bit LCG (Knuth MMIX), 31 high bits */
+unsigned long synth_rand(unsigned long *state){
+  *state = *state * 6364136223846793005UL + 1442695040888963407UL;
+  return *state >> 33;
+}
+
+/* uniform in [0, 1) */
+double synth_unif(unsigned long *state){
+  return synth_rand(state) / 2147483648.0;
+}
+
+/* standard normal (Box-Muller) */
+double synth_normal(unsigned long *state){
+  const double u1 = 1.0 - synth_unif(state);
+  const double u2 = synth_unif(state);
+  return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+void synth_kmer_str(const unsigned int kmer,
+		    const int k,
+		    char *str){
+  int l;
+  for(l = 0; l < k; l++){
+    str[l] = "ACGT"[(kmer >> (2 * (k - 1 - l))) & 3];
+  }
+  str[k] = '\0';
+}
+
+/**
+ * random sequence of len bp, 60 bp per line, with gap_num runs of
+ * gap_len 'N' at random positions
+ */
+int synth_fasta(const char *file,
+		const char *name,
+		const unsigned long len,
+		const unsigned long gap_num,
+		const unsigned long gap_len,
+		unsigned long *state){
+  char *seq = calloc_errchk(len + 1, sizeof(char), "calloc seq");
+  unsigned long i, g;
+  FILE *fp;
+
+  for(i = 0; i < len; i++){
+    seq[i] = "ACGT"[synth_rand(state) & 3];
+  }
+  if(gap_len < len){
+    for(g = 0; g < gap_num; g++){
+      const unsigned long begin = synth_rand(state) % (len - gap_len);
+      memset(seq + begin, 'N', gap_len);
+    }
+  }
+
+  fp = synth_fopen(file);
+  fprintf(fp, ">%s\n", name);
+  for(i = 0; i < len; i += 60){
+    fprintf(fp, "%.*s\n", (int)((len - i < 60) ? len - i : 60), seq + i);
+  }
+  fclose(fp);
+  free(seq);
+  return 0;
+}
+
+/* every k-mer, in the format of kmer_read() */
+int synth_kmer(const char *file,
+	       const int k){
+  const unsigned int kmer_num = 1U << (2 * k);
+  char str[BUF_SIZE];
+  unsigned int a;
+  FILE *fp = synth_fopen(file);
+  for(a = 0; a < kmer_num; a++){
+    synth_kmer_str(a, k, str);
+    fprintf(fp, "%d\t%s\n", a, str);
+  }
+  fclose(fp);
+  return 0;
+}
+
+/**
+ * canonical k-mer pairs, in the format of canonical_kp_read()
+ *  (a, b) is canonical when it precedes (rc(b), rc(a)). When max_num is
+ *  smaller than the number of canonical pairs (or max_num = 0 : all),
+ *  max_num of them are selected uniformly, in order (selection sampling).
+ *  returns the number of pairs written
+ */
+unsigned long synth_ckp(const char *file,
+			const int k,
+			const unsigned long max_num,
+			unsigned long *state){
+  const unsigned long kmer_num = 1UL << (2 * k);
+  const unsigned long total = (kmer_num * kmer_num + kmer_num) / 2;
+  const unsigned long num = (max_num == 0 || max_num > total) ?
+    total : max_num;
+  unsigned int *rc = kmer_revcmp_table(k);
+  char s1[BUF_SIZE], s2[BUF_SIZE], s3[BUF_SIZE], s4[BUF_SIZE];
+  unsigned long a, b, seen = 0, written = 0;
+  FILE *fp = synth_fopen(file);
+
+  for(a = 0; a < kmer_num && written < num; a++){
+    for(b = 0; b < kmer_num && written < num; b++){
+      if(a < rc[b] || (a == rc[b] && b <= rc[a])){
+	if((total - seen) * synth_unif(state) < num - written){
+	  synth_kmer_str(a, k, s1);
+	  synth_kmer_str(b, k, s2);
+	  synth_kmer_str(rc[b], k, s3);
+	  synth_kmer_str(rc[a], k, s4);
+	  fprintf(fp, "%ld\t%ld\t%d\t%d\t%s\t%s\t%s\t%s\n",
+		  a, b, rc[b], rc[a], s1, s2, s3, s4);
+	  written++;
+	}
+	seen++;
+      }
+    }
+  }
+  fclose(fp);
+  free(rc);
+  return written;
+}
+
+/**
+ * Hi-C contact list of the valid bins (features != NULL) i < j with
+ * dmin <= j - i <= dmax, each kept with probability density
+ *  mij = sum_s beta_s X_s(i, j) / sd + N(0, 1 / snr)
+ * where X_s is the pairwise feature of the s-th planted pair (as in
+ * l2kernel.h), beta_s = +-(1 + U(0, 1)) and sd the standard deviation of
+ * the planted signal. The planted pairs (row of ckps, k-mers, beta_s)
+ * are written to truth_file. Rows are written to args->hic_file in bp.
+ *  returns the number of rows
+ */
+unsigned long synth_hic(const cmd_args *args,
+			const double **features,
+			const unsigned long bin_num,
+			const canonical_kp *ckps,
+			const unsigned long dmin,
+			const unsigned long dmax,
+			const double density,
+			const unsigned long planted,
+			const double snr,
+			const char *truth_file,
+			unsigned long *state){
+  const unsigned long s_num = (planted < ckps->num) ? planted : ckps->num;
+  unsigned long *idx = calloc_errchk(s_num, sizeof(unsigned long),
+				     "calloc idx");
+  double *beta = calloc_errchk(s_num, sizeof(double), "calloc beta");
+  unsigned long *row_i, *row_j, row_num = 0, row_max = 0;
+  double *y, sum = 0, sum_sq = 0, sd;
+  unsigned long i, d, r, s;
+  FILE *fp;
+
+  /* planted pairs */
+  for(s = 0; s < s_num; s++){
+    unsigned long t;
+    do{
+      idx[s] = synth_rand(state) % ckps->num;
+      for(t = 0; t < s && idx[t] != idx[s]; t++);
+    }while(t < s);
+    beta[s] = ((synth_rand(state) & 1) ? 1.0 : -1.0) *
+      (1.0 + synth_unif(state));
+  }
+
+  /* rows */
+  for(i = 0; i < bin_num; i++){
+    if(features[i] != NULL){
+      for(d = dmin; d <= dmax && i + d < bin_num; d++){
+	row_max++;
+      }
+    }
+  }
+  row_i = calloc_errchk(row_max + 1, sizeof(unsigned long), "calloc row_i");
+  row_j = calloc_errchk(row_max + 1, sizeof(unsigned long), "calloc row_j");
+  y     = calloc_errchk(row_max + 1, sizeof(double), "calloc y");
+
+  for(i = 0; i < bin_num; i++){
+    if(features[i] == NULL){
+      continue;
+    }
+    for(d = dmin; d <= dmax && i + d < bin_num; d++){
+      if(features[i + d] == NULL || synth_unif(state) >= density){
+	continue;
+      }
+      row_i[row_num] = i;
+      row_j[row_num] = i + d;
+      for(s = 0; s < s_num; s++){
+	const unsigned long c = idx[s];
+	y[row_num] += beta[s] *
+	  (features[i][ckps->kmer1[c]] * features[i + d][ckps->kmer2[c]] +
+	   features[i][ckps->revcmp1[c]] * features[i + d][ckps->revcmp2[c]]);
+      }
+      sum += y[row_num];
+      sum_sq += y[row_num] * y[row_num];
+      row_num++;
+    }
+  }
+
+  sd = (row_num > 1) ?
+    sqrt((sum_sq - sum * sum / row_num) / (row_num - 1)) : 0;
+  if(sd <= 0){
+    sd = 1;
+  }
+
+  fp = synth_fopen(args->hic_file);
+  for(r = 0; r < row_num; r++){
+    fprintf(fp, "%ld\t%ld\t%e\n",
+	    row_i[r] * args->res, row_j[r] * args->res,
+	    y[r] / sd + ((snr > 0) ? synth_normal(state) / sqrt(snr) : 0));
+  }
+  fclose(fp);
+
+  if(truth_file != NULL){
+    char s1[BUF_SIZE], s2[BUF_SIZE];
+    fp = synth_fopen(truth_file);
+    fprintf(fp, "axis\tkmer1\tkmer2\tbeta\n");
+    for(s = 0; s < s_num; s++){
+      synth_kmer_str(ckps->kmer1[idx[s]], args->k, s1);
+      synth_kmer_str(ckps->kmer2[idx[s]], args->k, s2);
+      fprintf(fp, "%ld\t%s\t%s\t%e\n", idx[s], s1, s2, beta[s]);
+    }
+    fclose(fp);
+  }
+
+  free(idx);
+  free(beta);
+  free(row_i);
+  free(row_j);
+  free(y);
+  return row_num;
+}
+
+#endif
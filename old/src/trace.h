@@ -0,0 +1,149 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+/**
+ * timeline of the run (--trace FILE)
+ *  spans (name, begin, duration, iteration, thread) are recorded into a
+ *  ring buffer of TRACE_RING_SIZE events (the oldest are overwritten) and
+ *  written at exit in the Chrome trace event format, which
+ *  chrome://tracing and Perfetto open. The main thread is tid 0 and the
+ *  workers are tid 1, 2, ... (trace_set_tid()).
+ *  trace_now() is the monotonic clock of the timings of the trainers.
+ *  Without --trace, trace_span() returns at once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#include "constant.h"
+#include "calloc_errchk.h"
+#include "cmd_args.h"
+
+#define TRACE_RING_SIZE (1UL << 18)
+
+/* name : a string literal (kept by pointer) */
+typedef struct _trace_event{
+  const char *name;
+  double ts;
+  double dur;
+  long iter;
+  int tid;
+} trace_event;
+
+typedef struct _trace_ring{
+  const char *file;
+  trace_event *ev;
+  _Atomic unsigned long next;
+  double t0;
+} trace_ring;
+
+static trace_ring trace_global;
+static __thread int trace_tid = 0;
+
+double trace_now(void);
+int trace_open(const cmd_args *args);
+int trace_close(void);
+int trace_enabled(void);
+void trace_set_tid(const int tid);
+void trace_span(const char *name,
+		const long iter,
+		const double begin,
+		const double end);
+
+/* monotonic clock, seconds */
+double trace_now(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int trace_enabled(void){
+  return trace_global.ev != NULL;
+}
+
+int trace_open(const cmd_args *args){
+  if(args->trace_file == NULL){
+    return 0;
+  }
+  trace_global.file = args->trace_file;
+  trace_global.ev = calloc_errchk(TRACE_RING_SIZE, sizeof(trace_event),
+				  "calloc trace_event[]");
+  atomic_store(&trace_global.next, 0);
+  trace_global.t0 = trace_now();
+  return 0;
+}
+
+/* tid of the calling thread in the trace (0 : main thread) */
+void trace_set_tid(const int tid){
+  trace_tid = tid;
+}
+
+/* span [begin, end) of trace_now() on the calling thread */
+void trace_span(const char *name,
+		const long iter,
+		const double begin,
+		const double end){
+  trace_event *e;
+  if(trace_global.ev == NULL){
+    return;
+  }
+  e = &trace_global.ev[atomic_fetch_add(&trace_global.next, 1) &
+		       (TRACE_RING_SIZE - 1)];
+  e->name = name;
+  e->ts = (begin - trace_global.t0) * 1e6;
+  e->dur = (end - begin) * 1e6;
+  e->iter = iter;
+  e->tid = trace_tid;
+}
+
+/* write the events in the ring (oldest first) and release it */
+int trace_close(void){
+  const unsigned long next = atomic_load(&trace_global.next);
+  const unsigned long first =
+    (next > TRACE_RING_SIZE) ? next - TRACE_RING_SIZE : 0;
+  unsigned long i;
+  int t, tid_max = 0;
+  FILE *fp;
+  if(trace_global.ev == NULL){
+    return 0;
+  }
+  if((fp = fopen(trace_global.file, "w")) == NULL){
+    fprintf(stderr, "error: fopen %s\n%s\n",
+	    trace_global.file, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  for(i = first; i < next; i++){
+    const int tid = trace_global.ev[i & (TRACE_RING_SIZE - 1)].tid;
+    tid_max = (tid > tid_max) ? tid : tid_max;
+  }
+  fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  for(t = 0; t <= tid_max; t++){
+    char name[BUF_SIZE];
+    if(t == 0){
+      sprintf(name, "main");
+    }else{
+      sprintf(name, "worker %d", t);
+    }
+    fprintf(fp, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+	    "\"tid\": %d, \"args\": {\"name\": \"%s\"}}\n",
+	    (t == 0) ? "" : ",", t, name);
+  }
+  for(i = first; i < next; i++){
+    const trace_event *e = &trace_global.ev[i & (TRACE_RING_SIZE - 1)];
+    fprintf(fp, ",{\"name\": \"%s\", \"cat\": \"qloop\", \"ph\": \"X\", "
+	    "\"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d, "
+	    "\"args\": {\"iter\": %ld}}\n",
+	    e->name, e->ts, e->dur, e->tid, e->iter);
+  }
+  fprintf(fp, "]}\n");
+  fclose(fp);
+  free(trace_global.ev);
+  trace_global.ev = NULL;
+  return 0;
+}
+
+#endif
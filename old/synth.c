@@ -0,0 +1,166 @@
+#include <stdio.h>
+
+#include "src/constant.h"
+#include "src/cmd_args.h"
+#include "src/fasta.h"
+#include "src/kmer.h"
+#include "src/synth.h"
+
+/**
+ * synth : reproducible synthetic inputs of twin / pred
+ *  writes <out>.fa, <out>.hic, <out>.ckp, <out>.kmer and <out>.truth
+ *  (the planted k-mer pairs, see synth_hic() in src/synth.h)
+ */
+
+typedef struct _synth_args {
+  int k;
+  int res;
+  unsigned long len;
+  unsigned long gaps;
+  unsigned long gap_len;
+  unsigned long dmin;
+  unsigned long dmax;
+  double density;
+  unsigned long pairs;
+  unsigned long planted;
+  double snr;
+  unsigned long seed;
+  f_norm f_norm;
+  char *out;
+} synth_args;
+
+static int synth_usage(FILE *fp,
+		       const char *prog_name){
+  fprintf(fp, "%s [INFO] ", prog_name);
+  fprintf(fp, "usage:\n");
+  fprintf(fp,
+	  "%s -k k --res r --len L [--gaps G] [--gap_len g] [--dmin d] [--dmax D] [--density p] [--pairs P] [--planted S] [--snr R] [--seed s] [--f_norm L1|L2] --out o \n",
+	  prog_name);
+  return 0;
+}
+
+int main(int argc, char **argv){
+  synth_args sargs = {4, 1000, 0, 0, 10000, 1, 20, 1.0, 0, 10, 4.0,
+		      20160721UL, L1, NULL};
+  char fasta_file[F_NAME_LEN], hic_file[F_NAME_LEN];
+  char ckp_file[F_NAME_LEN], kmer_file[F_NAME_LEN], truth_file[F_NAME_LEN];
+  cmd_args args;
+
+  {
+    int opt, opt_idx = 0;
+    struct option long_opts[] = {
+      {"help",     no_argument,       NULL, 'h'},
+      {"k",        required_argument, NULL, 'k'},
+      {"res",      required_argument, NULL, 'r'},
+      {"len",      required_argument, NULL, 'l'},
+      {"gaps",     required_argument, NULL, 'g'},
+      {"gap_len",  required_argument, NULL, 'G'},
+      {"dmin",     required_argument, NULL, 'd'},
+      {"dmax",     required_argument, NULL, 'D'},
+      {"density",  required_argument, NULL, 'p'},
+      {"pairs",    required_argument, NULL, 'P'},
+      {"planted",  required_argument, NULL, 'S'},
+      {"snr",      required_argument, NULL, 'R'},
+      {"seed",     required_argument, NULL, 's'},
+      {"f_norm",   required_argument, NULL, 'L'},
+      {"out",      required_argument, NULL, 'o'},
+      {0, 0, 0, 0}
+    };
+
+    while((opt = getopt_long(argc, argv, "hk:r:l:g:G:d:D:p:P:S:R:s:L:o:",
+			     long_opts, &opt_idx)) != -1){
+      switch(opt){
+	case 'h':
+	  synth_usage(stdout, argv[0]);
+	  return 0;
+	case 'k': sargs.k = atoi(optarg); break;
+	case 'r': sargs.res = atoi(optarg); break;
+	case 'l': sargs.len = strtoul(optarg, NULL, 10); break;
+	case 'g': sargs.gaps = strtoul(optarg, NULL, 10); break;
+	case 'G': sargs.gap_len = strtoul(optarg, NULL, 10); break;
+	case 'd': sargs.dmin = strtoul(optarg, NULL, 10); break;
+	case 'D': sargs.dmax = strtoul(optarg, NULL, 10); break;
+	case 'p': sargs.density = strtod(optarg, NULL); break;
+	case 'P': sargs.pairs = strtoul(optarg, NULL, 10); break;
+	case 'S': sargs.planted = strtoul(optarg, NULL, 10); break;
+	case 'R': sargs.snr = strtod(optarg, NULL); break;
+	case 's': sargs.seed = strtoul(optarg, NULL, 10); break;
+	case 'L':
+	  if(strcmp(optarg, "L1") == 0){
+	    sargs.f_norm = L1;
+	  }else if(strcmp(optarg, "L2") == 0){
+	    sargs.f_norm = L2;
+	  }
+	  break;
+	case 'o': sargs.out = optarg; break;
+	default:
+	  synth_usage(stderr, argv[0]);
+	  exit(EXIT_FAILURE);
+      }
+    }
+
+    if(sargs.k <= 0 || sargs.k > 6 || sargs.res <= 0 ||
+       sargs.len < (unsigned long)sargs.res * (sargs.dmax + 2) ||
+       sargs.dmin < 1 || sargs.dmax < sargs.dmin ||
+       sargs.density <= 0 || sargs.density > 1 || sargs.out == NULL ||
+       strlen(sargs.out) + 8 > F_NAME_LEN){
+      fprintf(stderr, "%s [ERROR] ", argv[0]);
+      fprintf(stderr, "invalid arguments\n");
+      synth_usage(stderr, argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  sprintf(fasta_file, "%s.fa", sargs.out);
+  sprintf(hic_file, "%s.hic", sargs.out);
+  sprintf(ckp_file, "%s.ckp", sargs.out);
+  sprintf(kmer_file, "%s.kmer", sargs.out);
+  sprintf(truth_file, "%s.truth", sargs.out);
+
+  /* the features of the planted model are computed by set_features(),
+   * with the settings twin is expected to run with */
+  memset(&args, 0, sizeof(cmd_args));
+  args.k = sargs.k;
+  args.res = sargs.res;
+  args.fasta_file = fasta_file;
+  args.hic_file = hic_file;
+  args.kmer_pair = ckp_file;
+  args.kmer = kmer_file;
+  args.prog_name = argv[0];
+  args.f_norm = sargs.f_norm;
+
+  {
+    unsigned long state = sargs.seed, bin_num, pair_num, row_num;
+    double **features;
+    canonical_kp *ckps;
+
+    synth_fasta(fasta_file, "chrS", sargs.len, sargs.gaps, sargs.gap_len,
+		&state);
+    synth_kmer(kmer_file, sargs.k);
+    pair_num = synth_ckp(ckp_file, sargs.k, sargs.pairs, &state);
+
+    fprintf(stderr, "%s [INFO] ", argv[0]);
+    fprintf(stderr, "%s : %ld bp, %ld gaps of %ld bp\n",
+	    fasta_file, sargs.len, sargs.gaps, sargs.gap_len);
+    fprintf(stderr, "%s [INFO] ", argv[0]);
+    fprintf(stderr, "%s : %ld canonical %d-mer pairs\n",
+	    ckp_file, pair_num, sargs.k);
+
+    set_features_bins(&args, &features, &bin_num);
+    canonical_kp_read(&args, &ckps);
+
+    row_num = synth_hic(&args, (const double **)features, bin_num, ckps,
+			sargs.dmin, sargs.dmax, sargs.density,
+			sargs.planted, sargs.snr, truth_file, &state);
+
+    fprintf(stderr, "%s [INFO] ", argv[0]);
+    fprintf(stderr, "%s : %ld rows (%ld <= j - i <= %ld bins)\n",
+	    hic_file, row_num, sargs.dmin, sargs.dmax);
+    fprintf(stderr, "%s [INFO] ", argv[0]);
+    fprintf(stderr, "%s : %ld planted pairs, snr = %f\n",
+	    truth_file, (sargs.planted < pair_num) ? sargs.planted : pair_num,
+	    sargs.snr);
+  }
+
+  return 0;
+}
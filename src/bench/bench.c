@@ -0,0 +1,448 @@
+/**
+ * qloop_bench : microbenchmarks of the hot kernels of the trainer
+ *
+ * The inputs (FASTA, Hi-C and k-mer files) are synthetic and generated
+ * from a fixed seed into a temporary directory, so that two versions can
+ * be compared on the same data. Every kernel is run `reps' times and the
+ * best time is reported as ns/row, GB/s and GFLOP/s (bytes and flops are
+ * counted from the access pattern of the kernel, see bench_kernels()).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "config.h"
+
+#include "constant.h"
+#include "cmd_args.h"
+#include "fasta.h"
+#include "hic.h"
+#include "kmer.h"
+#include "l2boost.h"
+#include "pred.h"
+#include "synth.h"
+
+#define BENCH_SEED 20160721UL
+#define BENCH_MAX 16
+
+typedef struct _bench_opts{
+  int k;
+  unsigned long bins;
+  unsigned long rows;
+  int reps;
+  int threads;
+  const char *json;
+} bench_opts;
+
+/* one line of the report */
+typedef struct _bench_result{
+  const char *name;
+  const char *row;       /* what a row is for this kernel */
+  unsigned long rows;
+  double sec;            /* best of reps */
+  double bytes;          /* per run */
+  double flops;          /* per run */
+} bench_result;
+
+static double bench_now(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double bench_file_size(const char *file){
+  struct stat st;
+  return (stat(file, &st) == 0) ? (double)st.st_size : 0;
+}
+
+static FILE *bench_fopen(const char *file){
+  FILE *fp;
+  if((fp = fopen(file, "w")) == NULL){
+    fprintf(stderr, "error: fopen %s\n%s\n", file, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  return fp;
+}
+
+/**
+ * synthetic inputs (see synth.h)
+ *  fasta : random sequence of bins x res bp
+ *  hic   : rows between bins 1 to 20 apart, uniform values in [-1, 1)
+ *  ckp   : every canonical k-mer pair, in the order of the pair files
+ *  kmer  : every k-mer
+ */
+static void bench_inputs(const bench_opts *opts,
+			 const cmd_args *args){
+  unsigned long state = BENCH_SEED;
+  unsigned long i;
+  FILE *fp;
+
+  synth_fasta(args->fasta_file, "synthetic", opts->bins * args->res, 0, 0,
+	      &state);
+
+  fp = bench_fopen(args->hic_file);
+  for(i = 0; i < opts->rows; i++){
+    const unsigned long bin = 1 + synth_rand(&state) % (opts->bins - 22);
+    const unsigned long dist = 1 + synth_rand(&state) % 20;
+    fprintf(fp, "%ld\t%ld\t%e\n", bin * args->res, (bin + dist) * args->res,
+	    2.0 * synth_unif(&state) - 1.0);
+  }
+  fclose(fp);
+
+  synth_ckp(args->kmer_pair, opts->k, 0, &state);
+  synth_kmer(args->kmer, opts->k);
+}
+
+/* run stmt reps times, keep the best time */
+#define BENCH_RUN(result, reps, stmt) {		\
+    int rep_;					\
+    double t0_;					\
+    (result)->sec = -1;				\
+    for(rep_ = 0; rep_ < (reps); rep_++){	\
+      t0_ = bench_now();			\
+      stmt;					\
+      t0_ = bench_now() - t0_;			\
+      if((result)->sec < 0 || t0_ < (result)->sec){	\
+	(result)->sec = t0_;			\
+      }						\
+    }						\
+  }
+
+static int bench_kernels(const bench_opts *opts,
+			 cmd_args *args,
+			 bench_result *res){
+  const int thread_num = opts->threads;
+  const l2_kernels *kern = l2_kernels_select(DOUBLE, args->k);
+  int num = 0;
+  double **features = NULL;
+  hic *data = NULL;
+  canonical_kp *ckps = NULL;
+  kmer *kmers = NULL;
+  unsigned long n, p, j, s = 0;
+  double *U, *UdX, *Xnormsq, *res_sq, *beta_x, *pred;
+  cmpUdX_args *params;
+  pthread_t *threads;
+  boost model;
+
+  /* readers : GB/s of the input file */
+  res[num] = (bench_result){"set_features", "bin", opts->bins, 0,
+			    bench_file_size(args->fasta_file), 0};
+  BENCH_RUN(&res[num], opts->reps,
+	    if(features != NULL){
+	      free(features_block((const void **)features, opts->bins,
+				  ((size_t)1 << (2 * args->k)) *
+				  sizeof(double)));
+	      free(features);
+	    }
+	    set_features(args, &features));
+  num++;
+
+  res[num] = (bench_result){"hic_read", "hic row", opts->rows, 0,
+			    bench_file_size(args->hic_file), 0};
+  BENCH_RUN(&res[num], opts->reps,
+	    if(data != NULL){
+	      free(data->i); free(data->j); free(data->mij); free(data);
+	    }
+	    hic_read(args, &data));
+  num++;
+
+  res[num] = (bench_result){"canonical_kp_read", "pair", 0, 0,
+			    bench_file_size(args->kmer_pair), 0};
+  BENCH_RUN(&res[num], opts->reps,
+	    if(ckps != NULL){
+	      free(ckps->kmer1); free(ckps->kmer2);
+	      free(ckps->revcmp1); free(ckps->revcmp2); free(ckps);
+	    }
+	    canonical_kp_read(args, &ckps));
+  res[num].rows = ckps->num;
+  num++;
+
+  kmer_read(args, &kmers);
+
+  n = data->nrow;
+  p = ckps->num;
+  U       = calloc_errchk(n, sizeof(double), "calloc U[]");
+  UdX     = calloc_errchk(p, sizeof(double), "calloc UdX[]");
+  Xnormsq = calloc_errchk(p, sizeof(double), "calloc Xnormsq[]");
+  res_sq  = calloc_errchk(2, sizeof(double), "calloc res_sq[]");
+  beta_x  = calloc_errchk(2 * n, sizeof(double), "calloc beta_x[]");
+  kern->set_U(U, n, data->mij);
+
+  boost_pthread_prep(thread_num, n, p,
+		     (const void *)features, data, ckps, NULL,
+		     U, UdX, Xnormsq,
+		     &params, &threads);
+
+  /* column kernels : per (row, column), 2 bin indices (8 B) and 4
+   * feature values (32 B) are read, the pairwise feature costs 3 flops */
+  res[num] = (bench_result){"boost_cmpXnormsq", "hic row", n, 0,
+			    40.0 * n * p, 5.0 * n * p};
+  BENCH_RUN(&res[num], opts->reps,
+	    boost_pthread_run(thread_num, kern->cmpXnormsq, params, threads,
+			      NULL));
+  num++;
+
+  boost_tile_prep(args, thread_num, n, kern->real_size, data, params);
+  res[num] = (bench_result){"l2_cmpUdX", "hic row", n, 0,
+			    48.0 * n * p, 5.0 * n * p};
+  BENCH_RUN(&res[num], opts->reps,
+	    boost_pthread_run(thread_num, kern->cmpUdX, params, threads,
+			      NULL));
+  num++;
+
+  res[num] = (bench_result){"boost_select_axis", "column", p, 0,
+			    16.0 * p, 2.0 * p};
+  BENCH_RUN(&res[num], opts->reps,
+	    s = boost_select_axis(UdX, Xnormsq, p));
+  num++;
+
+  res[num] = (bench_result){"l2_update_U", "hic row", n, 0,
+			    56.0 * n, 8.0 * n};
+  BENCH_RUN(&res[num], opts->reps,
+	    kern->update_U(U, res_sq, 1, n, s, (const void *)features, data,
+			   ckps, 0, 0));
+  num++;
+
+  /* ada_cmpUdX : sign tests, counted as 4 comparisons per (row, column) */
+  {
+    cmpUdX_args *params_ada;
+    pthread_t *threads_ada;
+    const unsigned long q = kmers->num;
+    boost_pthread_prep(thread_num, n, q,
+		       (const void *)features, data, NULL, kmers,
+		       beta_x, UdX, Xnormsq,
+		       &params_ada, &threads_ada);
+    res[num] = (bench_result){"ada_cmpUdX", "hic row", n, 0,
+			      48.0 * n * q, 4.0 * n * q};
+    BENCH_RUN(&res[num], opts->reps,
+	      boost_pthread_run(thread_num, ada_cmpUdX, params_ada,
+				threads_ada, NULL));
+    num++;
+
+    /* the same counts over the sign agreement bitsets (2n bits per
+     * column, one AND and popcount per 64 row sides) */
+    {
+      ada_bits *bits;
+      ada_bits_prep(thread_num, n, q, params_ada, threads_ada, &bits);
+      ada_bits_set_x(bits, beta_x, data->mij, n);
+      res[num] = (bench_result){"ada_cmpUdX_bits", "hic row", n, 0,
+				2.0 / 8 * n * q, 2.0 / 64 * n * q};
+      BENCH_RUN(&res[num], opts->reps,
+		boost_pthread_run(thread_num, ada_cmpUdX_bits, params_ada,
+				  threads_ada, NULL));
+      num++;
+      ada_bits_free(bits);
+    }
+    free(params_ada);
+    free(threads_ada);
+  }
+
+  /* predict with a model of 64 axes */
+  {
+    const unsigned long axes = (p < 64) ? p : 64;
+    model.beta = calloc_errchk(p, sizeof(double), "calloc beta[]");
+    model.res_sq = res_sq;
+    for(j = 0; j < axes; j++){
+      model.beta[(j * p) / axes] = 1e-3;
+    }
+    res[num] = (bench_result){"predict", "hic row", n, 0,
+			      48.0 * n * axes, 5.0 * n * axes};
+    pred = NULL;
+    BENCH_RUN(&res[num], opts->reps,
+	      free(pred);
+	      predict(args, (const double **)features, data, ckps,
+		      &model, &pred, stderr));
+    num++;
+    free(pred);
+    free(model.beta);
+  }
+
+  boost_tile_free(thread_num, params);
+  free(params);
+  free(threads);
+  free(U);
+  free(UdX);
+  free(Xnormsq);
+  free(res_sq);
+  free(beta_x);
+  return num;
+}
+
+static void bench_report(const bench_opts *opts,
+			 const bench_result *res,
+			 const int num,
+			 FILE *fp_txt,
+			 FILE *fp_json){
+  int r;
+  fprintf(fp_txt, "%-20s %12s %12s %10s %10s\n",
+	  "kernel", "sec", "ns/row", "GB/s", "GFLOP/s");
+  for(r = 0; r < num; r++){
+    fprintf(fp_txt, "%-20s %12.6f %12.3f %10.3f %10.3f\n",
+	    res[r].name, res[r].sec,
+	    1e9 * res[r].sec / res[r].rows,
+	    res[r].bytes / res[r].sec / 1e9,
+	    res[r].flops / res[r].sec / 1e9);
+  }
+
+  if(fp_json == NULL){
+    return;
+  }
+  fprintf(fp_json, "{\n");
+  fprintf(fp_json, "  \"version\": \"%d.%d\",\n", VERSION_MAJOR, VERSION_MINOR);
+  fprintf(fp_json, "  \"k\": %d,\n", opts->k);
+  fprintf(fp_json, "  \"bins\": %ld,\n", opts->bins);
+  fprintf(fp_json, "  \"rows\": %ld,\n", opts->rows);
+  fprintf(fp_json, "  \"reps\": %d,\n", opts->reps);
+  fprintf(fp_json, "  \"threads\": %d,\n", opts->threads);
+  fprintf(fp_json, "  \"results\": [\n");
+  for(r = 0; r < num; r++){
+    fprintf(fp_json,
+	    "    {\"name\": \"%s\", \"row\": \"%s\", \"rows\": %ld, "
+	    "\"sec\": %e, \"ns_per_row\": %e, \"gb_per_s\": %e, "
+	    "\"gflop_per_s\": %e}%s\n",
+	    res[r].name, res[r].row, res[r].rows, res[r].sec,
+	    1e9 * res[r].sec / res[r].rows,
+	    res[r].bytes / res[r].sec / 1e9,
+	    res[r].flops / res[r].sec / 1e9,
+	    (r + 1 < num) ? "," : "");
+  }
+  fprintf(fp_json, "  ]\n");
+  fprintf(fp_json, "}\n");
+}
+
+static void bench_usage(FILE *fp,
+			const char *prog_name){
+  fprintf(fp, "usage:\n");
+  fprintf(fp, "%s [--k K] [--bins B] [--rows N] [--reps R] [--thread T] [--json FILE]\n",
+	  prog_name);
+  fprintf(fp, "  K : k-mer length (default: 4)\n");
+  fprintf(fp, "  B : number of 1 kb bins of the synthetic sequence (default: 2000)\n");
+  fprintf(fp, "  N : number of synthetic Hi-C rows (default: 10000)\n");
+  fprintf(fp, "  R : repetitions, the best time is reported (default: 3)\n");
+  fprintf(fp, "  T : threads of the column kernels (default: 1)\n");
+  fprintf(fp, "  FILE : JSON report (\"-\" : stdout)\n");
+}
+
+int main(int argc, char **argv){
+  bench_opts opts = {4, 2000, 10000, 3, 1, NULL};
+  bench_result res[BENCH_MAX];
+  cmd_args *args;
+  char dir[] = "/tmp/qloop_bench.XXXXXX";
+  char fasta[F_NAME_LEN], hic_file[F_NAME_LEN];
+  char ckp[F_NAME_LEN], kmer_file[F_NAME_LEN];
+  int opt, opt_idx = 0, num;
+  struct option long_opts[] = {
+    {"help",   no_argument,       NULL, 'h'},
+    {"k",      required_argument, NULL, 'k'},
+    {"bins",   required_argument, NULL, 'b'},
+    {"rows",   required_argument, NULL, 'n'},
+    {"reps",   required_argument, NULL, 'r'},
+    {"thread", required_argument, NULL, 't'},
+    {"json",   required_argument, NULL, 'j'},
+    {0, 0, 0, 0}
+  };
+
+  while((opt = getopt_long(argc, argv, "hk:b:n:r:t:j:",
+			   long_opts, &opt_idx)) != -1){
+    switch(opt){
+      case 'h':
+	bench_usage(stdout, argv[0]);
+	return 0;
+      case 'k':
+	opts.k = atoi(optarg);
+	break;
+      case 'b':
+	opts.bins = strtoul(optarg, NULL, 10);
+	break;
+      case 'n':
+	opts.rows = strtoul(optarg, NULL, 10);
+	break;
+      case 'r':
+	opts.reps = atoi(optarg);
+	break;
+      case 't':
+	opts.threads = atoi(optarg);
+	break;
+      case 'j':
+	opts.json = optarg;
+	break;
+      default:
+	bench_usage(stderr, argv[0]);
+	return EXIT_FAILURE;
+    }
+  }
+  if(opts.k < 1 || opts.k > L2_K_MAX || opts.bins < 64 || opts.rows < 1 ||
+     opts.reps < 1 || opts.threads < 1){
+    bench_usage(stderr, argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if(mkdtemp(dir) == NULL){
+    perror("mkdtemp");
+    return EXIT_FAILURE;
+  }
+  sprintf(fasta, "%s/synthetic.fa", dir);
+  sprintf(hic_file, "%s/synthetic.hic", dir);
+  sprintf(ckp, "%s/synthetic.ckp", dir);
+  sprintf(kmer_file, "%s/synthetic.kmer", dir);
+
+  args = calloc_errchk(1, sizeof(cmd_args), "calloc cmd_args");
+  args->k = opts.k;
+  args->res = 1000;
+  args->margin = 0;
+  args->fasta_file = fasta;
+  args->hic_file = hic_file;
+  args->kmer_pair = ckp;
+  args->kmer = kmer_file;
+  args->thread_num = opts.threads;
+  args->prog_name = argv[0];
+  args->f_norm = L1;
+  args->precision = DOUBLE;
+  args->tile = 1;
+
+  bench_inputs(&opts, args);
+
+  {
+    /* the readers and kernels log to stderr : keep the report readable */
+    const int fd_err = dup(STDERR_FILENO);
+    const int fd_null = open("/dev/null", O_WRONLY);
+    fflush(stderr);
+    if(fd_null >= 0){
+      dup2(fd_null, STDERR_FILENO);
+      close(fd_null);
+    }
+    num = bench_kernels(&opts, args, res);
+    fflush(stderr);
+    if(fd_err >= 0){
+      dup2(fd_err, STDERR_FILENO);
+      close(fd_err);
+    }
+  }
+
+  {
+    FILE *fp_json = NULL;
+    if(opts.json != NULL){
+      fp_json = (strcmp(opts.json, "-") == 0) ? stdout : bench_fopen(opts.json);
+    }
+    bench_report(&opts, res, num, (fp_json == stdout) ? stderr : stdout,
+		 fp_json);
+    if(fp_json != NULL && fp_json != stdout){
+      fclose(fp_json);
+    }
+  }
+
+  unlink(fasta);
+  unlink(hic_file);
+  unlink(ckp);
+  unlink(kmer_file);
+  rmdir(dir);
+  free(args);
+  return 0;
+}
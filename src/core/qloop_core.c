@@ -0,0 +1,7 @@
+/**
+ * qloop core library : the only translation unit of the headers of
+ * old/src, whose functions are defined in the headers
+ */
+
+#include "qloop_core.h"
+#include "qloop.h"
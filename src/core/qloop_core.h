@@ -0,0 +1,27 @@
+//
+// entry points of the qloop core library (old/src/qloop.h)
+//
+
+#ifndef QLOOP_CORE_H
+#define QLOOP_CORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the command lines of twin, pred and kmer_filter */
+int qloop_twin_main(int argc, char **argv);
+int qloop_pred_main(int argc, char **argv);
+int qloop_filter_main(int argc, char **argv);
+
+/* twin, then pred of the training rows, on one load of the data */
+int qloop_pipeline_main(int argc, char **argv);
+
+/* the Hi-C input of twin and pred from a raw contact list (prep.h) */
+int qloop_prep_main(int argc, char **argv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //QLOOP_CORE_H
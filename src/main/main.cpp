@@ -3,16 +3,61 @@
 //
 
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "config.h"
+#include "qloop_core.h"
 
 using namespace std;
 
 int version() {
     std::cout << "version " << VERSION_MAJOR << "." << VERSION_MINOR << std::endl;
+    return 0;
 }
 
+int usage(const char *prog) {
+    std::cerr << "usage: " << prog << " <command> [options]" << std::endl
+              << std::endl
+              << "commands:" << std::endl
+              << "  train     L2 Boosting over canonical k-mer pairs (twin)" << std::endl
+              << "  predict   prediction with a trained model (pred)" << std::endl
+              << "  filter    AdaBoost k-mer filter (kmer_filter)" << std::endl
+              << "  pipeline  train, then predict the training data on one load" << std::endl
+              << "  prep      Hi-C input from a raw contact list (hic_prep.py)" << std::endl
+              << "  version   print the version" << std::endl;
+    return 1;
+}
+
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        return usage(argv[0]);
+    }
+
+    const string cmd = argv[1];
+    int (*run)(int, char **) = nullptr;
+    if (cmd == "train") {
+        run = qloop_twin_main;
+    } else if (cmd == "predict") {
+        run = qloop_pred_main;
+    } else if (cmd == "filter") {
+        run = qloop_filter_main;
+    } else if (cmd == "pipeline") {
+        run = qloop_pipeline_main;
+    } else if (cmd == "prep") {
+        run = qloop_prep_main;
+    } else if (cmd == "version" || cmd == "-v" || cmd == "--version") {
+        return version();
+    } else {
+        std::cerr << argv[0] << ": unknown command " << cmd << std::endl;
+        return usage(argv[0]);
+    }
 
-int main() {
-    version();
+    // the options of the command follow "qloop <command>"
+    string prog = string(argv[0]) + " " + cmd;
+    vector<char *> sub_argv(argv + 1, argv + argc);
+    sub_argv[0] = &prog[0];
+    sub_argv.push_back(nullptr);
+    return run(argc - 1, sub_argv.data());
 }